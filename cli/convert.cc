@@ -0,0 +1,76 @@
+#include <fstream>
+#include <iostream>
+
+#include <cxxopts.hpp>
+
+#include <ctranslate2/models/model.h>
+#include <ctranslate2/utils.h>
+
+// Files of the model directory that are copied as is.
+static const std::vector<std::string> model_resources = {
+  "shared_vocabulary.txt",
+  "source_vocabulary.txt",
+  "target_vocabulary.txt",
+  "vmap.txt",
+};
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options cmd_options("convert", "CTranslate2 model conversion client");
+  cmd_options.add_options()
+    ("h,help", "Display available options.")
+    ("model", "Path to the CTranslate2 model directory.", cxxopts::value<std::string>())
+    ("output_dir", "Path to an existing directory where the converted model is saved.",
+     cxxopts::value<std::string>())
+    ("compute_type", "The type of the converted weights: default, float, int16, or int8",
+     cxxopts::value<std::string>()->default_value("default"))
+    ("process_linear_weights",
+     "Also save the linear weights processed for this CPU (u8 compensation terms, and packed "
+     "weights when CT2_USE_EXPERIMENTAL_PACKED_GEMM is set). The converted model can then only "
+     "be loaded on a CPU with the same ISA and Gemm backend.",
+     cxxopts::value<bool>()->default_value("false"))
+    ("intra_threads", "Number of OpenMP threads (set to 0 to use the default value).",
+     cxxopts::value<size_t>()->default_value("0"))
+    ;
+
+  auto args = cmd_options.parse(argc, argv);
+
+  if (args.count("help")) {
+    std::cerr << cmd_options.help() << std::endl;
+    return 0;
+  }
+  if (!args.count("model")) {
+    throw std::invalid_argument("Option --model is required to run the conversion");
+  }
+  if (!args.count("output_dir")) {
+    throw std::invalid_argument("Option --output_dir is required to run the conversion");
+  }
+
+  ctranslate2::set_num_threads(args["intra_threads"].as<size_t>());
+
+  const auto model_dir = args["model"].as<std::string>();
+  const auto output_dir = args["output_dir"].as<std::string>();
+  if (model_dir == output_dir)
+    throw std::invalid_argument("The output directory should be different from the model "
+                                "directory");
+
+  const auto compute_type = ctranslate2::str_to_compute_type(args["compute_type"].as<std::string>());
+  const auto model = ctranslate2::models::Model::load(model_dir,
+                                                      ctranslate2::Device::CPU,
+                                                      /*device_index=*/0,
+                                                      compute_type);
+  model->save(output_dir, args["process_linear_weights"].as<bool>());
+
+  ctranslate2::models::ModelFileReader model_reader(model_dir);
+  for (const auto& filename : model_resources) {
+    auto resource = model_reader.get_file(filename, /*binary=*/true);
+    if (!resource)
+      continue;
+    const std::string path = output_dir + "/" + filename;
+    std::ofstream output(path, std::ios_base::out | std::ios_base::binary);
+    if (!output)
+      throw std::runtime_error("Unable to open output file " + path);
+    output << resource->rdbuf();
+  }
+
+  return 0;
+}
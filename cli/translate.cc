@@ -31,8 +31,11 @@ int main(int argc, char* argv[]) {
      cxxopts::value<size_t>()->default_value("32"))
     ("read_batch_size", "Size of the batch to read at once (defaults to batch_size).",
      cxxopts::value<size_t>()->default_value("0"))
-    ("batch_type", "Batch type (can be examples, tokens).",
+    ("batch_type", "Batch type (can be examples, tokens, decoding_cost).",
      cxxopts::value<std::string>()->default_value("examples"))
+    ("target_length_ratio", "Expected target/source length ratio to estimate the decoding "
+     "cost with batch_type decoding_cost (set 0 to estimate it from the translations).",
+     cxxopts::value<float>()->default_value("0"))
     ("beam_size", "Beam search size (set 1 for greedy decoding).",
      cxxopts::value<size_t>()->default_value("2"))
     ("sampling_topk", "Sample randomly from the top K candidates.",
@@ -107,6 +110,7 @@ int main(int argc, char* argv[]) {
   auto options = ctranslate2::TranslationOptions();
   options.max_batch_size = args["batch_size"].as<size_t>();
   options.batch_type = ctranslate2::str_to_batch_type(args["batch_type"].as<std::string>());
+  options.target_length_ratio = args["target_length_ratio"].as<float>();
   options.beam_size = args["beam_size"].as<size_t>();
   options.length_penalty = args["length_penalty"].as<float>();
   options.coverage_penalty = args["coverage_penalty"].as<float>();
@@ -10,10 +10,22 @@ namespace ctranslate2 {
   enum class BatchType {
     Examples,
     Tokens,
+    DecodingCost,
   };
 
   BatchType str_to_batch_type(const std::string& batch_type);
 
+  // Estimates the cost of decoding an example for BatchType::DecodingCost. The decoder runs
+  // beam_size hypotheses for each target position, so the cost is the number of decoded
+  // tokens: beam_size * min(target_length_ratio * source_length, max_target_length).
+  struct DecodingCostModel {
+    size_t beam_size = 1;
+    float target_length_ratio = 1;
+    size_t max_target_length = 0;  // 0 means unlimited.
+
+    size_t get_cost(size_t source_length) const;
+  };
+
   // Base class to produce batches.
   class BatchReader {
   public:
@@ -21,7 +33,8 @@ namespace ctranslate2 {
 
     std::vector<std::vector<std::string>>
     get_next(const size_t max_batch_size,
-             const BatchType batch_type = BatchType::Examples);
+             const BatchType batch_type = BatchType::Examples,
+             const DecodingCostModel& cost_model = DecodingCostModel());
 
   protected:
     // Returns true if there are still elements to read.
@@ -100,7 +113,8 @@ namespace ctranslate2 {
     // number of examples from the other streams.
     std::vector<std::vector<std::vector<std::string>>>
     get_next(const size_t max_batch_size,
-             const BatchType batch_type = BatchType::Examples);
+             const BatchType batch_type = BatchType::Examples,
+             const DecodingCostModel& cost_model = DecodingCostModel());
 
   private:
     std::vector<std::unique_ptr<BatchReader>> _readers;
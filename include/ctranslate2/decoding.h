@@ -1,21 +1,33 @@
 #pragma once
 
+#include <functional>
+
 #include "ctranslate2/layers/decoder.h"
 #include "ctranslate2/sampling.h"
 #include "ctranslate2/generation_result.h"
 
 namespace ctranslate2 {
 
+  using GenerationCallback = std::function<void(const GenerationStepResult<size_t>&)>;
+
   class SearchStrategy {
   public:
     virtual ~SearchStrategy() = default;
+    // Each example starts at the step start_steps[b] (e.g. after a target prefix run in the
+    // decoder) and the decoding stops at the step max_length. The end id can not be generated
+    // before the step min_length. prefix_ids[b] is forced from the step start_steps[b] if it
+    // is longer, and its first start_steps[b] ids are included in the streamed output.
+    // When is_cancelled is set, it is called before each step with the batch index of each
+    // unfinished example: cancelled examples are removed from the batch without result.
+    // When callback is set, it is called as soon as an example produces output ids (see
+    // GenerationStepResult).
     virtual void
     search(layers::Decoder& decoder,
            layers::DecoderState& state,
            const Sampler& sampler,
            const std::vector<size_t>& start_ids,
            const size_t end_id,
-           const dim_t start_step,
+           const std::vector<dim_t>& start_steps,
            const dim_t max_length,
            const dim_t min_length,
            const std::vector<size_t>* output_ids_map,
@@ -23,7 +35,9 @@ namespace ctranslate2 {
            std::vector<std::vector<float>>* scores = nullptr,
            std::vector<std::vector<std::vector<std::vector<float>>>>* attention = nullptr,
            const size_t num_hypotheses = 1,
-           const std::vector<std::vector<size_t>>* prefix_ids = nullptr) const = 0;
+           const std::vector<std::vector<size_t>>* prefix_ids = nullptr,
+           const std::function<bool(size_t)>* is_cancelled = nullptr,
+           const GenerationCallback* callback = nullptr) const = 0;
   };
 
   class BeamSearch : public SearchStrategy {
@@ -36,7 +50,7 @@ namespace ctranslate2 {
            const Sampler& sampler,
            const std::vector<size_t>& start_ids,
            const size_t end_id,
-           const dim_t start_step,
+           const std::vector<dim_t>& start_steps,
            const dim_t max_length,
            const dim_t min_length,
            const std::vector<size_t>* output_ids_map,
@@ -44,7 +58,9 @@ namespace ctranslate2 {
            std::vector<std::vector<float>>* scores = nullptr,
            std::vector<std::vector<std::vector<std::vector<float>>>>* attention = nullptr,
            const size_t num_hypotheses = 1,
-           const std::vector<std::vector<size_t>>* prefix_ids = nullptr) const override;
+           const std::vector<std::vector<size_t>>* prefix_ids = nullptr,
+           const std::function<bool(size_t)>* is_cancelled = nullptr,
+           const GenerationCallback* callback = nullptr) const override;
 
   private:
     const dim_t _beam_size;
@@ -60,7 +76,7 @@ namespace ctranslate2 {
            const Sampler& sampler,
            const std::vector<size_t>& start_ids,
            const size_t end_id,
-           const dim_t start_step,
+           const std::vector<dim_t>& start_steps,
            const dim_t max_length,
            const dim_t min_length,
            const std::vector<size_t>* output_ids_map,
@@ -68,9 +84,94 @@ namespace ctranslate2 {
            std::vector<std::vector<float>>* scores = nullptr,
            std::vector<std::vector<std::vector<std::vector<float>>>>* attention = nullptr,
            const size_t num_hypotheses = 1,
-           const std::vector<std::vector<size_t>>* prefix_ids = nullptr) const override;
+           const std::vector<std::vector<size_t>>* prefix_ids = nullptr,
+           const std::function<bool(size_t)>* is_cancelled = nullptr,
+           const GenerationCallback* callback = nullptr) const override;
   };
 
+  // Greedy search where new sequences can join the running batch before each step and
+  // finished sequences are returned immediately (continuous batching). Each sequence keeps
+  // its own decoding step, so the batch can be refilled while it is being decoded.
+  // The callback is called with the sequence id as batch_id for each generated id.
+  class ContinuousGreedySearch {
+  public:
+    ContinuousGreedySearch(layers::Decoder& decoder,
+                           const Sampler& sampler,
+                           const size_t end_id,
+                           const std::vector<size_t>* output_ids_map = nullptr,
+                           GenerationCallback callback = nullptr);
+
+    // Adds sequences identified by ids. state is the initial decoder state of these sequences
+    // (e.g. with the encoder output). The first decoding step of the new sequences is run
+    // immediately and the unfinished sequences are merged in the running batch.
+    void add(layers::DecoderState state,
+             const std::vector<size_t>& ids,
+             const std::vector<size_t>& start_ids,
+             const dim_t max_length,
+             const dim_t min_length,
+             const bool return_scores);
+
+    // Runs a decoding step for all running sequences.
+    void step();
+
+    // Number of running sequences.
+    size_t num_sequences() const;
+
+    // Returns the sequences that finished since the last call.
+    std::vector<std::pair<size_t, GenerationResult<size_t>>> get_finished();
+
+    // Removes the running sequences for which the predicate returns true, without result.
+    void remove(const std::function<bool(size_t)>& predicate);
+
+  private:
+    struct Sequence {
+      size_t id;
+      dim_t step;
+      dim_t max_step;
+      dim_t min_step;
+      bool return_scores;
+      size_t last_id;
+      std::vector<size_t> output_ids;
+      float score;
+    };
+
+    // Samples the next ids and removes the finished sequences from the batch.
+    void update(StorageView& logits,
+                std::vector<Sequence>& sequences,
+                layers::DecoderState& state);
+    void finish(Sequence& sequence);
+
+    layers::Decoder& _decoder;
+    const Sampler& _sampler;
+    const size_t _end_id;
+    const std::vector<size_t>* _output_ids_map;
+    const GenerationCallback _callback;
+    layers::DecoderState _state;
+    std::vector<Sequence> _sequences;
+    std::vector<std::pair<size_t, GenerationResult<size_t>>> _finished;
+  };
+
+  // Decoder state of a single sequence after running its target prefix, which can be updated
+  // for a longer prefix by running only the new prefix ids (see update_prefix_state).
+  struct DecoderPrefixState {
+    layers::DecoderState state;
+    // Ids passed to the decoder: the start id followed by the prefix ids except the last one.
+    std::vector<size_t> input_ids;
+    // Attention vectors of each decoder input.
+    std::vector<std::vector<float>> attention;
+  };
+
+  // Updates prefix_state for the target prefix prefix_ids. prefix_state.state should be the
+  // initial decoder state (e.g. with the encoder output) or a state returned by a previous
+  // call with a prefix that is a prefix of prefix_ids. Returns false if the state can not be
+  // updated because the previous prefix is not a prefix of prefix_ids.
+  bool update_prefix_state(layers::Decoder& decoder,
+                           DecoderPrefixState& prefix_state,
+                           const size_t start_id,
+                           const std::vector<size_t>& prefix_ids);
+
+  // If prefix_state is set, the batch contains a single example and state is a copy of the
+  // prefix state for prefix_ids: the prefix is not run again in the decoder.
   std::vector<GenerationResult<size_t>>
   decode(layers::Decoder& decoder,
          layers::DecoderState& state,
@@ -85,6 +186,9 @@ namespace ctranslate2 {
          const size_t num_hypotheses,
          const bool return_alternatives,
          const bool return_scores,
-         const bool return_attention);
+         const bool return_attention,
+         const std::function<bool(size_t)>* is_cancelled = nullptr,
+         const GenerationCallback* callback = nullptr,
+         const DecoderPrefixState* prefix_state = nullptr);
 
 }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "models/model.h"
+#include "storage_view.h"
+
+namespace ctranslate2 {
+
+  // Thread-safe cache of the encoder outputs of source sequences that evicts the least
+  // recently used outputs when they exceed a memory budget. It is used by Translator to skip
+  // the encoder when the same source is translated again, e.g. with a different target
+  // prefix. The cache can be shared by translators using models on the same device.
+  class EncoderCache {
+  public:
+    EncoderCache(size_t max_memory);
+
+    // Sets output to the cached encoder output of the source ids (with shape
+    // [1, ids.size(), depth]) and returns true if they are cached.
+    bool get(const std::shared_ptr<const models::Model>& model,
+             const std::vector<size_t>& ids,
+             StorageView& output);
+    void put(const std::shared_ptr<const models::Model>& model,
+             const std::vector<size_t>& ids,
+             StorageView output);
+    void clear();
+
+    // Memory in bytes used by the cached outputs.
+    size_t memory_usage() const;
+    size_t num_hits() const;
+    size_t num_misses() const;
+    // Ratio of the lookups that found an output (0 if there was no lookups).
+    float hit_ratio() const;
+
+  private:
+    struct Entry {
+      std::string key;
+      // The key contains the model address which can be reused by another model after
+      // this one is released.
+      std::weak_ptr<const models::Model> model;
+      StorageView output;
+      size_t memory_usage;
+    };
+
+    void erase(std::list<Entry>::iterator it);
+
+    mutable std::mutex _mutex;
+    // Entries from the most recently used to the least recently used.
+    std::list<Entry> _entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+    size_t _memory_usage = 0;
+    const size_t _max_memory;
+    std::atomic<size_t> _num_hits{0};
+    std::atomic<size_t> _num_misses{0};
+  };
+
+}
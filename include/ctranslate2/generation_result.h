@@ -5,6 +5,17 @@
 
 namespace ctranslate2 {
 
+  // Output of an example during decoding.
+  template <typename T>
+  struct GenerationStepResult {
+    size_t batch_id;       // Index of the example in the batch.
+    size_t step;           // Decoding step.
+    std::vector<T> tokens; // With greedy search, the token generated at this step (empty when
+                           // the end of sequence is generated). With beam search, the best
+                           // hypothesis of the finished example.
+    bool is_last;          // The example is finished.
+  };
+
   template <typename T>
   class GenerationResult {
   public:
@@ -25,6 +25,8 @@ namespace ctranslate2 {
                          LayerNormStrategy layer_norm_strategy = LayerNormStrategy::Input);
       DataType output_type() const override;
       dim_t output_size() const override;
+      // attention_bias is optionally added to the attention scores before the softmax
+      // (e.g. to mask some cached positions).
       void operator()(const StorageView& queries,
                       const StorageView* memory,
                       const StorageView* memory_lengths,
@@ -32,7 +34,8 @@ namespace ctranslate2 {
                       StorageView* cached_keys = nullptr,
                       StorageView* cached_values = nullptr,
                       StorageView* attention = nullptr,
-                      const Padder* padder = nullptr) const;
+                      const Padder* padder = nullptr,
+                      const StorageView* attention_bias = nullptr) const;
     private:
       const dim_t _num_heads;
       const bool _self_attention;
@@ -26,6 +26,45 @@ namespace ctranslate2 {
                               StorageView* logits = nullptr,
                               StorageView* attention = nullptr) = 0;
 
+      // Runs the decoding steps start_step to start_step + time - 1 without computing the
+      // logits, e.g. to force a target prefix. ids has shape [batch_size, time] and the
+      // optional attention has shape [batch_size, time, memory_time]. The default
+      // implementation runs one step at a time.
+      virtual void forward_prefix(dim_t start_step,
+                                  const StorageView& ids,
+                                  DecoderState& state,
+                                  StorageView* attention = nullptr);
+
+      // Runs prefixes of different lengths from the initial state in a single call. ids has
+      // shape [batch_size, time] and is padded on the left: the inputs of the batch entry b
+      // are its last lengths[b] ids. The optional attention has shape
+      // [batch_size, time, memory_time] and includes the padding positions. The entry b is
+      // then at step lengths[b] and the next steps should be run with the steps operator
+      // below. By default, this method is not supported and throws an exception.
+      virtual void forward_prefix(const std::vector<dim_t>& lengths,
+                                  const StorageView& ids,
+                                  DecoderState& state,
+                                  StorageView* attention = nullptr);
+
+      // Continuous batching: runs a decoding step where each batch entry is at a different
+      // step. The entries should have run their first step separately and then be merged
+      // in the same state with append_state, or have run their prefix with the method above.
+      // By default, these methods are not supported and throw an exception.
+      virtual void operator()(const std::vector<dim_t>& steps,
+                              const StorageView& ids,
+                              DecoderState& state,
+                              StorageView* logits = nullptr,
+                              StorageView* attention = nullptr);
+      // Appends the batch entries of other_state to state.
+      virtual void append_state(DecoderState& state, DecoderState& other_state) const;
+
+      // Returns an approximation of the peak memory in bytes used to decode a batch entry
+      // (including its state) for max_length steps with an encoder output of memory_length
+      // positions, or 0 if unknown.
+      virtual size_t estimate_memory_usage(dim_t, dim_t) const {
+        return 0;
+      }
+
       // Gathers states based on indices.
       void gather_state(DecoderState& state, const StorageView& indices) const;
 
@@ -14,6 +14,12 @@ namespace ctranslate2 {
       virtual void operator()(const StorageView& ids,
                               const StorageView& lengths,
                               StorageView& output) = 0;
+
+      // Returns an approximation of the peak memory in bytes used to encode a batch entry
+      // of this length, or 0 if unknown.
+      virtual size_t estimate_memory_usage(dim_t) const {
+        return 0;
+      }
     };
 
   }
@@ -2,20 +2,32 @@
 
 #include <istream>
 #include <unordered_map>
+#include <unordered_set>
 #include <memory>
+#include <mutex>
 
 #include "ctranslate2/storage_view.h"
+#include "ctranslate2/utils.h"
 
 namespace ctranslate2 {
   namespace models {
 
-    static const size_t current_binary_version = 4;
+    static const size_t current_binary_version = 6;
 
     // Checks whether the provided path could contain a CTranslate2 model.
     bool contains_model(const std::string& path);
 
     class ModelReader;
 
+    // Location of a variable in a model file.
+    struct VariableEntry {
+      std::string name;
+      Shape shape;
+      DataType dtype;
+      dim_t num_bytes;
+      std::streamoff offset;
+    };
+
     // Base class for models.
     class Model {
     public:
@@ -48,9 +60,42 @@ namespace ctranslate2 {
       // If the model contains variables, they will be moved to the new device.
       void set_device(const Device device, const int index = 0);
 
+      // When the model is loaded lazily, the variable is materialized on first access.
+      // The returned variables remain valid until they are released by unload_variables.
       const StorageView* get_variable_if_exists(const std::string& name) const;
       const StorageView& get_variable(const std::string& name) const;
-      const std::unordered_map<std::string, StorageView>& get_variables() const;
+      // Returns a snapshot of the variables. When the model is loaded lazily, only the
+      // materialized variables are returned and other threads can materialize more variables
+      // in the meantime. The pointers remain valid until the variables are released by
+      // unload_variables.
+      std::unordered_map<std::string, const StorageView*> get_variables() const;
+
+      // Returns the number of bytes used by the variables. Buffers that are shared by multiple
+      // variables are counted once. For a lazy model, only the materialized variables are counted.
+      size_t get_memory_usage() const;
+      // Returns the number of bytes used by the variables once they are all materialized. For
+      // a lazy model, this is estimated from the variable index and the conversion to the
+      // compute type, ignoring the quantization scales and the processed linear weights.
+      // Otherwise this is the same as get_memory_usage.
+      size_t get_full_memory_usage() const;
+
+      // Saves the model in the current binary version to model_dir/model.bin. The variables
+      // are saved with the converted type. If with_processed_weights is true, the processed
+      // linear weights (u8 compensation and packed weights) are also saved: the saved model
+      // can then only be loaded with the same CPU ISA and Gemm backend.
+      void save(const std::string& model_dir, const bool with_processed_weights = false) const;
+
+      // Returns true if the variables are materialized on first access
+      // (see ModelReader::lazy_load).
+      bool is_lazy() const;
+      // Releases the materialized variables of a model loaded lazily. They will be materialized
+      // again on the next access. The variables are not released and false is returned while
+      // they are in use (see ModelVariablesGuard).
+      bool unload_variables() const;
+      // Number of times the variables were released by unload_variables. The layers built
+      // from the model reference its variables: they should be built again when this value
+      // changed since they were built.
+      size_t variables_generation() const;
 
       // Attributes are saved as scalar variables.
       template <typename T>
@@ -91,13 +136,94 @@ namespace ctranslate2 {
       ComputeType _effective_compute_type = ComputeType::DEFAULT;
 
     private:
-      void process_linear_weights();
+      // Memory mappings (files or shared memory) and variables shared with other models that
+      // are directly viewed by some variables.
+      std::vector<std::shared_ptr<const void>> _mapped_memory;
+      // The spec name saved in the model file.
+      std::string _spec;
+      // Size of the mapped buffers holding more data than the shape of the variables viewing
+      // them (e.g. packed weights), so that they are saved with all their data. For a lazy
+      // model, this is protected by _lazy_mutex.
+      std::unordered_map<const void*, dim_t> _mapped_buffer_bytes;
+
+      void register_mapped_buffer(const StorageView& variable, const dim_t num_bytes);
+      // Returns the size in bytes of each variable buffer. For a lazy model, this should be
+      // called with _lazy_mutex locked.
+      std::unordered_map<const void*, dim_t> get_buffer_bytes() const;
+
+      static std::shared_ptr<Model> read_model(ModelReader& model_reader,
+                                               Device device,
+                                               int device_index,
+                                               ComputeType compute_type);
+      static std::shared_ptr<const Model> load_shared(ModelReader& model_reader,
+                                                      const std::string& shared_memory_name,
+                                                      Device device,
+                                                      int device_index,
+                                                      ComputeType compute_type);
+      static std::shared_ptr<const Model> attach_shared(ModelReader& model_reader,
+                                                        std::shared_ptr<SharedMemory> segment);
+      void write_shared(SharedMemory& segment) const;
+
+      // Lazy loading state: the model file index is kept to materialize variables on demand.
+      bool _lazy = false;
+      mutable std::mutex _lazy_mutex;
+      // Number of ModelVariablesGuard instances and of calls to unload_variables which
+      // released the variables, protected by _lazy_mutex.
+      mutable size_t _num_variables_guards = 0;
+      size_t _variables_generation = 0;
+      std::unique_ptr<std::istream> _lazy_file;
+      std::shared_ptr<const MappedFile> _lazy_mapped_file;
+      std::unordered_map<std::string, VariableEntry> _lazy_variables;
+      std::unordered_map<std::string, std::string> _lazy_aliases;
+      std::unordered_set<std::string> _materialized_variables;
+
+      bool is_pending_variable(const std::string& name) const;
+      bool materialize_variable(const std::string& name);
+      void process_materialized_weight(const std::string& name,
+                                       std::vector<std::string>& new_variables);
+
+      // Returns true if the model was saved with the processed linear weights, and throws
+      // if they were processed for another platform.
+      bool check_processed_weights() const;
+      // The processed weights are read from and saved to cache_dir, if not empty.
+      void process_linear_weights(const std::string& cache_dir);
+      void process_linear_weight(const std::string& name,
+                                 const StorageView& weight,
+                                 std::unordered_map<std::string, StorageView>& variables_to_add,
+                                 std::vector<std::string>& variables_to_remove) const;
+      bool load_processed_weights(const std::string& path);
+      // Replaces the variables by views on identical variables of other loaded models.
+      void share_variables();
       void set_compute_type(ComputeType type);
+      void convert_variable(const std::string& name,
+                            StorageView& variable,
+                            const DataType target_dtype,
+                            std::unordered_map<std::string, StorageView>& variables_to_add,
+                            std::vector<std::string>& variables_to_remove);
       void ensure_dtype(const std::string& name,
                         StorageView& variable,
                         const DataType target_dtype,
                         std::unordered_map<std::string, StorageView>& variables_to_add,
                         std::vector<std::string>& variables_to_remove);
+
+      friend class ModelVariablesGuard;
+    };
+
+    // Prevents the variables of a model from being released by Model::unload_variables while
+    // this object exists, e.g. while a translator runs the layers built from the model.
+    class ModelVariablesGuard {
+    public:
+      explicit ModelVariablesGuard(const Model& model);
+      ModelVariablesGuard(ModelVariablesGuard&& other);
+      ~ModelVariablesGuard();
+
+      ModelVariablesGuard(const ModelVariablesGuard&) = delete;
+      ModelVariablesGuard& operator=(const ModelVariablesGuard&) = delete;
+      ModelVariablesGuard& operator=(ModelVariablesGuard&&) = delete;
+
+    private:
+      // nullptr if the model is not lazy or the guard was moved.
+      const Model* _model;
     };
 
     // The ModelReader interface allows user code to customize how and where to read model files.
@@ -115,6 +241,31 @@ namespace ctranslate2 {
       std::unique_ptr<std::istream> get_required_file(const std::string& filename,
                                                       const bool binary = false);
 
+      // Returns a read-only memory mapping of a binary file included in the model, or nullptr
+      // if the file should not be mapped. When a mapping is returned, variables whose type
+      // does not need to be converted will directly view the mapped data.
+      virtual std::shared_ptr<const MappedFile> map_file(const std::string& filename);
+
+      // Returns the name of a shared memory segment where the model should be loaded, or an
+      // empty string to load the model in the process memory.
+      virtual std::string get_shared_memory_name() const;
+
+      // Returns true if the variables should only be materialized when they are first accessed.
+      // By default, this is enabled with the environment variable CT2_USE_LAZY_LOADING.
+      // This requires a model saved with binary version >= 6.
+      virtual bool lazy_load() const;
+
+      // Returns a directory where the processed linear weights (e.g. packed weights) are
+      // cached, so that the next loads of the same model read them instead of computing them
+      // again, or an empty string to disable the cache. By default, this is the environment
+      // variable CT2_PACKED_WEIGHTS_CACHE_DIR.
+      virtual std::string processed_weights_cache_dir() const;
+
+      // Returns true if the variables should be shared with identical variables (same type,
+      // shape, and content) of other models loaded in the process, e.g. the embeddings of
+      // models fine-tuned from the same parent. This does not apply to lazy models.
+      // By default, this is enabled with the environment variable CT2_USE_WEIGHT_DEDUPLICATION.
+      virtual bool deduplicate_weights() const;
     };
 
     class ModelFileReader : public ModelReader {
@@ -123,11 +274,29 @@ namespace ctranslate2 {
       std::string get_model_id() const override;
       std::unique_ptr<std::istream> get_file(const std::string& filename,
                                              const bool binary = false) override;
+      // Files are mapped when the environment variable CT2_USE_MMAP is enabled.
+      std::shared_ptr<const MappedFile> map_file(const std::string& filename) override;
 
     private:
       std::string _model_dir;
       std::string _path_separator;
     };
 
+    // Loads the model in a named POSIX shared memory segment (e.g. "/ct2-ende"). The first
+    // process builds the segment with the finalized variables (already converted and packed)
+    // and the next processes attach to it in read-only mode, so that the model weights are
+    // stored once per host. The segment persists after the processes exit: it should be
+    // removed with SharedMemory::unlink when the model is updated.
+    class SharedMemoryModelReader : public ModelFileReader {
+    public:
+      SharedMemoryModelReader(std::string model_dir,
+                              std::string shared_memory_name,
+                              std::string path_separator = "/");
+      std::string get_shared_memory_name() const override;
+
+    private:
+      std::string _shared_memory_name;
+    };
+
   }
 }
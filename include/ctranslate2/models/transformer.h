@@ -36,6 +36,9 @@ namespace ctranslate2 {
       PositionEncoder();
       PositionEncoder(const TransformerModel& model, const std::string& scope);
       void operator()(StorageView& input, dim_t index = 0);
+      // Adds the encoding at a different position to each input vector: positions has
+      // batch_size * time values.
+      void operator()(StorageView& input, const std::vector<dim_t>& positions);
     private:
       const StorageView& get_position_encoding(dim_t max_time,
                                                dim_t depth,
@@ -85,7 +88,8 @@ namespace ctranslate2 {
                       StorageView* cached_attn_values,
                       StorageView& output,
                       StorageView* attention = nullptr,
-                      const Padder* padder = nullptr) const;
+                      const Padder* padder = nullptr,
+                      const StorageView* self_attention_bias = nullptr) const;
     private:
       const layers::MultiHeadAttention _self_attention;
       const std::unique_ptr<const layers::MultiHeadAttention> _encoder_attention;
@@ -101,7 +105,9 @@ namespace ctranslate2 {
       void operator()(const StorageView& ids,
                       const StorageView& lengths,
                       StorageView& output) override;
+      size_t estimate_memory_usage(dim_t length) const override;
     private:
+      const dim_t _num_heads;
       const layers::Embeddings _embeddings;
       const ComputeType _compute_type;
       const std::unique_ptr<PositionEncoder> _position_encoder;
@@ -125,9 +131,40 @@ namespace ctranslate2 {
                       layers::DecoderState& state,
                       StorageView* logits = nullptr,
                       StorageView* attention = nullptr) override;
+      // Runs all steps in a single pass with a causal self-attention mask.
+      void forward_prefix(dim_t start_step,
+                          const StorageView& ids,
+                          layers::DecoderState& state,
+                          StorageView* attention = nullptr) override;
+      void forward_prefix(const std::vector<dim_t>& lengths,
+                          const StorageView& ids,
+                          layers::DecoderState& state,
+                          StorageView* attention = nullptr) override;
+      void operator()(const std::vector<dim_t>& steps,
+                      const StorageView& ids,
+                      layers::DecoderState& state,
+                      StorageView* logits = nullptr,
+                      StorageView* attention = nullptr) override;
+      void append_state(layers::DecoderState& state,
+                        layers::DecoderState& other_state) const override;
+      size_t estimate_memory_usage(dim_t memory_length, dim_t max_length) const override;
     protected:
       bool should_reorder_state(const std::string& name) const override;
     private:
+      void decode(const StorageView& ids,
+                  dim_t step,
+                  const std::vector<dim_t>* steps,
+                  const std::vector<dim_t>* lengths,
+                  layers::DecoderState& state,
+                  StorageView* logits,
+                  StorageView* attention);
+      StorageView make_self_attention_bias(dim_t batch_size,
+                                           dim_t time,
+                                           const std::vector<dim_t>* steps,
+                                           const std::vector<dim_t>* lengths,
+                                           layers::DecoderState& state) const;
+
+      const dim_t _num_heads;
       const bool _with_encoder_attention;
       const ComputeType _compute_type;
       const layers::Embeddings _embeddings;
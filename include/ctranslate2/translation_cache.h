@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "translator.h"
+
+namespace ctranslate2 {
+
+  // Thread-safe cache of translation results that evicts the least recently used results
+  // when the cached results exceed a memory budget. The cache is split in shards with their
+  // own lock so that concurrent lookups do not contend on a single lock.
+  class TranslationCache {
+  public:
+    TranslationCache(size_t max_memory, size_t num_shards = 16);
+
+    // Returns true if the translation results are deterministic for these options.
+    // Results of random sampling and translations streamed with a callback are not cached.
+    static bool is_cacheable(const TranslationOptions& options);
+
+    // Returns the key of an example: the model, the source and target prefix tokens, and
+    // the options changing the result.
+    static std::string make_key(const models::Model& model,
+                                const std::vector<std::string>& source,
+                                const std::vector<std::string>* target_prefix,
+                                const TranslationOptions& options);
+
+    // Appends the cached result to results and returns true if the key is cached.
+    bool get(const std::string& key,
+             const std::shared_ptr<const models::Model>& model,
+             std::vector<TranslationResult>& results);
+    void put(const std::string& key,
+             const std::shared_ptr<const models::Model>& model,
+             TranslationResult result);
+    void clear();
+
+    // Estimated memory in bytes used by the cached results.
+    size_t memory_usage() const;
+    size_t num_hits() const;
+    size_t num_misses() const;
+    // Ratio of the lookups that found a result (0 if there was no lookups).
+    float hit_ratio() const;
+
+  private:
+    struct Entry {
+      std::string key;
+      // The key contains the model address which can be reused by another model after
+      // this one is released.
+      std::weak_ptr<const models::Model> model;
+      TranslationResult result;
+      size_t memory_usage;
+    };
+
+    struct Shard {
+      mutable std::mutex mutex;
+      // Entries from the most recently used to the least recently used.
+      std::list<Entry> entries;
+      std::unordered_map<std::string, std::list<Entry>::iterator> index;
+      size_t memory_usage = 0;
+    };
+
+    Shard& get_shard(const std::string& key);
+    static void erase(Shard& shard, std::list<Entry>::iterator it);
+
+    std::vector<std::unique_ptr<Shard>> _shards;
+    const size_t _max_shard_memory;
+    std::atomic<size_t> _num_hits{0};
+    std::atomic<size_t> _num_misses{0};
+  };
+
+}
@@ -1,18 +1,44 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "batch_reader.h"
+#include "encoder_cache.h"
 #include "models/sequence_to_sequence.h"
 #include "generation_result.h"
 
 namespace ctranslate2 {
 
   using TranslationResult = GenerationResult<std::string>;
+  using TranslationStepResult = GenerationStepResult<std::string>;
 
   class Translator;
   class TranslatorPool;
+  class ContinuousBatchTranslator;
+  struct EncodedBatch;
+  class ContinuousGreedySearch;
+  class Sampler;
+  struct DecoderPrefixState;
+
+  // A token shared with running translations to cancel them. The cancelled translations stop
+  // before the next decoding step and fail with a std::runtime_error.
+  class CancellationToken {
+  public:
+    void cancel() {
+      _cancelled = true;
+    }
+    bool is_cancelled() const {
+      return _cancelled;
+    }
+
+  private:
+    std::atomic<bool> _cancelled{false};
+  };
 
   struct TranslationOptions {
     // Maximum batch size to run the model on (set 0 to forward the input as is).
@@ -21,8 +47,14 @@ namespace ctranslate2 {
     // batch reduces the padding and so increases the computation efficiency.
     size_t max_batch_size = 0;
 
-    // Whether "max_batch_size" represents number of examples or tokens.
+    // Whether "max_batch_size" represents number of examples, tokens, or the decoding cost.
     BatchType batch_type = BatchType::Examples;
+    // With BatchType::DecodingCost, "max_batch_size" is the number of tokens decoded for the
+    // batch including all beams (see DecodingCostModel), and the target length is estimated
+    // as target_length_ratio * source length. If 0, TranslatorPool uses the ratio of the
+    // completed translations (see TranslatorPool::estimated_target_length_ratio) and
+    // Translator uses 1.
+    float target_length_ratio = 0;
 
     // Beam size to use for beam search (set 1 to run greedy search).
     size_t beam_size = 2;
@@ -61,15 +93,77 @@ namespace ctranslate2 {
     // Replace unknown target tokens by the original source token with the highest attention.
     bool replace_unknowns = false;
 
+    // Allow TranslatorPool to decode this batch together with other batches that are
+    // added while the decoding is running. Finished examples leave the decoding batch and
+    // new batches join it before each step. This is only applied to greedy search without
+    // target prefix, vocabulary map, attention, and alternatives (see
+    // ContinuousBatchTranslator::is_supported), other options use the static batching.
+    bool continuous_batching = false;
+
+    // Batches queued in TranslatorPool are translated by decreasing priority, then by
+    // increasing deadline, then in submission order.
+    int priority = 0;
+    // Time after which the translation result is no longer useful. A batch that is not
+    // translated before the deadline fails with a std::runtime_error: it is not run if it is
+    // still queued, and it stops before the next decoding step if it is running.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    // If set, the translation can be cancelled with this token (see CancellationToken).
+    std::shared_ptr<CancellationToken> cancellation_token;
+
+    // Function called during the decoding as soon as an example produces tokens: with greedy
+    // search, for each generated token, and with beam search, when the example is finished
+    // (see GenerationStepResult). batch_id is the index of the example in the input batch.
+    // It is not called for empty examples and when returning alternatives.
+    std::function<void(const TranslationStepResult&)> callback;
+
     void validate() const;
+    // Returns the decoding cost model for BatchType::DecodingCost. default_target_length_ratio
+    // is used when target_length_ratio is 0.
+    DecodingCostModel get_decoding_cost_model(float default_target_length_ratio = 1) const;
+    // Returns true if the translation was cancelled or its deadline is exceeded.
+    bool should_stop() const;
+    // Throws a std::runtime_error if the translation was cancelled or its deadline is exceeded.
+    void check_cancellation() const;
+    // Returns true if identical examples can be translated once: the decoding is
+    // deterministic and the examples are not streamed or cancelled separately.
+    bool can_deduplicate_examples() const;
 
   private:
     // Internal options.
     bool validated = false;
     bool rebatch_input = true;
+    // Returns true if the example at this index of the input should be removed from the
+    // decoding batch (e.g. when a batch combines multiple requests).
+    std::function<bool(size_t)> is_example_cancelled;
+
+    bool can_be_cancelled() const;
 
     friend class Translator;
     friend class TranslatorPool;
+    friend class ContinuousBatchTranslator;
+  };
+
+  // Opaque state of an interactive translation used with Translator::translate_with_session.
+  // It holds the encoder output of the source and the decoder state after the last target
+  // prefix, so that a translation with the same source and an extended prefix only runs the
+  // new prefix tokens in the decoder. A session should not be used by multiple translations
+  // at the same time.
+  class TranslationSession {
+  public:
+    TranslationSession();
+    ~TranslationSession();
+    TranslationSession(TranslationSession&& other);
+    TranslationSession& operator=(TranslationSession&& other);
+
+    // Releases the saved state.
+    void clear();
+
+  private:
+    std::weak_ptr<const models::Model> _model;
+    std::vector<std::string> _source;
+    std::unique_ptr<DecoderPrefixState> _prefix_state;
+
+    friend class Translator;
   };
 
   // This class holds all information required to translate from a model. Copying
@@ -77,6 +171,8 @@ namespace ctranslate2 {
   // be safely executed in parallel.
   class Translator {
   public:
+    // Creates a translator without model: set_model should be called before translating.
+    Translator() = default;
     Translator(const std::string& model_dir,
                Device device = Device::CPU,
                int device_index = 0,
@@ -104,11 +200,43 @@ namespace ctranslate2 {
                                 const std::vector<std::vector<std::string>>& target_prefix,
                                 const TranslationOptions& options);
 
+    // Translates with a target prefix and saves the decoder state after the prefix in the
+    // session. If the next call uses the same source and a prefix that extends the previous
+    // one, the encoder is skipped and only the new prefix tokens are run in the decoder.
+    // Otherwise the session is reset. As with return_alternatives, the scores do not
+    // include the prefix tokens.
+    TranslationResult
+    translate_with_session(const std::vector<std::string>& source,
+                           const std::vector<std::string>& target_prefix,
+                           const TranslationOptions& options,
+                           TranslationSession& session);
+
+    // Pipelined translation: encode_batch rebatches the input according to the options and
+    // runs the encoder on each batch. The encoded batches can then be decoded with
+    // decode_batch by another translator using the same model (e.g. running on other cores)
+    // while this translator encodes the next input.
+    std::vector<EncodedBatch>
+    encode_batch(const std::vector<std::vector<std::string>>& source,
+                 const std::vector<std::vector<std::string>>& target_prefix,
+                 const TranslationOptions& options);
+    // Returns the results of the batch examples (see EncodedBatch::example_index).
+    std::vector<TranslationResult>
+    decode_batch(EncodedBatch& batch, const TranslationOptions& options);
+
+    // Returns an approximation of the peak memory in bytes used by the activations and the
+    // decoder state to translate this batch as a single batch (i.e. ignoring max_batch_size).
+    size_t estimate_memory_usage(const std::vector<std::vector<std::string>>& source,
+                                 const std::vector<std::vector<std::string>>& target_prefix,
+                                 const TranslationOptions& options);
+
     Device device() const;
     int device_index() const;
     ComputeType compute_type() const;
 
     // Change the model while keeping the same device and compute type as the previous model.
+    // The layers of a model loaded lazily are built on the first translation, so that its
+    // variables are only materialized when the translator is used. They are built again if
+    // the variables were released in the meantime (see models::Model::unload_variables).
     void set_model(const std::string& model_dir);
     void set_model(models::ModelReader& model_reader);
     void set_model(const std::shared_ptr<const models::Model>& model);
@@ -116,36 +244,164 @@ namespace ctranslate2 {
     // Detach the model from this translator, which becomes unusable until set_model is called.
     void detach_model();
 
+    // Returns the model used by this translator, or nullptr if the model is detached.
+    const std::shared_ptr<const models::Model>& get_model() const;
+
+    // Skips the encoder for the source sequences found in the cache, or disables the cache
+    // if nullptr. The cache can be changed while the translator is running in another thread
+    // and copies of the translator share the same cache.
+    void set_encoder_cache(std::shared_ptr<EncoderCache> cache);
+    std::shared_ptr<EncoderCache> get_encoder_cache() const;
+
   private:
     void assert_has_model() const;
+    // Builds the layers if needed and returns a guard that prevents the model variables from
+    // being released while the layers are used.
+    models::ModelVariablesGuard use_layers();
+    void build_layers();
 
+    // example_index is the index of each example in the translation input, if it was
+    // rebatched.
     std::vector<TranslationResult>
     run_batch_translation(const std::vector<std::vector<std::string>>& source,
                           const std::vector<std::vector<std::string>>& target_prefix,
-                          const TranslationOptions& options);
+                          const TranslationOptions& options,
+                          const std::vector<size_t>* example_index = nullptr);
+    // Runs the decoding from the encoder output in state, or from the decoder state after
+    // the target prefix if prefix_state is set (see decode).
+    std::vector<TranslationResult>
+    run_batch_decoding(const std::vector<std::vector<std::string>>& source,
+                       const std::vector<std::vector<std::string>>& target_prefix,
+                       layers::DecoderState& state,
+                       const TranslationOptions& options,
+                       const std::vector<size_t>* example_index,
+                       const DecoderPrefixState* prefix_state = nullptr);
+
+    dim_t get_preferred_size_multiple() const;
+    // Encodes the source and returns the decoder state initialized with the encoder output.
+    layers::DecoderState encode(const std::vector<std::vector<std::string>>& source);
+    // Runs the encoder on the source sequences missing from the cache and assembles the
+    // padded encoder output of the batch.
+    void encode_with_cache(EncoderCache& cache,
+                           const std::vector<std::vector<size_t>>& source_ids,
+                           const StorageView& ids,
+                           const StorageView& lengths,
+                           StorageView& encoded);
+    // Sets the vocabulary mask of the decoder and returns the mapping from the output ids
+    // to the vocabulary ids (empty if the output ids are the vocabulary ids).
+    std::vector<size_t>
+    update_vocabulary_mask(const std::vector<std::vector<std::string>>& source,
+                           const TranslationOptions& options);
 
     std::shared_ptr<const models::Model> _model;
     std::unique_ptr<layers::Encoder> _encoder;
     std::unique_ptr<layers::Decoder> _decoder;
+    // Value of models::Model::variables_generation when the layers were built.
+    size_t _variables_generation = 0;
     const models::SequenceToSequenceModel* _seq2seq_model = nullptr;
+    // Accessed with std::atomic_load and std::atomic_store.
+    std::shared_ptr<EncoderCache> _encoder_cache;
+
+    friend class ContinuousBatchTranslator;
+  };
+
+  // Translates batches with continuous batching: batches can be added while the decoding is
+  // running and the batch results are returned as soon as all their examples are finished.
+  // The decoder state of the new examples is merged in the running batch, so the decoding
+  // batch size remains high when translations have different lengths.
+  //
+  // The translator should not be used by other translations or have its model replaced
+  // while this instance exists.
+  class ContinuousBatchTranslator {
+  public:
+    ContinuousBatchTranslator(Translator& translator, const TranslationOptions& options);
+    ~ContinuousBatchTranslator();
+
+    // Returns true if the options can be used with continuous batching.
+    static bool is_supported(const TranslationOptions& options);
+
+    // Returns true if a batch with these options can join the running batches.
+    bool accept(const TranslationOptions& options) const;
+
+    // Encodes a new batch and runs its first decoding step. batch_id identifies the batch in
+    // the values returned by get_finished_batches.
+    void add(size_t batch_id,
+             const std::vector<std::vector<std::string>>& source,
+             const TranslationOptions& options);
+
+    // Runs a decoding step for all running examples.
+    void step();
+
+    // Number of examples that are being decoded.
+    size_t num_examples() const;
+
+    // Returns the batches that finished since the last call with their results.
+    std::vector<std::pair<size_t, std::vector<TranslationResult>>> get_finished_batches();
+
+    // Removes the examples of a running batch from the decoding batch.
+    void cancel(size_t batch_id);
+
+  private:
+    struct RunningBatch {
+      std::vector<TranslationResult> results;
+      size_t num_running_examples;
+      std::function<void(const TranslationStepResult&)> callback;
+    };
+
+    void collect_finished_examples();
+    void on_step_result(const GenerationStepResult<size_t>& step_result);
+
+    Translator& _translator;
+    models::ModelVariablesGuard _variables_guard;
+    const TranslationOptions _options;
+    std::vector<size_t> _output_ids_map;
+    std::unique_ptr<const Sampler> _sampler;
+    std::unique_ptr<ContinuousGreedySearch> _search;
+    size_t _start_id;
+    size_t _end_id;
+    std::unordered_map<size_t, RunningBatch> _batches;
+    // Position of each running example: (batch id, index in the batch).
+    std::unordered_map<size_t, std::pair<size_t, size_t>> _examples;
+    size_t _next_example_id = 0;
+    std::vector<std::pair<size_t, std::vector<TranslationResult>>> _finished_batches;
   };
 
   struct Batch {
     std::vector<std::vector<std::string>> source;
     std::vector<std::vector<std::string>> target;
     std::vector<size_t> example_index;  // Index of each example in the original input.
+    // Examples of the original input that are identical to a batch example and are not
+    // translated: pairs (index in the batch, index in the original input).
+    std::vector<std::pair<size_t, size_t>> duplicates;
+  };
+
+  // A batch encoded by Translator::encode_batch.
+  struct EncodedBatch : public Batch {
+    // Initial decoder state including the encoder output ("memory" and "memory_lengths").
+    layers::DecoderState state;
   };
 
   // Rebatch the input according to the translation options.
-  // This function can also reorder the examples to improve efficiency.
+  // This function can also reorder the examples to improve efficiency. If deduplicate is
+  // set, only the first occurrence of identical examples (same source and target) is
+  // included in the batches (see Batch::duplicates). The options overload deduplicates the
+  // examples if TranslationOptions::can_deduplicate_examples is true.
   std::vector<Batch>
   rebatch_input(const std::vector<std::vector<std::string>>& source,
                 const std::vector<std::vector<std::string>>& target,
                 size_t max_batch_size,
-                BatchType batch_type = BatchType::Examples);
+                BatchType batch_type = BatchType::Examples,
+                const DecodingCostModel& cost_model = DecodingCostModel(),
+                bool deduplicate = false);
   std::vector<Batch>
   rebatch_input(const std::vector<std::vector<std::string>>& source,
                 const std::vector<std::vector<std::string>>& target_prefix,
                 const TranslationOptions& options);
 
+  // Moves the results of a batch returned by rebatch_input to their position in the results
+  // of the original input, and copies them to the duplicated examples.
+  void set_batch_results(const Batch& batch,
+                         std::vector<TranslationResult> batch_results,
+                         std::vector<TranslationResult>& results);
+
 }
@@ -1,13 +1,18 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <future>
 #include <fstream>
+#include <list>
+#include <map>
 #include <mutex>
 #include <queue>
 #include <thread>
 
 #include "batch_reader.h"
+#include "translation_cache.h"
 #include "translator.h"
 
 namespace ctranslate2 {
@@ -32,9 +37,22 @@ namespace ctranslate2 {
                    const std::string& model_dir,
                    Args&&... args) {
       const auto model = models::Model::load(model_dir, std::forward<Args>(args)...);
-      create_translators(model, num_translators, num_threads_per_translator);
+      create_translators(model, num_translators, num_threads_per_translator, model->device());
     }
 
+    // Creates a pool translating with multiple models. The models are identified by their
+    // path and are loaded on the first request with the given device and compute type. When
+    // the loaded models use more than max_models_memory bytes (0 for no limit), the least
+    // recently used models are evicted. Lazy models are charged with their size once all
+    // variables are materialized (see models::Model::get_full_memory_usage). The worker
+    // threads are shared by all models.
+    TranslatorPool(size_t num_translators,
+                   size_t num_threads_per_translator,
+                   size_t max_models_memory,
+                   Device device = Device::CPU,
+                   int device_index = 0,
+                   ComputeType compute_type = ComputeType::DEFAULT);
+
     ~TranslatorPool();
 
     // Run a translation job asynchronously.
@@ -46,6 +64,18 @@ namespace ctranslate2 {
                           std::vector<std::vector<std::string>> target_prefix,
                           TranslationOptions options);
 
+    // Run a translation job asynchronously with the model identified by model_id
+    // (only for pools created with multiple models).
+    std::future<std::vector<TranslationResult>>
+    translate_batch_async(const std::string& model_id,
+                          std::vector<std::vector<std::string>> source,
+                          TranslationOptions options);
+    std::future<std::vector<TranslationResult>>
+    translate_batch_async(const std::string& model_id,
+                          std::vector<std::vector<std::string>> source,
+                          std::vector<std::vector<std::string>> target_prefix,
+                          TranslationOptions options);
+
     // Run a translation synchronously.
     // To benefit from parallelism, you can set max_batch_size in the translation options:
     // the input will be split according to this value and each batch will be translated
@@ -57,6 +87,15 @@ namespace ctranslate2 {
     translate_batch(const std::vector<std::vector<std::string>>& source,
                     const std::vector<std::vector<std::string>>& target_prefix,
                     const TranslationOptions& options);
+    std::vector<TranslationResult>
+    translate_batch(const std::string& model_id,
+                    const std::vector<std::vector<std::string>>& source,
+                    const TranslationOptions& options);
+    std::vector<TranslationResult>
+    translate_batch(const std::string& model_id,
+                    const std::vector<std::vector<std::string>>& source,
+                    const std::vector<std::vector<std::string>>& target_prefix,
+                    const TranslationOptions& options);
 
     // Translate a stream in parallel.
     // Results will be written in order as they are available so the stream content is
@@ -101,7 +140,10 @@ namespace ctranslate2 {
       }
 
       while (true) {
-        auto batch = batch_reader.get_next(read_batch_size, options.batch_type);
+        auto batch = batch_reader.get_next(
+          read_batch_size,
+          options.batch_type,
+          options.get_decoding_cost_model(estimated_target_length_ratio()));
         if (batch[0].empty())
           break;
         results.emplace(post(std::move(batch[0]),
@@ -260,7 +302,71 @@ namespace ctranslate2 {
       return stats;
     }
 
+    // Replaces the model of a pool created with a single model. The queued and running jobs
+    // finish with the previous model while the next jobs use the new model. The previous
+    // model is released when the last job using it is finished. If model is nullptr, the
+    // model is released and the next jobs will fail until a new model is set.
+    void replace_model(std::shared_ptr<const models::Model> model);
+
+    // Releases the variables of the models loaded lazily (see models::ModelReader::lazy_load)
+    // that were not requested for timeout. The next jobs materialize them again. In a pool
+    // created with multiple models, the lazy models evicted by the memory limit also release
+    // their variables but remain registered. Set timeout to 0 to disable.
+    void set_idle_model_timeout(std::chrono::milliseconds timeout);
+
+    // Enables micro-batching of the translation jobs. Compatible jobs (same model, same
+    // options except priority and deadline, all with or without target prefix, and not
+    // returning alternatives) are held in the queue until they contain at least max_tokens
+    // source tokens or the oldest job waited max_delay. They are then translated as a single
+    // batch (which is split according to max_batch_size) and each job receives its own
+    // results. The held jobs do not delay the other jobs. This increases the throughput when
+    // jobs contain few examples. The compatible jobs are queued for the same translator, but
+    // any idle translator can run them. Set max_delay to 0 to disable.
+    void set_micro_batching(std::chrono::microseconds max_delay, size_t max_tokens = 0);
+
+    // Limits the estimated memory used by the running translations to max_memory bytes
+    // (see Translator::estimate_memory_usage). Jobs wait until the running jobs release
+    // enough memory, jobs exceeding the budget are translated in smaller batches, and jobs
+    // with an example exceeding the budget fail with a std::runtime_error. Set max_memory
+    // to 0 to disable.
+    void set_memory_budget(size_t max_memory);
+    // Estimated memory used by the running translations, when a memory budget is set.
+    size_t estimated_memory_usage();
+
+    // Enables pipelined translation: the first num_encoders translators take the queued jobs
+    // and run the encoder while the other translators run the decoding of the encoded jobs.
+    // This keeps the encoding of the next jobs and the decoding of the current jobs running
+    // in parallel. Jobs using continuous batching are not pipelined and run on the encoding
+    // translators. Set num_encoders to 0 to disable.
+    void set_pipelining(size_t num_encoders);
+
+    // Ratio between the target and source lengths of the completed translations. It is used
+    // to estimate the decoding cost with BatchType::DecodingCost when the options do not set
+    // target_length_ratio (see TranslationOptions). Returns 1 until a translation completes.
+    float estimated_target_length_ratio() const;
+
+    // Caches the translation results in memory, up to max_memory bytes split in num_shards
+    // least recently used caches. The examples that were already translated with the same
+    // model, target prefix, and options are not translated again, and the batches whose
+    // examples are all cached are answered by post() without running a translation. Random
+    // sampling and translations with a callback are not cached (see
+    // TranslationCache::is_cacheable). Set max_memory to 0 to disable and clear the cache.
+    void set_translation_cache(size_t max_memory, size_t num_shards = 16);
+    // Ratio of the examples found in the translation cache (0 if the cache is disabled).
+    float translation_cache_hit_ratio() const;
+
+    // Caches the encoder outputs in memory, up to max_memory bytes shared by all translators
+    // (see Translator::set_encoder_cache). Sources that are translated again, e.g. with
+    // another target prefix, are not encoded again. Set max_memory to 0 to disable and clear
+    // the cache.
+    void set_encoder_cache(size_t max_memory);
+    // Ratio of the source sequences found in the encoder cache (0 if the cache is disabled).
+    float encoder_cache_hit_ratio() const;
+
     size_t num_queued_batches();
+    // Number of models currently loaded by a pool created with multiple models. The lazy
+    // models that released their variables are not counted (see set_idle_model_timeout).
+    size_t num_loaded_models();
     size_t num_translators() const;
     const std::vector<Translator>& get_translators() const;
 
@@ -276,23 +382,90 @@ namespace ctranslate2 {
          bool throttle = false);
 
   private:
+    class JobQueue;
+
+    // Queued jobs that can be merged together (see can_merge and are_mergeable). The number
+    // of source tokens is updated when jobs are added to and removed from the queue.
+    struct MergeGroup {
+      std::shared_ptr<const models::Model> model;
+      bool with_target_prefix;
+      TranslationOptions options;
+      size_t num_jobs = 0;
+      size_t num_tokens = 0;
+    };
+
     class Job {
     public:
+      // The translator switches to the job model before running the job.
+      Job(std::shared_ptr<const models::Model> model = nullptr,
+          int priority = 0,
+          std::chrono::steady_clock::time_point deadline
+          = std::chrono::steady_clock::time_point::max())
+        : _model(std::move(model))
+        , _priority(priority)
+        , _deadline(deadline)
+        , _submission_time(std::chrono::steady_clock::now()) {
+      }
       virtual ~Job() = default;
-      virtual void run(Translator& translator) = 0;
+      // Fails the job without running it.
+      virtual void fail(std::exception_ptr exception) = 0;
+
+      const std::shared_ptr<const models::Model>& model() const {
+        return _model;
+      }
+      int priority() const {
+        return _priority;
+      }
+      std::chrono::steady_clock::time_point deadline() const {
+        return _deadline;
+      }
+      std::chrono::steady_clock::time_point submission_time() const {
+        return _submission_time;
+      }
+      // Returns the exception to fail the job with if it should no longer be run
+      // (e.g. it was cancelled or its deadline is exceeded), or nullptr.
+      virtual std::exception_ptr get_stop_exception() const {
+        if (_deadline != std::chrono::steady_clock::time_point::max()
+            && std::chrono::steady_clock::now() >= _deadline)
+          return std::make_exception_ptr(
+            std::runtime_error("The translation deadline is exceeded"));
+        return nullptr;
+      }
+
+    protected:
+      std::shared_ptr<const models::Model> _model;
+
+    private:
+      int _priority;
+      std::chrono::steady_clock::time_point _deadline;
+      std::chrono::steady_clock::time_point _submission_time;
+      // Group of the queued jobs that this job can be merged with, set by JobQueue.
+      MergeGroup* _merge_group = nullptr;
+      size_t _num_merge_tokens = 0;
+
+      friend class JobQueue;
     };
 
     template <typename ResultType>
     class BaseJob : public Job {
     public:
+      BaseJob(std::shared_ptr<const models::Model> model = nullptr,
+              int priority = 0,
+              std::chrono::steady_clock::time_point deadline
+              = std::chrono::steady_clock::time_point::max())
+        : Job(std::move(model), priority, deadline) {
+      }
+
       std::future<ResultType> get_future() {
         return _promise.get_future();
       }
 
-      void run(Translator& translator) override;
+      void fail(std::exception_ptr exception) override {
+        set_exception(exception);
+      }
 
-    protected:
-      virtual ResultType compute(Translator& translator) const = 0;
+      void set_value(ResultType result);
+      void set_exception(std::exception_ptr exception);
 
     private:
       std::promise<ResultType> _promise;
@@ -302,37 +475,351 @@ namespace ctranslate2 {
     public:
       TranslationJob(std::vector<std::vector<std::string>> source,
                      std::vector<std::vector<std::string>> target_prefix,
-                     TranslationOptions options)
-        : _source(std::move(source))
+                     TranslationOptions options,
+                     std::shared_ptr<const models::Model> model = nullptr)
+        : BaseJob(std::move(model), options.priority, options.deadline)
+        , _source(std::move(source))
         , _target_prefix(std::move(target_prefix))
         , _options(std::move(options)) {
       }
 
-    protected:
-      std::vector<TranslationResult> compute(Translator& translator) const override;
+      const std::vector<std::vector<std::string>>& source() const {
+        return _source;
+      }
+      const std::vector<std::vector<std::string>>& target_prefix() const {
+        return _target_prefix;
+      }
+      const TranslationOptions& options() const {
+        return _options;
+      }
+      size_t num_tokens() const;
+
+      std::exception_ptr get_stop_exception() const override {
+        try {
+          _options.check_cancellation();
+          return nullptr;
+        } catch (...) {
+          return std::current_exception();
+        }
+      }
+
+      // Returns true if the job should be run with continuous batching.
+      bool use_continuous_batching() const {
+        return (_options.continuous_batching
+                && _target_prefix.empty()
+                && ContinuousBatchTranslator::is_supported(_options));
+      }
+
+      // The job translates the examples missing from the cache: the results are added to
+      // the cache with the example keys, and are returned with the cached results which
+      // were found at cached_index in the posted batch.
+      void set_cache(std::shared_ptr<TranslationCache> cache,
+                     std::vector<std::string> keys,
+                     std::vector<TranslationResult> cached_results,
+                     std::vector<size_t> cached_index) {
+        _cache = std::move(cache);
+        _cache_keys = std::move(keys);
+        _cached_results = std::move(cached_results);
+        _cached_index = std::move(cached_index);
+      }
+
+      // Sets the translation results of the job examples.
+      void set_results(std::vector<TranslationResult> results);
 
     private:
       std::vector<std::vector<std::string>> _source;
       std::vector<std::vector<std::string>> _target_prefix;
       TranslationOptions _options;
+      std::shared_ptr<TranslationCache> _cache;
+      std::vector<std::string> _cache_keys;
+      std::vector<TranslationResult> _cached_results;
+      std::vector<size_t> _cached_index;
+    };
+
+    // Queue of jobs ordered by decreasing priority, then by increasing deadline, then by
+    // submission order.
+    class JobQueue {
+    public:
+      struct Key {
+        int priority;
+        std::chrono::steady_clock::time_point deadline;
+        std::chrono::steady_clock::time_point submission_time;
+        size_t index;
+
+        bool operator<(const Key& other) const {
+          if (priority != other.priority)
+            return priority > other.priority;
+          if (deadline != other.deadline)
+            return deadline < other.deadline;
+          if (submission_time != other.submission_time)
+            return submission_time < other.submission_time;
+          return index < other.index;
+        }
+      };
+
+      // Returns the key of the job. The index orders the jobs submitted at the same time.
+      static Key make_key(const Job& job, size_t index = 0) {
+        return Key{job.priority(), job.deadline(), job.submission_time(), index};
+      }
+
+      bool empty() const {
+        return _jobs.empty();
+      }
+      size_t size() const {
+        return _jobs.size();
+      }
+      void emplace(std::unique_ptr<Job> job) {
+        add_to_merge_group(*job);
+        Key key = make_key(*job, _next_index++);
+        _jobs.emplace(std::move(key), std::move(job));
+      }
+      // Returns the most urgent job.
+      const std::unique_ptr<Job>& front() const {
+        return _jobs.begin()->second;
+      }
+      // Removes and returns the most urgent job.
+      std::unique_ptr<Job> pop() {
+        std::unique_ptr<Job> job = std::move(_jobs.begin()->second);
+        _jobs.erase(_jobs.begin());
+        remove_from_merge_group(*job);
+        return job;
+      }
+      // Removes and returns the jobs for which the predicate is true, from the most urgent.
+      template <typename Predicate>
+      std::vector<std::unique_ptr<Job>> pop_if(const Predicate& predicate) {
+        std::vector<std::unique_ptr<Job>> jobs;
+        for (auto it = _jobs.begin(); it != _jobs.end();) {
+          if (predicate(*it->second)) {
+            remove_from_merge_group(*it->second);
+            jobs.emplace_back(std::move(it->second));
+            it = _jobs.erase(it);
+          } else {
+            ++it;
+          }
+        }
+        return jobs;
+      }
+      // Returns the group of the queued jobs that the job can be merged with, or nullptr if
+      // the job can not be merged.
+      static const MergeGroup* merge_group(const Job& job) {
+        return job._merge_group;
+      }
+      // Calls the function on each job, from the most urgent.
+      template <typename Function>
+      void for_each(const Function& function) const {
+        for (const auto& pair : _jobs)
+          function(*pair.second);
+      }
+
+    private:
+      std::map<Key, std::unique_ptr<Job>> _jobs;
+      size_t _next_index = 0;
+      std::list<MergeGroup> _merge_groups;
+
+      void add_to_merge_group(Job& job);
+      void remove_from_merge_group(Job& job);
+    };
+
+    // Queue of the jobs assigned to a translator. Idle translators steal jobs from the
+    // queues of the other translators.
+    struct WorkerQueue {
+      std::mutex mutex;
+      std::condition_variable cv;
+      JobQueue jobs;
+      // Set when a job is posted to this queue, when another queue received a job that this
+      // idle translator could steal, or when the models changed.
+      bool notified = false;
+      std::atomic<bool> idle{false};
+    };
+
+    // Jobs translated as a single batch (see run_merged_jobs).
+    struct MergedJobs {
+      std::vector<std::unique_ptr<Job>> jobs;
+      const std::vector<std::vector<std::string>>* source;
+      const std::vector<std::vector<std::string>>* target_prefix;
+      std::vector<std::vector<std::string>> merged_source;
+      std::vector<std::vector<std::string>> merged_target_prefix;
+      // Job and offset of the job in the merged batch for each example.
+      std::vector<const TranslationJob*> example_job;
+      std::vector<size_t> example_offset;
+      TranslationOptions options;
+      // Memory reserved in the memory budget.
+      size_t memory_usage = 0;
+      // Pipelined translation: the encoder model and output.
+      std::shared_ptr<const models::Model> model;
+      std::vector<EncodedBatch> encoded_batches;
     };
 
     void create_translators(const std::shared_ptr<const models::Model>& model,
                             size_t num_translators,
-                            size_t num_threads_per_translator);
+                            size_t num_threads_per_translator,
+                            Device device);
     void post_job(std::unique_ptr<Job> job, bool throttle = false);
-    void work_loop(Translator& translator, size_t num_threads);
+    // Returns the index of the queue that should receive the job. The jobs that can be merged
+    // together are posted to the same queue, selected by their merge_hash.
+    size_t select_queue(const Job& job);
+    // Number of queues receiving the posted jobs.
+    size_t num_job_queues() const;
+    // Wakes up an idle translator other than the owner of queue index.
+    void notify_idle_worker(size_t index);
+    void notify_all_workers();
+    void work_loop(size_t index, size_t num_threads);
+    // Removes the next jobs to run from the queue: the most urgent job, or the merged jobs
+    // when micro-batching is enabled. The merged jobs that should wait for more jobs are
+    // skipped and next_wakeup is updated, so possibly no jobs are returned. Expired jobs are
+    // removed and failed.
+    std::vector<std::unique_ptr<Job>>
+    pop_jobs(WorkerQueue& queue, std::chrono::steady_clock::time_point& next_wakeup);
+    // Same as pop_jobs but takes the queue with the most urgent jobs that can run now, so
+    // that a translator runs an urgent job queued behind a busy translator before the less
+    // urgent jobs of its own queue. The queue index is preferred for equally urgent jobs.
+    std::vector<std::unique_ptr<Job>>
+    pop_next_jobs(size_t index, std::chrono::steady_clock::time_point& next_wakeup);
+    // Sets key to the key of the jobs that pop_jobs would return now. Returns false if no
+    // jobs can run now. Expired jobs are removed and failed.
+    bool peek_jobs(WorkerQueue& queue,
+                   std::chrono::steady_clock::time_point& next_wakeup,
+                   JobQueue::Key& key);
+    // Returns the most urgent job that can run now in the queue, or nullptr. If the job can
+    // be merged, its merge group should run with it. Called with the queue lock.
+    const Job* select_jobs(const JobQueue& jobs,
+                           std::chrono::steady_clock::time_point now,
+                           std::chrono::steady_clock::time_point& next_wakeup) const;
+    using StoppedJobs = std::vector<std::pair<std::unique_ptr<Job>, std::exception_ptr>>;
+    // Removes the jobs that should not run. Called with the queue lock.
+    static StoppedJobs pop_stopped_jobs(JobQueue& jobs);
+    // Fails the jobs removed by pop_stopped_jobs. Called without the queue lock.
+    void fail_stopped_jobs(StoppedJobs stopped_jobs);
+    // Updates the number of queued jobs after jobs were removed from a queue.
+    void on_jobs_removed(size_t num_jobs);
+    // Runs the job with continuous batching on the translator owning the queue index: the
+    // next compatible jobs in the queues join the decoding batch until it contains
+    // max_batch_size examples (64 by default).
+    void run_continuous_batching(Translator& translator,
+                                 size_t index,
+                                 std::unique_ptr<TranslationJob> job);
+
+    // Returns true if the job can be merged with other jobs (see set_micro_batching).
+    bool can_merge(const Job& job) const;
+    // Returns true if the job can be merged with other jobs when micro-batching is enabled.
+    static bool is_mergeable(const TranslationJob& job);
+    // Returns true if the job can be translated in a single batch with the jobs of the group.
+    static bool are_mergeable(const TranslationJob& job, const MergeGroup& group);
+    // Hash of the fields compared by are_mergeable: mergeable jobs have the same hash.
+    static size_t merge_hash(const TranslationJob& job);
+    // Translates the jobs as a single batch and dispatches the results to each job.
+    void run_merged_jobs(Translator& translator, std::vector<std::unique_ptr<Job>> jobs);
+    std::unique_ptr<MergedJobs> merge_jobs(std::vector<std::unique_ptr<Job>> jobs) const;
+    void set_merged_results(MergedJobs& merged, std::vector<TranslationResult> results);
+    // Pipelined translation: encodes the jobs and posts them to the decoding translators.
+    void encode_merged_jobs(Translator& translator, std::vector<std::unique_ptr<Job>> jobs);
+    void decode_merged_jobs(Translator& translator, std::unique_ptr<MergedJobs> merged);
+    // Wakes up an idle decoding translator.
+    void notify_idle_decoder();
+    // Updates the estimated target length ratio with the results of a completed job.
+    void record_translation_lengths(const TranslationJob& job,
+                                    const std::vector<TranslationResult>& results);
+
+    // Returns the estimated memory usage of the translation. If it exceeds the memory
+    // budget, max_batch_size is reduced so that each translated batch fits in the budget.
+    size_t fit_memory_budget(Translator& translator,
+                             const std::vector<std::vector<std::string>>& source,
+                             const std::vector<std::vector<std::string>>& target_prefix,
+                             TranslationOptions& options) const;
+    // Reserves memory in the budget, waiting for the running jobs to release memory if needed.
+    void reserve_memory(size_t memory);
+    // Same as reserve_memory but returns false instead of waiting.
+    bool try_reserve_memory(size_t memory);
+    void release_memory(size_t memory);
+
+    std::future<std::vector<TranslationResult>>
+    post_translation(std::shared_ptr<const models::Model> model,
+                     std::vector<std::vector<std::string>> source,
+                     std::vector<std::vector<std::string>> target_prefix,
+                     TranslationOptions options,
+                     bool throttle);
+    std::vector<TranslationResult>
+    translate_batch_with_model(const std::shared_ptr<const models::Model>& model,
+                               const std::vector<std::vector<std::string>>& source,
+                               const std::vector<std::vector<std::string>>& target_prefix,
+                               const TranslationOptions& options);
+
+    // Returns the model of a pool created with a single model.
+    std::shared_ptr<const models::Model> get_model();
+    // Returns the model identified by model_id and loads it if needed.
+    std::shared_ptr<const models::Model> get_model(const std::string& model_id);
+    // Loads the model identified by model_id and registers it as the most recently used.
+    // _models_loading_mutex should be locked.
+    std::shared_ptr<const models::Model> load_model(const std::string& model_id);
+    // Returns true if the model was replaced or evicted: translators should detach it.
+    bool is_outdated(const std::shared_ptr<const models::Model>& model);
+    // Evicts the least recently used models until the loaded models fit in max_models_memory.
+    // Returns true if models were removed. _mutex should be locked.
+    bool evict_models();
+    // Releases the variables of the idle and evicted lazy models (see set_idle_model_timeout)
+    // and updates next_wakeup to the next time a model becomes idle.
+    void unload_idle_models(std::chrono::steady_clock::time_point& next_wakeup);
 
     void open_input_file(const std::string& file, std::ifstream& stream) const;
     void open_output_file(const std::string& file, std::ofstream& stream) const;
 
+    // Each translator has its own queue so that posting and running jobs does not contend on
+    // a single lock. The jobs are distributed to the idle translators first, and translators
+    // run the most urgent jobs across all queues (see pop_next_jobs).
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::atomic<size_t> _next_queue{0};
+    std::atomic<size_t> _num_queued_jobs{0};
+    std::atomic<size_t> _num_throttled_posts{0};
+    std::atomic<bool> _request_end{false};
     std::condition_variable _can_add_more_work;
-    std::queue<std::unique_ptr<Job>> _work;
     std::vector<std::thread> _workers;
     std::vector<Translator> _translators;
     std::mutex _mutex;
-    std::condition_variable _cv;
-    bool _request_end = false;
+    // The model of a pool created with a single model and the last time it was requested,
+    // protected by _mutex.
+    std::shared_ptr<const models::Model> _model;
+    std::chrono::steady_clock::time_point _model_last_use;
+    std::atomic<int64_t> _idle_model_timeout_ms{0};
+    // Micro-batching parameters.
+    std::atomic<int64_t> _micro_batching_max_delay_us{0};
+    std::atomic<size_t> _micro_batching_max_tokens{0};
+    // Pipelined translation: the encoded jobs wait in this queue to be decoded.
+    std::atomic<size_t> _num_encoders{0};
+    std::mutex _encoded_jobs_mutex;
+    std::condition_variable _can_encode_more_jobs;
+    std::queue<std::unique_ptr<MergedJobs>> _encoded_jobs;
+    // Memory budget of the running translations.
+    std::mutex _memory_mutex;
+    std::condition_variable _memory_released;
+    std::atomic<size_t> _memory_budget{0};
+    size_t _memory_usage = 0;
+    // Total length of the completed translations (see estimated_target_length_ratio).
+    std::atomic<size_t> _num_translated_source_tokens{0};
+    std::atomic<size_t> _num_translated_target_tokens{0};
+    // Translation and encoder caches, accessed with std::atomic_load and std::atomic_store.
+    std::shared_ptr<TranslationCache> _translation_cache;
+    std::shared_ptr<EncoderCache> _encoder_cache;
+
+    // Models loaded by a pool created with multiple models, from the most recently used to the
+    // least recently used. These members are protected by _mutex.
+    struct LoadedModel {
+      std::string id;
+      std::shared_ptr<const models::Model> model;
+      size_t memory_usage;
+      std::chrono::steady_clock::time_point last_use;
+      // false if the model is lazy and its variables were released: it does not count in
+      // the memory usage until it is requested again.
+      bool loaded;
+    };
+    bool _multi_model = false;
+    std::list<LoadedModel> _models;
+    size_t _models_memory_usage = 0;
+    size_t _max_models_memory = 0;
+    Device _device = Device::CPU;
+    int _device_index = 0;
+    ComputeType _compute_type = ComputeType::DEFAULT;
+    // Models are loaded one at a time without holding _mutex.
+    std::mutex _models_loading_mutex;
 
     template <typename Tokenizer>
     bool read_next_sequence(std::istream& in,
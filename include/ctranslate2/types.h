@@ -20,6 +20,8 @@ namespace ctranslate2 {
   };
 
   std::string dtype_name(DataType type);
+  // Size in bytes of a value of this type.
+  size_t dtype_size(DataType type);
 
   enum class ComputeType {
     DEFAULT,
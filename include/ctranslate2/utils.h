@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
 #include <vector>
@@ -32,6 +33,9 @@ namespace ctranslate2 {
 
   std::vector<std::string> split_string(const std::string& str, char delimiter);
 
+  // Non cryptographic 64-bit hash of a memory buffer.
+  uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
   template <typename T, typename I>
   static std::vector<T> index_vector(const std::vector<T>& v,
                                      const std::vector<I>& index) {
@@ -47,6 +51,69 @@ namespace ctranslate2 {
   void* aligned_alloc(size_t size, size_t alignment);
   void aligned_free(void* ptr);
 
+  // Read-only memory mapping of a file. The mapped pages are backed by the page cache
+  // and can be shared by all processes mapping the same file.
+  class MappedFile {
+  public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+      return _data;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+  private:
+    const char* _data;
+    size_t _size;
+  };
+
+  // Memory mapping of a named POSIX shared memory segment.
+  class SharedMemory {
+  public:
+    // Creates a new segment in read-write mode. Returns nullptr if a segment with the same
+    // name already exists.
+    static std::shared_ptr<SharedMemory> create(const std::string& name);
+    // Opens an existing segment in read-only mode. Returns nullptr if the segment does not exist.
+    static std::shared_ptr<SharedMemory> open(const std::string& name);
+    // Removes the segment name. Processes that already mapped the segment can still access it.
+    static void unlink(const std::string& name);
+
+    ~SharedMemory();
+    SharedMemory(const SharedMemory&) = delete;
+    SharedMemory& operator=(const SharedMemory&) = delete;
+
+    // Resizes a segment opened in read-write mode.
+    void resize(size_t size);
+    // Maps the segment again, e.g. after it was resized by another process.
+    void remap();
+
+    char* data() {
+      return _data;
+    }
+
+    const char* data() const {
+      return _data;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+  private:
+    SharedMemory(int fd, bool writable);
+
+    int _fd;
+    bool _writable;
+    char* _data;
+    size_t _size;
+  };
+
 #ifdef NDEBUG
 #  define THROW_EXCEPTION(EXCEPTION, MESSAGE) throw EXCEPTION(MESSAGE)
 #else
@@ -3,7 +3,9 @@ that do not load a computation graph. The model converter should make sure that
 each required variable of the specification is set.
 """
 
+import io
 import struct
+
 import numpy as np
 
 OPTIONAL = "optional"
@@ -201,26 +203,59 @@ class ModelSpec(LayerSpec):
             else:
                 variables.append(variable)
 
-        with open(path, "wb") as model:
+        # The header indexes the offset of each variable so that the runtime can directly
+        # map or skip variables. The size of the header does not depend on the offset
+        # values, so we first serialize it to compute where the variables start.
+        header = _serialize_header(
+            self.name, self.revision, variables, aliases, [0] * len(variables)
+        )
+        offsets = []
+        offset = _align(len(header))
+        for _, value in variables:
+            offsets.append(offset)
+            offset = _align(offset + value.nbytes)
+        header = _serialize_header(
+            self.name, self.revision, variables, aliases, offsets
+        )
 
-            def _write_string(string):
-                model.write(struct.pack("H", len(string) + 1))
-                model.write(string.encode("utf-8"))
-                model.write(struct.pack("B", 0))
-
-            model.write(struct.pack("I", 4))  # Binary version.
-            _write_string(self.name)
-            model.write(struct.pack("I", self.revision))
-            model.write(struct.pack("I", len(variables)))
-            for name, value in variables:
-                _write_string(name)
-                model.write(struct.pack("B", len(value.shape)))
-                for dim in value.shape:
-                    model.write(struct.pack("I", dim))
-                model.write(struct.pack("B", _dtype_to_type_id(value.dtype)))
-                model.write(struct.pack("I", value.nbytes))
+        with open(path, "wb") as model:
+            model.write(header)
+            for (_, value), offset in zip(variables, offsets):
+                model.write(b"\0" * (offset - model.tell()))
                 model.write(value.tobytes())
-            model.write(struct.pack("I", len(aliases)))
-            for alias, variable_name in aliases:
-                _write_string(alias)
-                _write_string(variable_name)
+
+
+# Variables are aligned in the model file so that they can be viewed directly in memory.
+# This value should match ALIGNMENT in src/primitives/cpu.cc.
+_ALIGNMENT = 64
+
+
+def _align(offset):
+    return (offset + _ALIGNMENT - 1) // _ALIGNMENT * _ALIGNMENT
+
+
+def _serialize_header(name, revision, variables, aliases, offsets):
+    header = io.BytesIO()
+
+    def _write_string(string):
+        header.write(struct.pack("H", len(string) + 1))
+        header.write(string.encode("utf-8"))
+        header.write(struct.pack("B", 0))
+
+    header.write(struct.pack("I", 6))  # Binary version.
+    _write_string(name)
+    header.write(struct.pack("I", revision))
+    header.write(struct.pack("I", len(variables)))
+    header.write(struct.pack("I", len(aliases)))
+    for (var_name, value), offset in zip(variables, offsets):
+        _write_string(var_name)
+        header.write(struct.pack("B", len(value.shape)))
+        for dim in value.shape:
+            header.write(struct.pack("I", dim))
+        header.write(struct.pack("B", _dtype_to_type_id(value.dtype)))
+        header.write(struct.pack("Q", value.nbytes))
+        header.write(struct.pack("Q", offset))
+    for alias, variable_name in aliases:
+        _write_string(alias)
+        _write_string(variable_name)
+    return header.getvalue()
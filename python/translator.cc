@@ -68,16 +68,14 @@ public:
                     int device_index,
                     const StringOrMap& compute_type,
                     size_t inter_threads,
-                    size_t intra_threads)
+                    size_t intra_threads,
+                    const std::string& shared_memory_name)
     : _model_path(model_path)
     , _device(ctranslate2::str_to_device(device))
     , _device_index(device_index)
     , _compute_type(std::visit(ComputeTypeResolver(device), compute_type))
-    , _model((ctranslate2::set_num_threads(intra_threads),
-              ctranslate2::models::Model::load(_model_path,
-                                               _device,
-                                               _device_index,
-                                               _compute_type)))
+    , _shared_memory_name(shared_memory_name)
+    , _model((ctranslate2::set_num_threads(intra_threads), load_model()))
     , _model_state(ModelState::Loaded)
     , _translator_pool(inter_threads, intra_threads, _model) {
   }
@@ -287,11 +285,19 @@ private:
   const ctranslate2::Device _device;
   const int _device_index;
   const ctranslate2::ComputeType _compute_type;
+  const std::string _shared_memory_name;
 
   std::shared_ptr<const ctranslate2::models::Model> _model;
   ModelState _model_state;
   ctranslate2::TranslatorPool _translator_pool;
 
+  std::shared_ptr<const ctranslate2::models::Model> load_model() const {
+    if (_shared_memory_name.empty())
+      return ctranslate2::models::Model::load(_model_path, _device, _device_index, _compute_type);
+    ctranslate2::models::SharedMemoryModelReader model_reader(_model_path, _shared_memory_name);
+    return ctranslate2::models::Model::load(model_reader, _device, _device_index, _compute_type);
+  }
+
   void assert_model_is_ready() const {
     if (!model_is_loaded())
       throw std::runtime_error("The model for this translator was unloaded");
@@ -312,18 +318,18 @@ private:
     if (target_state == ModelState::UnloadedToCpu || target_state == ModelState::Unloaded) {
       for (auto& translator : translators)
         translator.detach_model();
-      if (target_state == ModelState::UnloadedToCpu)
+      if (target_state == ModelState::UnloadedToCpu) {
         model->set_device(ctranslate2::Device::CPU);
-      else
+      } else {
         _model.reset();
+        _translator_pool.replace_model(nullptr);
+      }
     } else if (target_state == ModelState::Loaded) {
       if (_model_state == ModelState::UnloadedToCpu) {
         model->set_device(_device, _device_index);
       } else {
-        _model = ctranslate2::models::Model::load(_model_path,
-                                                  _device,
-                                                  _device_index,
-                                                  _compute_type);
+        _model = load_model();
+        _translator_pool.replace_model(_model);
       }
       for (auto& translator : translators)
         translator.set_model(_model);
@@ -338,13 +344,14 @@ PYBIND11_MODULE(translator, m)
   m.def("contains_model", &ctranslate2::models::contains_model, py::arg("path"));
 
   py::class_<TranslatorWrapper>(m, "Translator")
-    .def(py::init<const std::string&, const std::string&, int, const StringOrMap&, size_t, size_t>(),
+    .def(py::init<const std::string&, const std::string&, int, const StringOrMap&, size_t, size_t, const std::string&>(),
          py::arg("model_path"),
          py::arg("device")="cpu",
          py::arg("device_index")=0,
          py::arg("compute_type")="default",
          py::arg("inter_threads")=1,
-         py::arg("intra_threads")=4)
+         py::arg("intra_threads")=4,
+         py::arg("shared_memory_name")="")
     .def_property_readonly("device", &TranslatorWrapper::device)
     .def_property_readonly("device_index", &TranslatorWrapper::device_index)
     .def_property_readonly("num_translators", &TranslatorWrapper::num_translators)
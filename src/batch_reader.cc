@@ -1,5 +1,8 @@
 #include "ctranslate2/batch_reader.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace ctranslate2 {
 
   BatchType str_to_batch_type(const std::string& batch_type) {
@@ -7,15 +10,27 @@ namespace ctranslate2 {
       return BatchType::Examples;
     else if (batch_type == "tokens")
       return BatchType::Tokens;
+    else if (batch_type == "decoding_cost")
+      return BatchType::DecodingCost;
     throw std::invalid_argument("Invalid batch type: " + batch_type);
   }
 
+  size_t DecodingCostModel::get_cost(size_t source_length) const {
+    size_t target_length = static_cast<size_t>(std::ceil(target_length_ratio * source_length));
+    if (max_target_length > 0)
+      target_length = std::min(target_length, max_target_length);
+    return beam_size * std::max(target_length, size_t(1));
+  }
+
   template <typename T>
   static size_t get_batch_size_increment(const std::vector<T>& example,
-                                         const BatchType batch_type) {
+                                         const BatchType batch_type,
+                                         const DecodingCostModel& cost_model) {
     switch (batch_type) {
     case BatchType::Tokens:
       return example.size();
+    case BatchType::DecodingCost:
+      return cost_model.get_cost(example.size());
     default:
       return 1;
     };
@@ -23,7 +38,8 @@ namespace ctranslate2 {
 
   std::vector<std::vector<std::string>>
   BatchReader::get_next(const size_t max_batch_size,
-                        const BatchType batch_type) {
+                        const BatchType batch_type,
+                        const DecodingCostModel& cost_model) {
     std::vector<std::vector<std::string>> batch;
     batch.reserve(max_batch_size);
 
@@ -31,7 +47,8 @@ namespace ctranslate2 {
 
     while (has_next_element()) {
       const size_t batch_size_increment = get_batch_size_increment(peek_next_element(),
-                                                                   batch_type);
+                                                                   batch_type,
+                                                                   cost_model);
       if (batch_size > 0 && batch_size + batch_size_increment > max_batch_size)
         break;
       batch.emplace_back(get_next_element());
@@ -65,10 +82,11 @@ namespace ctranslate2 {
 
   std::vector<std::vector<std::vector<std::string>>>
   ParallelBatchReader::get_next(const size_t max_batch_size,
-                                const BatchType batch_type) {
+                                const BatchType batch_type,
+                                const DecodingCostModel& cost_model) {
     std::vector<std::vector<std::vector<std::string>>> batches;
     batches.resize(_readers.size());
-    batches[0] = _readers[0]->get_next(max_batch_size, batch_type);
+    batches[0] = _readers[0]->get_next(max_batch_size, batch_type, cost_model);
 
     const size_t batch_size = batches[0].size();
     for (size_t i = 1; i < _readers.size(); ++i) {
@@ -1,5 +1,16 @@
 #include "cpu_info.h"
 
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+#ifdef __linux__
+#  include <cerrno>
+#  include <sched.h>
+#endif
+
+#include "ctranslate2/utils.h"
+
 #if defined(CT2_X86_BUILD)
 #ifdef _WIN32
 #  include <intrin.h>
@@ -128,5 +139,97 @@ namespace ctranslate2 {
       return true;
     }
 #endif
+
+    // Parses a CPU list such as "0-3,8-11".
+    std::vector<int> parse_cpu_list(const std::string& list) {
+      std::vector<int> cores;
+      for (const auto& range : split_string(list, ',')) {
+        if (range.empty())
+          continue;
+        const auto bounds = split_string(range, '-');
+        const int first = std::stoi(bounds[0]);
+        const int last = bounds.size() > 1 ? std::stoi(bounds[1]) : first;
+        for (int core = first; core <= last; ++core)
+          cores.push_back(core);
+      }
+      return cores;
+    }
+
+#ifdef __linux__
+    // Returns the cores that the process is allowed to run on, indexed by the core id, or an
+    // empty vector if the affinity mask can not be read. The CPU set is allocated dynamically
+    // since the host can have more than CPU_SETSIZE cores.
+    static std::vector<bool> get_allowed_cores() {
+      for (size_t num_cores = CPU_SETSIZE; num_cores <= (size_t(1) << 20); num_cores *= 2) {
+        cpu_set_t* cpuset = CPU_ALLOC(num_cores);
+        if (!cpuset)
+          break;
+        const size_t size = CPU_ALLOC_SIZE(num_cores);
+        CPU_ZERO_S(size, cpuset);
+
+        const bool success = (sched_getaffinity(0, size, cpuset) == 0);
+        const int error = errno;
+        std::vector<bool> allowed_cores;
+        if (success) {
+          allowed_cores.resize(num_cores);
+          for (size_t core = 0; core < num_cores; ++core)
+            allowed_cores[core] = CPU_ISSET_S(core, size, cpuset);
+        }
+        CPU_FREE(cpuset);
+
+        // EINVAL means that the set is smaller than the kernel mask.
+        if (success || error != EINVAL)
+          return allowed_cores;
+      }
+      return {};
+    }
+#endif
+
+    static std::vector<std::vector<int>> read_numa_nodes() {
+      std::vector<std::vector<int>> nodes;
+
+#ifdef __linux__
+      const std::vector<bool> allowed_cores = get_allowed_cores();
+
+      std::ifstream online_nodes_file("/sys/devices/system/node/online");
+      std::string online_nodes;
+      if (online_nodes_file && std::getline(online_nodes_file, online_nodes)) {
+        for (const int node : parse_cpu_list(online_nodes)) {
+          std::ifstream cpu_list_file("/sys/devices/system/node/node"
+                                      + std::to_string(node)
+                                      + "/cpulist");
+          std::string cpu_list;
+          if (!cpu_list_file || !std::getline(cpu_list_file, cpu_list))
+            continue;
+
+          std::vector<int> cores;
+          for (const int core : parse_cpu_list(cpu_list)) {
+            if (core < 0)
+              continue;
+            if (allowed_cores.empty()
+                || (size_t(core) < allowed_cores.size() && allowed_cores[core]))
+              cores.push_back(core);
+          }
+          if (!cores.empty())
+            nodes.emplace_back(std::move(cores));
+        }
+      }
+#endif
+
+      if (nodes.empty()) {
+        std::vector<int> cores(std::max(std::thread::hardware_concurrency(), 1u));
+        for (size_t i = 0; i < cores.size(); ++i)
+          cores[i] = i;
+        nodes.emplace_back(std::move(cores));
+      }
+
+      return nodes;
+    }
+
+    const std::vector<std::vector<int>>& cpu_numa_nodes() {
+      static const std::vector<std::vector<int>> nodes = read_numa_nodes();
+      return nodes;
+    }
+
   }
 }
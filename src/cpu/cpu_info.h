@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace ctranslate2 {
   namespace cpu {
@@ -14,5 +15,13 @@ namespace ctranslate2 {
     bool cpu_supports_avx2();
     bool cpu_supports_neon();
 
+    // Returns the CPU cores of each NUMA node that the process is allowed to run on. On Linux,
+    // the topology is read from /sys/devices/system/node. If it is not available, all cores
+    // are returned in a single node.
+    const std::vector<std::vector<int>>& cpu_numa_nodes();
+
+    // Parses a list of CPU or NUMA node ids in the Linux format (e.g. "0-3,8-11").
+    std::vector<int> parse_cpu_list(const std::string& list);
+
   }
 }
@@ -1,5 +1,6 @@
 #include "ctranslate2/decoding.h"
 
+#include <algorithm>
 #include <cmath>
 #include <map>
 
@@ -64,7 +65,97 @@ namespace ctranslate2 {
                                                               log_probs.dim(0))));
   }
 
-  static void update_sample_with_prefix(const dim_t step,
+  // Penalizes id for the batch entries with a step lower than min_step. log_probs has
+  // shape [batch_size * num_rows, vocabulary_size] where batch_size is steps.size().
+  static void penalize_token(StorageView& log_probs,
+                             const size_t id,
+                             const std::vector<dim_t>& steps,
+                             const dim_t min_step) {
+    if (std::all_of(steps.begin(), steps.end(),
+                    [min_step](const dim_t step) { return step < min_step; })) {
+      penalize_token(log_probs, id);
+      return;
+    }
+
+    const dim_t vocabulary_size = log_probs.dim(-1);
+    const dim_t num_rows = log_probs.dim(0) / steps.size();
+    for (size_t b = 0; b < steps.size(); ++b) {
+      if (steps[b] >= min_step)
+        continue;
+      DEVICE_DISPATCH(log_probs.device(),
+                      TYPE_DISPATCH(log_probs.dtype(),
+                                    primitives<D>::strided_fill(log_probs.data<T>()
+                                                                + b * num_rows * vocabulary_size
+                                                                + id,
+                                                                static_cast<T>(-1e10),
+                                                                vocabulary_size,
+                                                                num_rows)));
+    }
+  }
+
+  // Multiplies the values of each batch entry by its scale.
+  static void mul_batch(StorageView& x, const std::vector<float>& scales) {
+    if (std::adjacent_find(scales.begin(), scales.end(), std::not_equal_to<float>())
+        == scales.end()) {
+      ops::Mul()(x, StorageView(scales[0]).to(x.dtype()), x);
+      return;
+    }
+
+    const dim_t depth = x.size() / scales.size();
+    for (size_t b = 0; b < scales.size(); ++b) {
+      DEVICE_DISPATCH(x.device(),
+                      TYPE_DISPATCH(x.dtype(),
+                                    primitives<D>::mul(static_cast<T>(scales[b]),
+                                                       x.data<T>() + b * depth,
+                                                       depth)));
+    }
+  }
+
+  // Returns the step of each batch entry after num_steps steps of the search.
+  static std::vector<dim_t> get_steps(const std::vector<dim_t>& start_steps,
+                                      const std::vector<dim_t>& batch_offset,
+                                      const dim_t num_steps) {
+    std::vector<dim_t> steps;
+    steps.reserve(batch_offset.size());
+    for (const dim_t batch_id : batch_offset)
+      steps.emplace_back(start_steps[batch_id] + num_steps);
+    return steps;
+  }
+
+  // Runs a decoding step where the batch entry b is at step steps[b] and has num_rows
+  // consecutive rows in ids (e.g. its beams).
+  static void run_decoder_step(layers::Decoder& decoder,
+                               const std::vector<dim_t>& steps,
+                               const bool same_steps,
+                               const dim_t num_rows,
+                               const StorageView& ids,
+                               layers::DecoderState& state,
+                               StorageView* logits,
+                               StorageView* attention) {
+    if (same_steps) {
+      decoder(steps[0], ids, state, logits, attention);
+      return;
+    }
+
+    std::vector<dim_t> row_steps;
+    row_steps.reserve(steps.size() * num_rows);
+    for (const dim_t step : steps)
+      row_steps.insert(row_steps.end(), num_rows, step);
+    decoder(row_steps, ids, state, logits, attention);
+  }
+
+  // Returns the prefix ids that were forced before the search started at start_step.
+  static std::vector<size_t> get_forced_prefix(const std::vector<std::vector<size_t>>* prefix_ids,
+                                               const size_t batch_id,
+                                               const dim_t start_step) {
+    if (!prefix_ids)
+      return {};
+    const auto& prefix = prefix_ids->at(batch_id);
+    const size_t length = std::min(static_cast<size_t>(start_step), prefix.size());
+    return std::vector<size_t>(prefix.begin(), prefix.begin() + length);
+  }
+
+  static void update_sample_with_prefix(const std::vector<dim_t>& steps,
                                         StorageView& sampled_ids,
                                         StorageView& sampled_scores,
                                         const std::vector<std::vector<size_t>>& prefix_ids,
@@ -73,6 +164,7 @@ namespace ctranslate2 {
     const dim_t batch_size = sampled_scores.dim(0);
     const dim_t beam_size = sampled_scores.dim(1);
     for (dim_t i = 0; i < batch_size; ++i) {
+      const dim_t step = steps[i];
       const dim_t batch_id = batch_offset[i];
       const auto& prefix = prefix_ids[batch_id];
       const dim_t prefix_length = prefix.size();
@@ -126,7 +218,7 @@ namespace ctranslate2 {
                      const Sampler& sampler,
                      const std::vector<size_t>& start_ids,
                      const size_t end_id,
-                     const dim_t start_step,
+                     const std::vector<dim_t>& start_steps,
                      const dim_t max_length,
                      const dim_t min_length,
                      const std::vector<size_t>* output_ids_map,
@@ -134,15 +226,22 @@ namespace ctranslate2 {
                      std::vector<std::vector<float>>* scores,
                      std::vector<std::vector<std::vector<std::vector<float>>>>* attention,
                      const size_t num_hypotheses,
-                     const std::vector<std::vector<size_t>>* prefix_ids) const {
+                     const std::vector<std::vector<size_t>>* prefix_ids,
+                     const std::function<bool(size_t)>* is_cancelled,
+                     const GenerationCallback* callback) const {
     PROFILE("beam_search");
-    const dim_t min_step = start_step + min_length;
-    const dim_t max_step = start_step + max_length;
     const Device device = decoder.device();
     const DataType dtype = decoder.output_type();
     const bool expand_after_first_step = (device == Device::CPU);
     const dim_t batch_size = start_ids.size();
     dim_t cur_batch_size = batch_size;
+    const bool same_start_steps = std::adjacent_find(start_steps.begin(),
+                                                     start_steps.end(),
+                                                     std::not_equal_to<dim_t>()) == start_steps.end();
+    const dim_t num_steps = (batch_size > 0
+                             ? max_length - *std::min_element(start_steps.begin(),
+                                                              start_steps.end())
+                             : 0);
 
     StorageView gather_indices(DataType::INT32);
     StorageView topk_ids({batch_size, 1},
@@ -190,16 +289,22 @@ namespace ctranslate2 {
 
     StorageView coverage;
 
-    for (dim_t step = start_step; step < max_step; ++step) {
+    for (dim_t num_steps_done = 0; num_steps_done < num_steps; ++num_steps_done) {
+      // Step of each example in the batch.
+      const std::vector<dim_t> steps = get_steps(start_steps, batch_offset, num_steps_done);
+      const bool is_expanded = (!expand_after_first_step || num_steps_done > 0);
+
       // Compute log probs for the current step.
-      decoder(step,
-              topk_ids.to(device),
-              state,
-              &logits,
-              (attention || _coverage_penalty != 0) ? &attention_step_device : nullptr);
+      run_decoder_step(decoder,
+                       steps,
+                       same_start_steps,
+                       is_expanded ? _beam_size : 1,
+                       topk_ids.to(device),
+                       state,
+                       &logits,
+                       (attention || _coverage_penalty != 0) ? &attention_step_device : nullptr);
       ops::LogSoftMax()(logits, log_probs);
       const dim_t vocabulary_size = log_probs.dim(-1);
-      const bool is_expanded = (!expand_after_first_step || step > start_step);
 
       // Multiply by the current beam log probs.
       if (is_expanded) {
@@ -213,17 +318,22 @@ namespace ctranslate2 {
       }
 
       // Penalize by the length, if enabled.
-      float length_penalty_weight = 1.0;
+      std::vector<float> length_penalty_weights;
       if (_length_penalty != 0) {
-        length_penalty_weight = std::pow((5.0 + static_cast<float>(step + 1)) / 6.0, _length_penalty);
-        ops::Mul()(log_probs,
-                   StorageView(1.f / length_penalty_weight).to(log_probs.dtype()),
-                   log_probs);
+        std::vector<float> inverse_weights;
+        length_penalty_weights.reserve(cur_batch_size);
+        inverse_weights.reserve(cur_batch_size);
+        for (const dim_t step : steps) {
+          const float weight = std::pow((5.0 + static_cast<float>(step + 1)) / 6.0,
+                                        _length_penalty);
+          length_penalty_weights.emplace_back(weight);
+          inverse_weights.emplace_back(1.f / weight);
+        }
+        mul_batch(log_probs, inverse_weights);
       }
 
       // Penalize end_id, if configured.
-      if (step < min_step)
-        penalize_token(log_probs, end_id);
+      penalize_token(log_probs, end_id, steps, min_length);
 
       // Flatten the probs into a list of candidates.
       log_probs.reshape({cur_batch_size, -1});
@@ -231,14 +341,12 @@ namespace ctranslate2 {
       // TopK candidates.
       sampler(log_probs, topk_ids, topk_scores, _beam_size);
       if (prefix_ids)
-        update_sample_with_prefix(step, topk_ids, topk_scores, *prefix_ids, end_id, batch_offset);
+        update_sample_with_prefix(steps, topk_ids, topk_scores, *prefix_ids, end_id, batch_offset);
 
       topk_log_probs = topk_scores;
       // Recover the true log probs if length penalty was applied.
       if (_length_penalty != 0)
-        ops::Mul()(topk_log_probs,
-                   StorageView(length_penalty_weight).to(topk_log_probs.dtype()),
-                   topk_log_probs);
+        mul_batch(topk_log_probs, length_penalty_weights);
 
       // Unflatten the ids.
       gather_indices.resize({cur_batch_size * _beam_size});
@@ -315,9 +423,14 @@ namespace ctranslate2 {
 
       for (dim_t i = 0; i < cur_batch_size; ++i) {
         const dim_t batch_id = batch_offset[i];
+        if (is_cancelled && (*is_cancelled)(batch_id)) {
+          hypotheses[batch_id].clear();
+          continue;
+        }
+
         for (dim_t k = 0; k < _beam_size; ++k) {
           if (topk_ids.at<int32_t>({i, k}) == static_cast<int32_t>(end_id)
-              || step + 1 == max_step) {
+              || steps[i] + 1 >= max_length) {
             if (k == 0)
               top_beam_finished[i] = true;
             float score = topk_scores.scalar_at<float>({i, k});
@@ -366,6 +479,14 @@ namespace ctranslate2 {
             }
           }
           hypotheses[batch_id].clear();
+          if (callback) {
+            // The streamed hypothesis includes the prefix forced before the search.
+            std::vector<size_t> ids = get_forced_prefix(prefix_ids,
+                                                        batch_id,
+                                                        start_steps[batch_id]);
+            ids.insert(ids.end(), sampled_ids[batch_id][0].begin(), sampled_ids[batch_id][0].end());
+            (*callback)({size_t(batch_id), size_t(steps[i]), std::move(ids), true});
+          }
         } else {
           non_finished_index.emplace_back(i);
         }
@@ -434,7 +555,7 @@ namespace ctranslate2 {
                        const Sampler& sampler,
                        const std::vector<size_t>& start_ids,
                        const size_t end_id,
-                       const dim_t start_step,
+                       const std::vector<dim_t>& start_steps,
                        const dim_t max_length,
                        const dim_t min_length,
                        const std::vector<size_t>* output_ids_map,
@@ -442,13 +563,20 @@ namespace ctranslate2 {
                        std::vector<std::vector<float>>* scores,
                        std::vector<std::vector<std::vector<std::vector<float>>>>* attention,
                        const size_t,
-                       const std::vector<std::vector<size_t>>* prefix_ids) const {
+                       const std::vector<std::vector<size_t>>* prefix_ids,
+                       const std::function<bool(size_t)>* is_cancelled,
+                       const GenerationCallback* callback) const {
     PROFILE("greedy_search");
-    const dim_t min_step = start_step + min_length;
-    const dim_t max_step = start_step + max_length;
     const Device device = decoder.device();
     const DataType dtype = decoder.output_type();
     const dim_t batch_size = start_ids.size();
+    const bool same_start_steps = std::adjacent_find(start_steps.begin(),
+                                                     start_steps.end(),
+                                                     std::not_equal_to<dim_t>()) == start_steps.end();
+    const dim_t num_steps = (batch_size > 0
+                             ? max_length - *std::min_element(start_steps.begin(),
+                                                              start_steps.end())
+                             : 0);
     StorageView sample_from({batch_size, 1},
                             std::vector<int32_t>(start_ids.begin(), start_ids.end()));
 
@@ -480,12 +608,26 @@ namespace ctranslate2 {
     StorageView attention_step;
     StorageView attention_step_device(dtype, device);
 
-    for (dim_t step = start_step; step < max_step; ++step) {
-      decoder(step,
-              sample_from.to(device),
-              state,
-              &logits,
-              attention ? &attention_step_device : nullptr);
+    if (callback && prefix_ids) {
+      // The streamed output includes the prefix forced before the search.
+      for (dim_t b = 0; b < batch_size; ++b) {
+        const std::vector<size_t> forced_ids = get_forced_prefix(prefix_ids, b, start_steps[b]);
+        for (size_t t = 0; t < forced_ids.size(); ++t)
+          (*callback)({size_t(b), t, {forced_ids[t]}, false});
+      }
+    }
+
+    for (dim_t num_steps_done = 0; num_steps_done < num_steps; ++num_steps_done) {
+      // Step of each example in the batch.
+      const std::vector<dim_t> steps = get_steps(start_steps, batch_offset, num_steps_done);
+      run_decoder_step(decoder,
+                       steps,
+                       same_start_steps,
+                       /*num_rows=*/1,
+                       sample_from.to(device),
+                       state,
+                       &logits,
+                       attention ? &attention_step_device : nullptr);
 
       // Compute log probs only if scores should be returned.
       if (scores) {
@@ -495,12 +637,11 @@ namespace ctranslate2 {
       }
 
       // Penalize end_id, if configured.
-      if (step < min_step)
-        penalize_token(log_probs, end_id);
+      penalize_token(log_probs, end_id, steps, min_length);
 
       sampler(log_probs, best_ids, best_probs);
       if (prefix_ids)
-        update_sample_with_prefix(step, best_ids, best_probs, *prefix_ids, end_id, batch_offset);
+        update_sample_with_prefix(steps, best_ids, best_probs, *prefix_ids, end_id, batch_offset);
       if (attention)
         attention_step.copy_from(attention_step_device.to_float());
 
@@ -513,7 +654,10 @@ namespace ctranslate2 {
         if (output_ids_map)
           true_id = output_ids_map->at(true_id);
         dim_t batch_id = batch_offset[i];
-        if (true_id != static_cast<int32_t>(end_id)) {
+        if (is_cancelled && (*is_cancelled)(batch_id))
+          continue;
+        const bool is_end = (true_id == static_cast<int32_t>(end_id));
+        if (!is_end) {
           non_finished_index.emplace_back(i);
           sample_from.at<int32_t>(i) = true_id;
           sampled_ids[batch_id][0].push_back(true_id);
@@ -525,6 +669,15 @@ namespace ctranslate2 {
             (*attention)[batch_id][0].emplace_back(attn, attn + attention_step.dim(-1));
           }
         }
+        if (callback) {
+          std::vector<size_t> step_ids;
+          if (!is_end)
+            step_ids.emplace_back(true_id);
+          (*callback)({size_t(batch_id),
+                       size_t(steps[i]),
+                       std::move(step_ids),
+                       is_end || steps[i] + 1 >= max_length});
+        }
       }
 
       const dim_t count_alive = non_finished_index.size();
@@ -545,29 +698,335 @@ namespace ctranslate2 {
     }
   }
 
+  ContinuousGreedySearch::ContinuousGreedySearch(layers::Decoder& decoder,
+                                                 const Sampler& sampler,
+                                                 const size_t end_id,
+                                                 const std::vector<size_t>* output_ids_map,
+                                                 GenerationCallback callback)
+    : _decoder(decoder)
+    , _sampler(sampler)
+    , _end_id(end_id)
+    , _output_ids_map(output_ids_map)
+    , _callback(std::move(callback)) {
+  }
+
+  void ContinuousGreedySearch::add(layers::DecoderState state,
+                                   const std::vector<size_t>& ids,
+                                   const std::vector<size_t>& start_ids,
+                                   const dim_t max_length,
+                                   const dim_t min_length,
+                                   const bool return_scores) {
+    PROFILE("continuous_greedy_search_add");
+    const dim_t batch_size = ids.size();
+    if (batch_size == 0)
+      return;
+
+    std::vector<Sequence> sequences;
+    sequences.reserve(batch_size);
+    for (dim_t i = 0; i < batch_size; ++i) {
+      Sequence sequence;
+      sequence.id = ids[i];
+      sequence.step = 0;
+      sequence.max_step = max_length;
+      sequence.min_step = min_length;
+      sequence.return_scores = return_scores;
+      sequence.last_id = start_ids[i];
+      sequence.score = 0;
+      sequences.emplace_back(std::move(sequence));
+    }
+
+    if (max_length <= 0) {
+      for (auto& sequence : sequences) {
+        if (_callback)
+          _callback({sequence.id, 0, {}, true});
+        finish(sequence);
+      }
+      return;
+    }
+
+    // The first step is run separately as it also processes the encoder output.
+    const Device device = _decoder.device();
+    const StorageView input({batch_size, 1}, std::vector<int32_t>(start_ids.begin(),
+                                                                  start_ids.end()));
+    StorageView logits(_decoder.output_type(), device);
+    _decoder(0, input.to(device), state, &logits);
+    update(logits, sequences, state);
+    if (sequences.empty())
+      return;
+
+    if (_sequences.empty())
+      _state = std::move(state);
+    else
+      _decoder.append_state(_state, state);
+    for (auto& sequence : sequences)
+      _sequences.emplace_back(std::move(sequence));
+  }
+
+  void ContinuousGreedySearch::step() {
+    PROFILE("continuous_greedy_search_step");
+    const dim_t batch_size = _sequences.size();
+    if (batch_size == 0)
+      return;
+
+    std::vector<dim_t> steps;
+    std::vector<int32_t> input_ids;
+    steps.reserve(batch_size);
+    input_ids.reserve(batch_size);
+    for (const auto& sequence : _sequences) {
+      steps.emplace_back(sequence.step);
+      input_ids.emplace_back(sequence.last_id);
+    }
+
+    const Device device = _decoder.device();
+    const StorageView input({batch_size, 1}, input_ids);
+    StorageView logits(_decoder.output_type(), device);
+    _decoder(steps, input.to(device), _state, &logits);
+    update(logits, _sequences, _state);
+    if (_sequences.empty())
+      _state.clear();
+  }
+
+  void ContinuousGreedySearch::update(StorageView& logits,
+                                      std::vector<Sequence>& sequences,
+                                      layers::DecoderState& state) {
+    const Device device = logits.device();
+    const dim_t batch_size = sequences.size();
+    const dim_t vocabulary_size = logits.dim(-1);
+
+    // Compute log probs only if scores should be returned.
+    const bool return_scores = std::any_of(sequences.begin(), sequences.end(),
+                                           [](const Sequence& sequence) {
+                                             return sequence.return_scores;
+                                           });
+    StorageView log_probs(logits.dtype(), device);
+    if (return_scores)
+      ops::LogSoftMax()(logits, log_probs);
+    else
+      log_probs.shallow_copy(logits);
+
+    // Penalize end_id for the sequences that did not reach their minimum length.
+    for (dim_t i = 0; i < batch_size; ++i) {
+      if (sequences[i].step < sequences[i].min_step) {
+        DEVICE_DISPATCH(device,
+                        TYPE_DISPATCH(log_probs.dtype(),
+                                      primitives<D>::fill(log_probs.data<T>()
+                                                          + i * vocabulary_size
+                                                          + _end_id,
+                                                          static_cast<T>(-1e10),
+                                                          1)));
+      }
+    }
+
+    StorageView best_ids(DataType::INT32);
+    StorageView best_probs(log_probs.dtype());
+    _sampler(log_probs, best_ids, best_probs);
+
+    std::vector<int32_t> alive_index;
+    alive_index.reserve(batch_size);
+    for (dim_t i = 0; i < batch_size; ++i) {
+      Sequence& sequence = sequences[i];
+      size_t id = best_ids.scalar_at<int32_t>({i});
+      if (_output_ids_map)
+        id = _output_ids_map->at(id);
+      sequence.step += 1;
+
+      const bool is_end = (id == _end_id);
+      if (!is_end) {
+        sequence.output_ids.push_back(id);
+        sequence.last_id = id;
+        if (sequence.return_scores)
+          sequence.score += best_probs.scalar_at<float>({i});
+      }
+
+      if (_callback) {
+        std::vector<size_t> step_ids;
+        if (!is_end)
+          step_ids.emplace_back(id);
+        _callback({sequence.id,
+                   size_t(sequence.step - 1),
+                   std::move(step_ids),
+                   is_end || sequence.step >= sequence.max_step});
+      }
+
+      if (is_end || sequence.step >= sequence.max_step)
+        finish(sequence);
+      else
+        alive_index.emplace_back(i);
+    }
+
+    const dim_t num_alive = alive_index.size();
+    if (num_alive == batch_size)
+      return;
+
+    std::vector<Sequence> alive_sequences;
+    alive_sequences.reserve(num_alive);
+    for (const auto index : alive_index)
+      alive_sequences.emplace_back(std::move(sequences[index]));
+    sequences = std::move(alive_sequences);
+
+    if (num_alive > 0)
+      _decoder.gather_state(state, StorageView({num_alive}, alive_index).to(device));
+  }
+
+  void ContinuousGreedySearch::finish(Sequence& sequence) {
+    GenerationResult<size_t> result({std::move(sequence.output_ids)});
+    if (sequence.return_scores)
+      result.set_scores({sequence.score});
+    _finished.emplace_back(sequence.id, std::move(result));
+  }
+
+  void ContinuousGreedySearch::remove(const std::function<bool(size_t)>& predicate) {
+    const dim_t batch_size = _sequences.size();
+    std::vector<int32_t> alive_index;
+    alive_index.reserve(batch_size);
+    for (dim_t i = 0; i < batch_size; ++i) {
+      if (!predicate(_sequences[i].id))
+        alive_index.emplace_back(i);
+    }
+
+    const dim_t num_alive = alive_index.size();
+    if (num_alive == batch_size)
+      return;
+
+    std::vector<Sequence> alive_sequences;
+    alive_sequences.reserve(num_alive);
+    for (const auto index : alive_index)
+      alive_sequences.emplace_back(std::move(_sequences[index]));
+    _sequences = std::move(alive_sequences);
+
+    if (num_alive > 0)
+      _decoder.gather_state(_state, StorageView({num_alive}, alive_index).to(_decoder.device()));
+    else
+      _state.clear();
+  }
+
+  size_t ContinuousGreedySearch::num_sequences() const {
+    return _sequences.size();
+  }
+
+  std::vector<std::pair<size_t, GenerationResult<size_t>>>
+  ContinuousGreedySearch::get_finished() {
+    auto finished = std::move(_finished);
+    _finished.clear();
+    return finished;
+  }
+
+  // Runs the decoder on the input ids of each batch example in a single call, starting at
+  // start_step. The examples can have different numbers of inputs when starting from the
+  // initial state: the inputs are then padded on the left (see Decoder::forward_prefix).
+  // The attention vectors of each input are appended to input_attention.
+  static void run_decoder_inputs(layers::Decoder& decoder,
+                                 layers::DecoderState& state,
+                                 const dim_t start_step,
+                                 const std::vector<std::vector<size_t>>& input_ids,
+                                 std::vector<std::vector<std::vector<float>>>* input_attention) {
+    const dim_t batch_size = input_ids.size();
+    std::vector<dim_t> lengths;
+    lengths.reserve(batch_size);
+    dim_t time = 0;
+    for (const auto& ids : input_ids) {
+      lengths.emplace_back(ids.size());
+      time = std::max(time, lengths.back());
+    }
+    if (time == 0)
+      return;
+
+    const bool same_lengths = std::all_of(lengths.begin(), lengths.end(),
+                                          [time](const dim_t length) { return length == time; });
+    if (!same_lengths && start_step != 0)
+      throw std::invalid_argument("Decoder inputs of different lengths can only be run from "
+                                  "the initial state");
+
+    std::vector<int32_t> flat_ids;
+    flat_ids.reserve(batch_size * time);
+    for (const auto& ids : input_ids) {
+      flat_ids.insert(flat_ids.end(), time - ids.size(), int32_t(0));
+      flat_ids.insert(flat_ids.end(), ids.begin(), ids.end());
+    }
+
+    const Device device = decoder.device();
+    const StorageView ids({batch_size, time}, flat_ids);
+    StorageView attention(decoder.output_type(), device);
+    if (same_lengths)
+      decoder.forward_prefix(start_step,
+                             ids.to(device),
+                             state,
+                             input_attention ? &attention : nullptr);
+    else
+      decoder.forward_prefix(lengths,
+                             ids.to(device),
+                             state,
+                             input_attention ? &attention : nullptr);
+
+    if (input_attention) {
+      // attention has shape [batch_size, time, memory_time].
+      const StorageView host_attention = attention.to_float().to(Device::CPU);
+      const dim_t memory_time = host_attention.dim(-1);
+      const auto* attention_data = host_attention.data<float>();
+      input_attention->resize(batch_size);
+      for (dim_t b = 0; b < batch_size; ++b) {
+        auto& example_attention = (*input_attention)[b];
+        example_attention.reserve(example_attention.size() + lengths[b]);
+        for (dim_t t = time - lengths[b]; t < time; ++t) {
+          const auto* vector = attention_data + (b * time + t) * memory_time;
+          example_attention.emplace_back(vector, vector + memory_time);
+        }
+      }
+    }
+  }
+
+  // Returns the decoder inputs to force the first prefix_length ids of the prefix.
+  static std::vector<size_t> get_prefix_inputs(const size_t start_id,
+                                               const std::vector<size_t>& prefix_ids,
+                                               size_t prefix_length) {
+    prefix_length = std::min(prefix_length, prefix_ids.size());
+    std::vector<size_t> input_ids;
+    if (prefix_length > 0) {
+      input_ids.reserve(prefix_length);
+      input_ids.emplace_back(start_id);
+      input_ids.insert(input_ids.end(), prefix_ids.begin(), prefix_ids.begin() + prefix_length - 1);
+    }
+    return input_ids;
+  }
+
+  static std::vector<size_t> get_prefix_inputs(const size_t start_id,
+                                               const std::vector<size_t>& prefix_ids) {
+    return get_prefix_inputs(start_id, prefix_ids, prefix_ids.size());
+  }
+
+  // Forces the first prefix_lengths[b] ids of each prefix in a single decoder call.
   static void initialize_decoder_with_prefix(layers::Decoder& decoder,
                                              layers::DecoderState& state,
                                              const std::vector<size_t>& start_ids,
-                                             const std::vector<size_t>& prefix_ids,
-                                             std::vector<std::vector<float>>* prefix_attention) {
-    const Device device = decoder.device();
-    const size_t prefix_size = prefix_ids.size();
-
-    StorageView input({1, 1}, std::vector<int32_t>(start_ids.begin(), start_ids.end()));
-    StorageView attention(device);
-    if (prefix_attention)
-      prefix_attention->reserve(prefix_size);
+                                             const std::vector<std::vector<size_t>>& prefix_ids,
+                                             const std::vector<dim_t>& prefix_lengths,
+                                             std::vector<std::vector<std::vector<float>>>* prefix_attention) {
+    std::vector<std::vector<size_t>> input_ids;
+    input_ids.reserve(prefix_ids.size());
+    for (size_t b = 0; b < prefix_ids.size(); ++b)
+      input_ids.emplace_back(get_prefix_inputs(start_ids[b], prefix_ids[b], prefix_lengths[b]));
+    run_decoder_inputs(decoder, state, /*start_step=*/0, input_ids, prefix_attention);
+  }
 
-    for (size_t i = 0; i < prefix_size; ++i) {
-      decoder(i,
-              input.to(device),
-              state,
-              /*logits=*/nullptr,
-              prefix_attention ? &attention : nullptr);
-      if (prefix_attention)
-        prefix_attention->emplace_back(attention.to_vector<float>());
-      input.at<int32_t>(0) = prefix_ids[i];
-    }
+  bool update_prefix_state(layers::Decoder& decoder,
+                           DecoderPrefixState& prefix_state,
+                           const size_t start_id,
+                           const std::vector<size_t>& prefix_ids) {
+    std::vector<size_t> input_ids = get_prefix_inputs(start_id, prefix_ids);
+    const size_t num_inputs = prefix_state.input_ids.size();
+    if (num_inputs > input_ids.size()
+        || !std::equal(prefix_state.input_ids.begin(),
+                       prefix_state.input_ids.end(),
+                       input_ids.begin()))
+      return false;
+
+    const std::vector<std::vector<size_t>> new_input_ids(
+      1, std::vector<size_t>(input_ids.begin() + num_inputs, input_ids.end()));
+    std::vector<std::vector<std::vector<float>>> attention(1, std::move(prefix_state.attention));
+    run_decoder_inputs(decoder, prefix_state.state, num_inputs, new_input_ids, &attention);
+    prefix_state.attention = std::move(attention[0]);
+    prefix_state.input_ids = std::move(input_ids);
+    return true;
   }
 
   template <typename T>
@@ -604,44 +1063,76 @@ namespace ctranslate2 {
          const size_t num_hypotheses,
          const bool return_alternatives,
          const bool return_scores,
-         const bool return_attention) {
+         const bool return_attention,
+         const std::function<bool(size_t)>* is_cancelled,
+         const GenerationCallback* callback,
+         const DecoderPrefixState* prefix_state) {
     const size_t batch_size = start_ids.size();
-    dim_t start_step = 0;
+    if (prefix_state && (batch_size != 1
+                         || !prefix_ids
+                         || get_prefix_inputs(start_ids[0], prefix_ids->front())
+                            != prefix_state->input_ids))
+      throw std::invalid_argument("The decoder prefix state does not match the target prefix");
+
+    // The prefixes are run in a single decoder call before the search, or are already in
+    // the state. Prefixes of different lengths are padded on the left and each example then
+    // starts the search at its own step. The full prefix is run when returning alternatives.
+    const bool run_full_prefix = prefix_ids && (return_alternatives || prefix_state);
+    if (run_full_prefix && prefix_ids->size() > 1)
+      throw std::invalid_argument("Returning alternatives from a prefix is not supported "
+                                  "in batch mode");
+    std::vector<dim_t> prefix_lengths(batch_size, 0);
+    if (prefix_ids) {
+      for (size_t b = 0; b < batch_size; ++b) {
+        const dim_t length = prefix_ids->at(b).size();
+        // Keep at least one search step so that each example gets a hypothesis.
+        prefix_lengths[b] = (run_full_prefix
+                             ? length
+                             : std::max(std::min(length, max_length - 1), dim_t(0)));
+      }
+    }
+    const bool with_prefix = std::any_of(prefix_lengths.begin(), prefix_lengths.end(),
+                                         [](const dim_t length) { return length > 0; });
 
+    std::vector<dim_t> start_steps(batch_size, 0);
     std::vector<std::vector<std::vector<float>>> prefix_attention;
     std::vector<std::vector<std::vector<size_t>>> expanded_ids;
     std::vector<std::vector<float>> expanded_scores;
     std::vector<std::vector<std::vector<std::vector<float>>>> expanded_attention;
-    if (return_alternatives) {
-      if (prefix_ids) {
-        if (prefix_ids->size() > 1)
-          throw std::invalid_argument("Returning alternatives from a prefix is not supported "
-                                      "in batch mode");
+    if (with_prefix) {
+      if (prefix_state) {
         if (return_attention)
-          prefix_attention.resize(1);
+          prefix_attention.emplace_back(prefix_state->attention);
+      } else {
         initialize_decoder_with_prefix(decoder,
                                        state,
                                        start_ids,
-                                       prefix_ids->front(),
-                                       return_attention ? &prefix_attention[0] : nullptr);
-        start_ids[0] = prefix_ids->front().back();
-        const dim_t prefix_length = prefix_ids->front().size();
-        start_step += prefix_length;
-        max_length = std::max(max_length - prefix_length, dim_t(0));
-        min_length = std::max(min_length - prefix_length, dim_t(0));
+                                       *prefix_ids,
+                                       prefix_lengths,
+                                       return_attention ? &prefix_attention : nullptr);
       }
+      for (size_t b = 0; b < batch_size; ++b) {
+        if (prefix_lengths[b] > 0) {
+          start_ids[b] = prefix_ids->at(b)[prefix_lengths[b] - 1];
+          start_steps[b] = prefix_lengths[b];
+        }
+      }
+    }
+
+    if (return_alternatives) {
 
       // In this translation mode, we first expand the next "num_hypotheses" candidate words
       // before running the full decoding on each prefix. This is to ensure that we get unique
       // alternatives at this decoding position.
+      const dim_t start_step = start_steps.empty() ? 0 : start_steps[0];
       BeamSearch(num_hypotheses).search(decoder,
                                         state,
                                         BestSampler(),
                                         start_ids,
                                         end_id,
-                                        start_step,
-                                        /*max_length=*/1,
-                                        /*min_length=*/1,
+                                        start_steps,
+                                        /*max_length=*/start_step + 1,
+                                        /*min_length=*/start_step + 1,
                                         output_ids_map,
                                         expanded_ids,
                                         return_scores ? &expanded_scores : nullptr,
@@ -655,9 +1146,7 @@ namespace ctranslate2 {
           start_ids[b * num_hypotheses + i] = expanded_ids[b][i].back();
         }
       }
-      start_step += 1;
-      max_length = std::max(max_length - 1, dim_t(0));
-      min_length = std::max(min_length - 1, dim_t(0));
+      start_steps.assign(batch_size * num_hypotheses, start_step + 1);
     }
 
     std::vector<std::vector<std::vector<size_t>>> sampled_ids;
@@ -668,7 +1157,7 @@ namespace ctranslate2 {
                            sampler,
                            start_ids,
                            end_id,
-                           start_step,
+                           start_steps,
                            max_length,
                            min_length,
                            output_ids_map,
@@ -676,7 +1165,10 @@ namespace ctranslate2 {
                            return_scores ? &scores : nullptr,
                            return_attention ? &attention : nullptr,
                            return_alternatives ? 1 : num_hypotheses,
-                           return_alternatives ? nullptr : prefix_ids);
+                           // The batch is flattened with the alternatives.
+                           return_alternatives ? nullptr : prefix_ids,
+                           return_alternatives ? nullptr : is_cancelled,
+                           return_alternatives ? nullptr : callback);
 
     if (return_alternatives) {
       // Convert outputs from shape batch_size*num_hypotheses x 1 to batch_size x num_hypotheses.
@@ -691,15 +1183,17 @@ namespace ctranslate2 {
     for (size_t i = 0; i < batch_size; ++i) {
 
       // Aggregate result from the optional prefix and expansion step.
-      if (return_alternatives) {
+      if (return_alternatives || with_prefix) {
 
-        for (size_t h = 0; h < num_hypotheses; ++h) {
+        for (size_t h = 0; h < sampled_ids[i].size(); ++h) {
           // Finalize the generated ids.
           std::vector<size_t>& ids = sampled_ids[i][h];
           if (!expanded_ids.empty())
             ids.insert(ids.begin(), expanded_ids[i][h][0]);
-          if (prefix_ids)
-            ids.insert(ids.begin(), prefix_ids->at(i).begin(), prefix_ids->at(i).end());
+          if (prefix_lengths[i] > 0)
+            ids.insert(ids.begin(),
+                       prefix_ids->at(i).begin(),
+                       prefix_ids->at(i).begin() + prefix_lengths[i]);
 
           // Finalize the score.
           if (return_scores && !expanded_scores.empty())
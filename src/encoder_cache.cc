@@ -0,0 +1,96 @@
+#include "ctranslate2/encoder_cache.h"
+
+#include <iterator>
+
+namespace ctranslate2 {
+
+  static std::string make_key(const models::Model& model, const std::vector<size_t>& ids) {
+    const auto* model_address = &model;
+    std::string key(reinterpret_cast<const char*>(&model_address), sizeof (model_address));
+    key.append(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof (size_t));
+    return key;
+  }
+
+  EncoderCache::EncoderCache(size_t max_memory)
+    : _max_memory(max_memory) {
+  }
+
+  bool EncoderCache::get(const std::shared_ptr<const models::Model>& model,
+                         const std::vector<size_t>& ids,
+                         StorageView& output) {
+    const std::string key = make_key(*model, ids);
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      auto it = _index.find(key);
+      if (it != _index.end()) {
+        auto entry = it->second;
+        if (entry->model.lock() == model) {
+          _entries.splice(_entries.begin(), _entries, entry);
+          output.assign(entry->output);
+          _num_hits += 1;
+          return true;
+        }
+        erase(entry);
+      }
+    }
+    _num_misses += 1;
+    return false;
+  }
+
+  void EncoderCache::put(const std::shared_ptr<const models::Model>& model,
+                         const std::vector<size_t>& ids,
+                         StorageView output) {
+    std::string key = make_key(*model, ids);
+    const size_t memory_usage = (2 * key.size()
+                                 + output.size() * dtype_size(output.dtype()));
+    if (memory_usage > _max_memory)
+      return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _index.find(key);
+    if (it != _index.end())
+      erase(it->second);
+
+    _entries.emplace_front(Entry{std::move(key), model, std::move(output), memory_usage});
+    _index.emplace(_entries.front().key, _entries.begin());
+    _memory_usage += memory_usage;
+
+    while (_memory_usage > _max_memory)
+      erase(std::prev(_entries.end()));
+  }
+
+  void EncoderCache::erase(std::list<Entry>::iterator it) {
+    _memory_usage -= it->memory_usage;
+    _index.erase(it->key);
+    _entries.erase(it);
+  }
+
+  void EncoderCache::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+    _memory_usage = 0;
+  }
+
+  size_t EncoderCache::memory_usage() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _memory_usage;
+  }
+
+  size_t EncoderCache::num_hits() const {
+    return _num_hits;
+  }
+
+  size_t EncoderCache::num_misses() const {
+    return _num_misses;
+  }
+
+  float EncoderCache::hit_ratio() const {
+    const size_t num_hits = _num_hits;
+    const size_t num_lookups = num_hits + _num_misses;
+    if (num_lookups == 0)
+      return 0;
+    return static_cast<float>(num_hits) / static_cast<float>(num_lookups);
+  }
+
+}
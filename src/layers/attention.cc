@@ -8,26 +8,30 @@
 namespace ctranslate2 {
   namespace layers {
 
-    StorageView make_relative_positions(dim_t length, dim_t max_position, bool with_cache) {
-      StorageView positions({with_cache ? 1 : length, length}, DataType::INT32);
+    // Returns the relative positions with shape [queries_length, keys_length] when the
+    // queries are the last queries_length positions of the keys.
+    static StorageView make_relative_positions_of_queries(dim_t queries_length,
+                                                          dim_t keys_length,
+                                                          dim_t max_position) {
+      StorageView positions({queries_length, keys_length}, DataType::INT32);
       auto* positions_data = positions.data<int32_t>();
+      const dim_t offset = keys_length - queries_length;
 
-      if (with_cache) {
-        for (dim_t i = 0; i < length; ++i) {
-          positions_data[i] = std::max(i - length + 1, -max_position) + max_position;
-        }
-      } else {
-        for (dim_t i = 0; i < length; ++i) {
-          auto* row = positions_data + i * length;
-          for (dim_t j = 0; j < length; ++j) {
-            row[j] = std::min(std::max(j - i, -max_position), max_position) + max_position;
-          }
+      for (dim_t i = 0; i < queries_length; ++i) {
+        auto* row = positions_data + i * keys_length;
+        for (dim_t j = 0; j < keys_length; ++j) {
+          row[j] = (std::min(std::max(j - (i + offset), -max_position), max_position)
+                    + max_position);
         }
       }
 
       return positions;
     }
 
+    StorageView make_relative_positions(dim_t length, dim_t max_position, bool with_cache) {
+      return make_relative_positions_of_queries(with_cache ? 1 : length, length, max_position);
+    }
+
     static void matmul_with_relative_representations(const ops::MatMul& matmul_op,
                                                      const StorageView& a,
                                                      const StorageView& b,
@@ -77,16 +81,17 @@ namespace ctranslate2 {
                                       StorageView& output,
                                       StorageView* attention = nullptr,
                                       float queries_scale = 1,
-                                      bool with_cache = false) {
+                                      const StorageView* attention_bias = nullptr) {
       PROFILE("dot_product_attention");
 
       std::unique_ptr<const StorageView> relative_positions;
       if (relative_position_keys || relative_position_values) {
-        const dim_t max_time = keys.dim(2);
+        // With cached keys, the queries are the last positions.
         relative_positions.reset(
-          new StorageView(make_relative_positions(max_time,
-                                                  maximum_relative_position,
-                                                  with_cache).to(queries.device())));
+          new StorageView(make_relative_positions_of_queries(queries.dim(2),
+                                                             keys.dim(2),
+                                                             maximum_relative_position)
+                          .to(queries.device())));
       }
 
       const ops::MatMul keys_matmul(/*transpose_a=*/false, /*transpose_b=*/true, queries_scale);
@@ -97,6 +102,8 @@ namespace ctranslate2 {
                                      *relative_position_keys,
                                      keys_matmul,
                                      output);
+      if (attention_bias)
+        ops::Add()(output, *attention_bias, output);
 
       StorageView attn(values.dtype(), values.device());
       ops::SoftMax()(output, values_lengths, attn);
@@ -165,7 +172,8 @@ namespace ctranslate2 {
                                         StorageView* cached_keys,
                                         StorageView* cached_values,
                                         StorageView* attention,
-                                        const Padder* padder) const {
+                                        const Padder* padder,
+                                        const StorageView* attention_bias) const {
       PROFILE("MultiHeadAttention");
       const Device device = queries.device();
       const DataType dtype = queries.dtype();
@@ -246,7 +254,7 @@ namespace ctranslate2 {
                             context,
                             attention,
                             _queries_scale,
-                            bool(cached_keys));
+                            attention_bias);
 
       StorageView& combined = values_proj;  // Reuse storage.
       combine_heads(context, combined);
@@ -9,6 +9,58 @@ namespace ctranslate2 {
       : _device(device) {
     }
 
+    void Decoder::forward_prefix(dim_t start_step,
+                                 const StorageView& ids,
+                                 DecoderState& state,
+                                 StorageView* attention) {
+      const dim_t batch_size = ids.dim(0);
+      const dim_t time = ids.dim(1);
+      const StorageView host_ids = ids.to(Device::CPU);
+      StorageView step_ids({batch_size, 1}, DataType::INT32);
+      std::vector<StorageView> step_attention;
+      if (attention)
+        step_attention.reserve(time);
+
+      for (dim_t t = 0; t < time; ++t) {
+        for (dim_t b = 0; b < batch_size; ++b)
+          step_ids.at<int32_t>(b) = host_ids.at<int32_t>({b, t});
+        if (attention)
+          step_attention.emplace_back(attention->dtype(), _device);
+        (*this)(start_step + t,
+                step_ids.to(_device),
+                state,
+                /*logits=*/nullptr,
+                attention ? &step_attention.back() : nullptr);
+      }
+
+      if (attention) {
+        std::vector<StorageView*> inputs;
+        inputs.reserve(time);
+        for (auto& x : step_attention)
+          inputs.emplace_back(&x);
+        ops::Concat(1)(inputs, *attention);
+      }
+    }
+
+    void Decoder::forward_prefix(const std::vector<dim_t>&,
+                                 const StorageView&,
+                                 DecoderState&,
+                                 StorageView*) {
+      throw std::runtime_error("This decoder does not support prefixes of different lengths");
+    }
+
+    void Decoder::operator()(const std::vector<dim_t>&,
+                             const StorageView&,
+                             DecoderState&,
+                             StorageView*,
+                             StorageView*) {
+      throw std::runtime_error("This decoder does not support continuous batching");
+    }
+
+    void Decoder::append_state(DecoderState&, DecoderState&) const {
+      throw std::runtime_error("This decoder does not support continuous batching");
+    }
+
     void Decoder::gather_state(DecoderState& state, const StorageView& indices) const {
       static const ops::Gather gather_op;
 
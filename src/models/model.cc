@@ -1,11 +1,28 @@
 #include "ctranslate2/models/model.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
 
 #include "ctranslate2/models/transformer.h"
 #include "ctranslate2/utils.h"
 
+#ifndef _WIN32
+#  include <cerrno>
+#  include <signal.h>
+#  include <unistd.h>
+#endif
+
 #include "cpu/backend.h"
+#include "cpu/cpu_isa.h"
+#include "models/model_file.h"
+#include "type_dispatch.h"
 
 namespace ctranslate2 {
   namespace models {
@@ -32,12 +49,179 @@ namespace ctranslate2 {
     template<>
     std::string consume(std::istream& in) {
       const auto str_length = consume<uint16_t>(in);
+      if (!in || str_length == 0)
+        return std::string();
       const auto c_str = consume<char>(in, str_length);
-      std::string str(c_str);
+      // The saved string is null-terminated but the file can be truncated or corrupted.
+      const size_t length = in ? std::find(c_str, c_str + str_length, '\0') - c_str : 0;
+      std::string str(c_str, length);
       delete [] c_str;
       return str;
     }
 
+    template <typename T>
+    void produce(std::ostream& out, const T& val) {
+      out.write(reinterpret_cast<const char*>(&val), sizeof (T));
+    }
+
+    template<>
+    void produce(std::ostream& out, const std::string& str) {
+      produce<uint16_t>(out, str.size() + 1);
+      out.write(str.c_str(), str.size() + 1);
+    }
+
+    // Variable data are aligned in files with binary version >= 6. This value should match
+    // _ALIGNMENT in python/ctranslate2/specs/model_spec.py.
+    static const size_t variable_alignment = 64;
+
+    // Reads the variable index and the aliases saved in files with binary version >= 6.
+    static void read_variable_index(std::istream& in,
+                                    std::vector<VariableEntry>& entries,
+                                    std::vector<std::pair<std::string, std::string>>& aliases) {
+      const auto num_variables = consume<uint32_t>(in);
+      const auto num_aliases = consume<uint32_t>(in);
+
+      entries.reserve(num_variables);
+      for (uint32_t i = 0; i < num_variables; ++i) {
+        VariableEntry entry;
+        entry.name = consume<std::string>(in);
+        const size_t rank = consume<uint8_t>(in);
+        const auto* dimensions = consume<uint32_t>(in, rank);
+        entry.shape.assign(dimensions, dimensions + rank);
+        delete [] dimensions;
+        entry.dtype = static_cast<DataType>(consume<uint8_t>(in));
+        entry.num_bytes = consume<uint64_t>(in);
+        entry.offset = consume<uint64_t>(in);
+        if (!in)
+          throw std::runtime_error("The variable index is truncated");
+        entries.emplace_back(std::move(entry));
+      }
+
+      aliases.reserve(num_aliases);
+      for (uint32_t i = 0; i < num_aliases; ++i) {
+        auto alias = consume<std::string>(in);
+        auto variable_name = consume<std::string>(in);
+        aliases.emplace_back(std::move(alias), std::move(variable_name));
+      }
+    }
+
+    static void write_header(std::ostream& out,
+                             const std::string& spec,
+                             const size_t spec_revision,
+                             const std::vector<SavedVariable>& variables,
+                             const std::vector<std::pair<std::string, std::string>>& aliases,
+                             const std::vector<uint64_t>& offsets) {
+      produce<uint32_t>(out, current_binary_version);
+      produce(out, spec);
+      produce<uint32_t>(out, spec_revision);
+      produce<uint32_t>(out, variables.size());
+      produce<uint32_t>(out, aliases.size());
+      for (size_t i = 0; i < variables.size(); ++i) {
+        const auto& variable = *variables[i].variable;
+        produce(out, variables[i].name);
+        produce<uint8_t>(out, variable.rank());
+        for (const auto dim : variable.shape())
+          produce<uint32_t>(out, dim);
+        produce<uint8_t>(out, static_cast<uint8_t>(variable.dtype()));
+        produce<uint64_t>(out, variables[i].num_bytes);
+        produce<uint64_t>(out, offsets[i]);
+      }
+      for (const auto& alias : aliases) {
+        produce(out, alias.first);
+        produce(out, alias.second);
+      }
+    }
+
+    static uint64_t align_offset(const uint64_t offset) {
+      return (offset + variable_alignment - 1) / variable_alignment * variable_alignment;
+    }
+
+    void write_model_file(std::ostream& out,
+                          const std::string& spec,
+                          const size_t spec_revision,
+                          const std::vector<SavedVariable>& variables,
+                          const std::vector<std::pair<std::string, std::string>>& aliases) {
+      // The header size does not depend on the offset values so we can first serialize it
+      // with null offsets to compute where the variable data start.
+      std::vector<uint64_t> offsets(variables.size(), 0);
+      std::ostringstream header;
+      write_header(header, spec, spec_revision, variables, aliases, offsets);
+
+      uint64_t offset = align_offset(header.str().size());
+      for (size_t i = 0; i < variables.size(); ++i) {
+        offsets[i] = offset;
+        offset = align_offset(offset + variables[i].num_bytes);
+      }
+
+      write_header(out, spec, spec_revision, variables, aliases, offsets);
+
+      uint64_t position = header.str().size();
+      for (size_t i = 0; i < variables.size(); ++i) {
+        const StorageView& variable = *variables[i].variable;
+        const std::string padding(offsets[i] - position, '\0');
+        out.write(padding.data(), padding.size());
+        out.write(static_cast<const char*>(variable.buffer()), variables[i].num_bytes);
+        position = offsets[i] + variables[i].num_bytes;
+      }
+    }
+
+    // Returns a pointer to the variable data in the mapped file, or nullptr if the data can't
+    // be viewed directly. The mapping can be a MappedFile or a SharedMemory.
+    template <typename Mapping>
+    static const char* get_mapped_data(const Mapping& mapped_file,
+                                       const std::streamoff offset,
+                                       const dim_t num_bytes,
+                                       const DataType dtype) {
+      if (offset < 0 || static_cast<size_t>(offset + num_bytes) > mapped_file.size())
+        return nullptr;
+      const char* data = mapped_file.data() + offset;
+      size_t item_size = 0;
+      TYPE_DISPATCH(dtype, item_size = sizeof (T));
+      // Older binary formats do not align the variables so we can only view the data
+      // when it is correctly aligned for its type.
+      if (reinterpret_cast<uintptr_t>(data) % item_size != 0)
+        return nullptr;
+      return data;
+    }
+
+    // Reads the variable data located at offset in the model file. When the file is mapped,
+    // the returned variable is a view on the mapped data if possible. num_bytes can be larger
+    // than the size of shape, in which case the extra data is also loaded.
+    template <typename Mapping>
+    static StorageView read_variable(std::istream& model_file,
+                                     const Mapping* mapped_file,
+                                     const std::streamoff offset,
+                                     const Shape& shape,
+                                     const DataType dtype,
+                                     const dim_t num_bytes) {
+      StorageView variable(dtype);
+      dim_t item_size = 0;
+      TYPE_DISPATCH(dtype, item_size = sizeof (T));
+      dim_t size = 1;
+      for (const dim_t dim : shape)
+        size *= dim;
+      if (num_bytes < size * item_size)
+        throw std::runtime_error("The variable data is smaller than its shape");
+
+      const char* mapped_data = (mapped_file
+                                 ? get_mapped_data(*mapped_file, offset, num_bytes, dtype)
+                                 : nullptr);
+      if (mapped_data) {
+        model_file.seekg(offset + num_bytes);
+        TYPE_DISPATCH(dtype,
+                      variable.view(const_cast<T*>(reinterpret_cast<const T*>(mapped_data)),
+                                    shape));
+      } else {
+        model_file.seekg(offset);
+        variable.reserve(num_bytes / item_size);
+        variable.resize(shape);
+        consume<char>(model_file, num_bytes, static_cast<char*>(variable.buffer()));
+        if (!model_file)
+          throw std::runtime_error("The variable data is truncated");
+      }
+      return variable;
+    }
+
     static void move_variables_to_device(std::unordered_map<std::string, StorageView>& variables,
                                          const Device device) {
       // Some variables can be shallow copies of others. Those variables should not be
@@ -73,6 +257,20 @@ namespace ctranslate2 {
             new_alias.shallow_copy(*variable);
             swap(*alias, new_alias);
           }
+          buffer_to_aliases.erase(it);
+        }
+      }
+
+      // The remaining views do not alias an owned variable (e.g. they view a memory mapped
+      // file): move the first view of each buffer and update the others.
+      for (auto& pair : buffer_to_aliases) {
+        std::vector<StorageView*>& views = pair.second;
+        StorageView* variable = views.front();
+        *variable = variable->to(device);
+        for (size_t i = 1; i < views.size(); ++i) {
+          StorageView new_alias(views[i]->dtype(), device);
+          new_alias.shallow_copy(*variable);
+          swap(*views[i], new_alias);
         }
       }
     }
@@ -98,6 +296,279 @@ namespace ctranslate2 {
       }
     }
 
+    // Runs func(i) for each i in [0, size) on multiple threads. The intra-op parallelism
+    // is disabled in each thread so that they do not compete for the same cores.
+    template <typename Function>
+    static void parallel_for_each(const size_t size, const Function& func) {
+      const size_t num_threads = std::min(size,
+                                          std::max(size_t(std::thread::hardware_concurrency()),
+                                                   size_t(1)));
+      if (num_threads <= 1) {
+        for (size_t i = 0; i < size; ++i)
+          func(i);
+        return;
+      }
+
+      std::atomic<size_t> next_index(0);
+      std::vector<std::exception_ptr> exceptions(num_threads);
+      std::vector<std::thread> threads;
+      threads.reserve(num_threads);
+
+      for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+          set_num_threads(1);
+          try {
+            for (size_t i = next_index++; i < size; i = next_index++)
+              func(i);
+          } catch (...) {
+            exceptions[t] = std::current_exception();
+            next_index = size;
+          }
+        });
+      }
+
+      for (auto& thread : threads)
+        thread.join();
+      for (const auto& exception : exceptions) {
+        if (exception)
+          std::rethrow_exception(exception);
+      }
+    }
+
+    // Variables created or removed when processing a single variable. They are merged in
+    // the variable index once all variables are processed.
+    struct VariableUpdates {
+      std::unordered_map<std::string, StorageView> variables_to_add;
+      std::vector<std::string> variables_to_remove;
+    };
+
+    static void apply_variable_updates(std::unordered_map<std::string, StorageView>& variables,
+                                       std::vector<VariableUpdates>& updates) {
+      for (auto& update : updates) {
+        for (auto& variable_pair : update.variables_to_add)
+          variables.emplace(std::move(variable_pair));
+      }
+      for (const auto& update : updates) {
+        for (const auto& name : update.variables_to_remove)
+          variables.erase(name);
+      }
+    }
+
+    static dim_t get_variable_bytes(const StorageView& variable) {
+      dim_t num_bytes = 0;
+      TYPE_DISPATCH(variable.dtype(), num_bytes = variable.size() * sizeof (T));
+      return num_bytes;
+    }
+
+    // Process-wide registry of the variables that can be shared by all loaded models. The
+    // registry only holds weak references: a shared variable is released when the last model
+    // viewing it is destroyed.
+    class SharedVariableRegistry {
+    public:
+      // Returns a registered variable with the same content, or registers this variable.
+      std::shared_ptr<const StorageView> get_or_register(StorageView& variable,
+                                                         const uint64_t hash) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& candidates = _variables[hash];
+        for (auto it = candidates.begin(); it != candidates.end();) {
+          std::shared_ptr<const StorageView> candidate = it->lock();
+          if (!candidate) {
+            it = candidates.erase(it);
+            continue;
+          }
+          // The full buffers are compared since they can hold more data than the variable
+          // shape (e.g. packed weights).
+          if (candidate->dtype() == variable.dtype()
+              && candidate->shape() == variable.shape()
+              && candidate->reserved_memory() == variable.reserved_memory()
+              && std::memcmp(candidate->buffer(),
+                             variable.buffer(),
+                             variable.reserved_memory()) == 0)
+            return candidate;
+          ++it;
+        }
+
+        // The storage is moved so existing views on this variable remain valid.
+        auto shared_variable = std::make_shared<const StorageView>(std::move(variable));
+        candidates.emplace_back(shared_variable);
+        return shared_variable;
+      }
+
+      // Removes the entries of released variables.
+      void prune() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _variables.begin(); it != _variables.end();) {
+          auto& candidates = it->second;
+          candidates.erase(std::remove_if(candidates.begin(),
+                                          candidates.end(),
+                                          [](const std::weak_ptr<const StorageView>& candidate) {
+                                            return candidate.expired();
+                                          }),
+                           candidates.end());
+          if (candidates.empty())
+            it = _variables.erase(it);
+          else
+            ++it;
+        }
+      }
+
+    private:
+      std::mutex _mutex;
+      std::unordered_map<uint64_t, std::vector<std::weak_ptr<const StorageView>>> _variables;
+    };
+
+    static SharedVariableRegistry& get_shared_variable_registry() {
+      static SharedVariableRegistry registry;
+      return registry;
+    }
+
+    // Small variables are not worth sharing.
+    static const dim_t min_shared_variable_bytes = 4096;
+
+    // Returns the path to the cached processed weights. The cache entry is keyed by the hash
+    // of the linear weights, the Gemm backend, and the CPU ISA.
+    static std::string
+    get_processed_weights_cache_path(const std::string& cache_dir,
+                                     std::vector<const std::pair<const std::string,
+                                                                 StorageView>*>& weights,
+                                     const ComputeType compute_type,
+                                     const bool packed) {
+      // Sort the weights so that the hash does not depend on the variable index order.
+      std::sort(weights.begin(), weights.end(),
+                [](const std::pair<const std::string, StorageView>* a,
+                   const std::pair<const std::string, StorageView>* b) {
+                  return a->first < b->first;
+                });
+
+      std::vector<uint64_t> hashes(weights.size());
+      parallel_for_each(weights.size(), [&](const size_t i) {
+        const std::string& name = weights[i]->first;
+        const StorageView& weight = weights[i]->second;
+        dim_t num_bytes = 0;
+        TYPE_DISPATCH(weight.dtype(), num_bytes = weight.size() * sizeof (T));
+        uint64_t hash = hash_bytes(name.data(), name.size(), static_cast<uint64_t>(weight.dtype()));
+        hash = hash_bytes(weight.shape().data(), weight.rank() * sizeof (dim_t), hash);
+        hashes[i] = hash_bytes(weight.buffer(), num_bytes, hash);
+      });
+
+      const uint64_t model_hash = hash_bytes(hashes.data(), hashes.size() * sizeof (uint64_t));
+
+      std::ostringstream path;
+      path << cache_dir << '/'
+           << std::hex << std::setfill('0') << std::setw(16) << model_hash
+           << '-' << cpu::gemm_backend_to_str(cpu::get_gemm_backend(compute_type))
+           << '-' << cpu::isa_to_str(cpu::get_cpu_isa())
+           << (packed ? "-packed" : "")
+           << ".bin";
+      return path.str();
+    }
+
+    // Returns the checksum of a variable saved in the cache file, which detects corrupted
+    // cache files.
+    static uint64_t hash_cached_variable(const std::string& name,
+                                         const void* data,
+                                         const size_t num_bytes,
+                                         const uint64_t seed) {
+      return hash_bytes(data, num_bytes, hash_bytes(name.data(), name.size(), seed));
+    }
+
+    // The checksum of the cached variables is saved next to the cache file.
+    static std::string get_checksum_path(const std::string& path) {
+      return path + ".checksum";
+    }
+
+    // Writes into a temporary file first so that other processes never read a partial file.
+    template <typename Writer>
+    static bool write_file_atomically(const std::string& path, const Writer& writer) {
+      const std::string tmp_path = path + ".tmp" + std::to_string(std::random_device()());
+      bool success = false;
+      {
+        std::ofstream file(tmp_path, std::ios_base::out | std::ios_base::binary);
+        if (file) {
+          writer(file);
+          file.close();
+          success = static_cast<bool>(file);
+        }
+      }
+
+      if (success && std::rename(tmp_path.c_str(), path.c_str()) == 0)
+        return true;
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+
+    bool save_processed_weights(const std::string& path,
+                                const std::string& spec,
+                                const size_t spec_revision,
+                                const std::vector<SavedVariable>& variables) {
+      uint64_t checksum = 0;
+      for (const auto& variable : variables) {
+        checksum = hash_cached_variable(variable.name,
+                                        variable.variable->buffer(),
+                                        variable.num_bytes,
+                                        checksum);
+      }
+
+      return (write_file_atomically(path,
+                                    [&](std::ostream& out) {
+                                      write_model_file(out, spec, spec_revision, variables, {});
+                                    })
+              && write_file_atomically(get_checksum_path(path),
+                                       [checksum](std::ostream& out) {
+                                         out << checksum;
+                                       }));
+    }
+
+    bool read_processed_weights(const std::string& path,
+                                std::vector<std::pair<VariableEntry, StorageView>>& variables,
+                                std::shared_ptr<const MappedFile>& mapped_file) {
+      uint64_t expected_checksum = 0;
+      {
+        std::ifstream checksum_file(get_checksum_path(path));
+        if (!(checksum_file >> expected_checksum))
+          return false;
+      }
+
+      std::ifstream cache_file(path, std::ios_base::in | std::ios_base::binary);
+      if (!cache_file)
+        return false;
+
+      try {
+        const ModelFileHeader header = read_model_header(cache_file);
+
+        std::shared_ptr<const MappedFile> cache_mapped_file;
+#ifndef _WIN32
+        cache_mapped_file = std::make_shared<MappedFile>(path);
+#endif
+
+        std::vector<std::pair<VariableEntry, StorageView>> cached_variables;
+        cached_variables.reserve(header.variables.size());
+        uint64_t checksum = 0;
+        for (const auto& entry : header.variables) {
+          // Truncated files are read from the stream and throw.
+          StorageView variable = read_variable(cache_file,
+                                               cache_mapped_file.get(),
+                                               entry.offset,
+                                               entry.shape,
+                                               entry.dtype,
+                                               entry.num_bytes);
+          checksum = hash_cached_variable(entry.name,
+                                          variable.buffer(),
+                                          entry.num_bytes,
+                                          checksum);
+          cached_variables.emplace_back(entry, std::move(variable));
+        }
+        if (checksum != expected_checksum)
+          return false;
+
+        variables = std::move(cached_variables);
+        mapped_file = std::move(cache_mapped_file);
+        return true;
+      } catch (const std::exception&) {
+        return false;
+      }
+    }
+
     template <typename T>
     static void pack_weight(const StorageView& weight,
                             const bool transpose,
@@ -157,6 +628,7 @@ namespace ctranslate2 {
     }
 
     void Model::set_device(const Device device, const int index) {
+      std::lock_guard<std::mutex> lock(_lazy_mutex);
       move_variables(_variable_index, _device, _device_index, device, index);
       _device = device;
       _device_index = index;
@@ -171,9 +643,23 @@ namespace ctranslate2 {
     }
 
     const StorageView* Model::get_variable_if_exists(const std::string& name) const {
+      if (!_lazy) {
+        auto it = _variable_index.find(name);
+        if (it == _variable_index.end())
+          return nullptr;
+        return &it->second;
+      }
+
+      std::lock_guard<std::mutex> lock(_lazy_mutex);
       auto it = _variable_index.find(name);
-      if (it == _variable_index.end())
-        return nullptr;
+      if (it == _variable_index.end()) {
+        // The model is logically const: materializing a variable does not change its content.
+        if (!const_cast<Model*>(this)->materialize_variable(name))
+          return nullptr;
+        it = _variable_index.find(name);
+        if (it == _variable_index.end())
+          return nullptr;
+      }
       return &it->second;
     }
 
@@ -184,8 +670,225 @@ namespace ctranslate2 {
       return *var;
     }
 
-    const std::unordered_map<std::string, StorageView>& Model::get_variables() const {
-      return _variable_index;
+    std::unordered_map<std::string, const StorageView*> Model::get_variables() const {
+      // Materializing a variable does not erase the variables that were already returned, so
+      // the pointers remain valid.
+      std::unique_lock<std::mutex> lock(_lazy_mutex, std::defer_lock);
+      if (_lazy)
+        lock.lock();
+      std::unordered_map<std::string, const StorageView*> variables;
+      variables.reserve(_variable_index.size());
+      for (const auto& variable_pair : _variable_index)
+        variables.emplace(variable_pair.first, &variable_pair.second);
+      return variables;
+    }
+
+    size_t Model::get_memory_usage() const {
+      std::lock_guard<std::mutex> lock(_lazy_mutex);
+      std::unordered_set<const void*> buffers;
+      size_t memory_usage = 0;
+      for (const auto& variable_pair : _variable_index) {
+        const StorageView& variable = variable_pair.second;
+        if (buffers.insert(variable.buffer()).second)
+          memory_usage += get_variable_bytes(variable);
+      }
+      return memory_usage;
+    }
+
+    size_t Model::get_full_memory_usage() const {
+      if (!_lazy)
+        return get_memory_usage();
+
+      // The variable index is not modified after the model is loaded.
+      const DataType target_dtype = compute_type_to_data_type(_effective_compute_type);
+      size_t memory_usage = 0;
+      for (const auto& variable_pair : _lazy_variables) {
+        const std::string& name = variable_pair.first;
+        const VariableEntry& entry = variable_pair.second;
+        dim_t size = 1;
+        for (const dim_t dim : entry.shape)
+          size *= dim;
+
+        // Same conversion as convert_variable.
+        DataType dtype = entry.dtype;
+        if (is_quantizable(name)) {
+          dtype = target_dtype;
+        } else if (!entry.shape.empty() && name.find("_scale") == std::string::npos) {
+          if (target_dtype == DataType::FLOAT16 && dtype == DataType::FLOAT)
+            dtype = DataType::FLOAT16;
+          else if (target_dtype != DataType::FLOAT16 && dtype == DataType::FLOAT16)
+            dtype = DataType::FLOAT;
+        }
+
+        memory_usage += size * dtype_size(dtype);
+      }
+      return memory_usage;
+    }
+
+    void Model::register_mapped_buffer(const StorageView& variable, const dim_t num_bytes) {
+      if (!variable.owns_data() && num_bytes > variable.reserved_memory())
+        _mapped_buffer_bytes.emplace(variable.buffer(), num_bytes);
+    }
+
+    std::unordered_map<const void*, dim_t> Model::get_buffer_bytes() const {
+      std::unordered_map<const void*, dim_t> buffer_bytes(_mapped_buffer_bytes);
+      for (const auto& variable_pair : _variable_index) {
+        const StorageView& variable = variable_pair.second;
+        dim_t& num_bytes = buffer_bytes[variable.buffer()];
+        num_bytes = std::max(num_bytes, variable.reserved_memory());
+      }
+      return buffer_bytes;
+    }
+
+    bool Model::is_lazy() const {
+      return _lazy;
+    }
+
+    bool Model::unload_variables() const {
+      if (!_lazy)
+        return true;
+      std::lock_guard<std::mutex> lock(_lazy_mutex);
+      if (_num_variables_guards > 0)
+        return false;
+      if (_variable_index.empty())
+        return true;
+      // Like the materialization, releasing the variables does not change the model content.
+      auto* model = const_cast<Model*>(this);
+      model->_variable_index.clear();
+      model->_materialized_variables.clear();
+      ++model->_variables_generation;
+      return true;
+    }
+
+    size_t Model::variables_generation() const {
+      if (!_lazy)
+        return 0;
+      std::lock_guard<std::mutex> lock(_lazy_mutex);
+      return _variables_generation;
+    }
+
+    ModelVariablesGuard::ModelVariablesGuard(const Model& model)
+      : _model(model.is_lazy() ? &model : nullptr) {
+      if (_model) {
+        std::lock_guard<std::mutex> lock(_model->_lazy_mutex);
+        ++_model->_num_variables_guards;
+      }
+    }
+
+    ModelVariablesGuard::ModelVariablesGuard(ModelVariablesGuard&& other)
+      : _model(other._model) {
+      other._model = nullptr;
+    }
+
+    ModelVariablesGuard::~ModelVariablesGuard() {
+      if (_model) {
+        std::lock_guard<std::mutex> lock(_model->_lazy_mutex);
+        --_model->_num_variables_guards;
+      }
+    }
+
+    bool Model::is_pending_variable(const std::string& name) const {
+      return ((_lazy_variables.count(name) != 0 || _lazy_aliases.count(name) != 0)
+              && _materialized_variables.count(name) == 0);
+    }
+
+    bool Model::materialize_variable(const std::string& name) {
+      // Variables derived from a weight are created when materializing the weight.
+      for (const std::string suffix : {"_scale", "_compensation", "_packed"}) {
+        if (ends_with(name, suffix)) {
+          const std::string base_name = name.substr(0, name.size() - suffix.size());
+          if (is_pending_variable(base_name))
+            return materialize_variable(base_name);
+        }
+      }
+
+      if (!is_pending_variable(name))
+        return false;
+      _materialized_variables.emplace(name);
+
+      auto scoped_device_setter = get_scoped_device_setter();
+      std::vector<std::string> new_variables;
+
+      auto alias_it = _lazy_aliases.find(name);
+      if (alias_it != _lazy_aliases.end()) {
+        const std::string& variable_name = alias_it->second;
+        materialize_variable(variable_name);
+        register_variable_alias(name, variable_name);
+        register_variable_alias(name + "_scale", variable_name + "_scale");
+        if (is_linear_weight(name))
+          process_materialized_weight(name, new_variables);
+        return true;
+      }
+
+      const auto read_lazy_variable = [this](const VariableEntry& entry) {
+        StorageView variable = read_variable(*_lazy_file,
+                                             _lazy_mapped_file.get(),
+                                             entry.offset,
+                                             entry.shape,
+                                             entry.dtype,
+                                             entry.num_bytes);
+        register_mapped_buffer(variable, entry.num_bytes);
+        return variable;
+      };
+
+      // The data are read and converted on the CPU, like in Model::load.
+      StorageView variable = read_lazy_variable(_lazy_variables.at(name));
+      new_variables.emplace_back(name);
+
+      // The quantization scale is required to convert the variable.
+      const std::string scale_name = name + "_scale";
+      auto scale_it = _lazy_variables.find(scale_name);
+      if (scale_it != _lazy_variables.end() && _materialized_variables.emplace(scale_name).second) {
+        _variable_index.emplace(scale_name, read_lazy_variable(scale_it->second));
+        new_variables.emplace_back(scale_name);
+      }
+
+      std::unordered_map<std::string, StorageView> variables_to_add;
+      std::vector<std::string> variables_to_remove;
+      convert_variable(name,
+                       variable,
+                       compute_type_to_data_type(_effective_compute_type),
+                       variables_to_add,
+                       variables_to_remove);
+      _variable_index.emplace(name, std::move(variable));
+      for (auto& variable_pair : variables_to_add) {
+        new_variables.emplace_back(variable_pair.first);
+        _variable_index.emplace(std::move(variable_pair));
+      }
+      for (const auto& variable_name : variables_to_remove)
+        _variable_index.erase(variable_name);
+
+      if (is_linear_weight(name))
+        process_materialized_weight(name, new_variables);
+
+      if (_device != Device::CPU) {
+        for (const auto& variable_name : new_variables) {
+          auto it = _variable_index.find(variable_name);
+          if (it != _variable_index.end())
+            it->second = it->second.to(_device);
+        }
+      }
+
+      return true;
+    }
+
+    void Model::process_materialized_weight(const std::string& name,
+                                            std::vector<std::string>& new_variables) {
+      if (_device != Device::CPU)
+        return;  // There is currently no processing for non CPU device.
+      auto it = _variable_index.find(name);
+      if (it == _variable_index.end())
+        return;
+
+      std::unordered_map<std::string, StorageView> variables_to_add;
+      std::vector<std::string> variables_to_remove;
+      process_linear_weight(name, it->second, variables_to_add, variables_to_remove);
+      for (auto& variable_pair : variables_to_add) {
+        new_variables.emplace_back(variable_pair.first);
+        _variable_index.emplace(std::move(variable_pair));
+      }
+      for (const auto& variable_name : variables_to_remove)
+        _variable_index.erase(variable_name);
     }
 
     bool Model::get_flag_with_default(const std::string& name, bool default_value) const {
@@ -293,12 +996,31 @@ namespace ctranslate2 {
       variable = std::move(target_variable);
     }
 
+    void Model::convert_variable(const std::string& name,
+                                 StorageView& variable,
+                                 const DataType target_dtype,
+                                 std::unordered_map<std::string, StorageView>& variables_to_add,
+                                 std::vector<std::string>& variables_to_remove) {
+      // Convert "weight" variables to the expected compute type.
+      if (is_quantizable(name)) {
+        ensure_dtype(name, variable, target_dtype, variables_to_add, variables_to_remove);
+      } else if (!variable.is_scalar() && name.find("_scale") == std::string::npos) {
+        // Other parameters may be converted from or to float16 (e.g. bias).
+        if (target_dtype == DataType::FLOAT16) {
+          if (variable.dtype() == DataType::FLOAT) {
+            variable = variable.to_float16();
+          }
+        } else {
+          if (variable.dtype() == DataType::FLOAT16) {
+            variable = variable.to_float();
+          }
+        }
+      }
+    }
+
     void Model::finalize() {
       auto scoped_device_setter = get_scoped_device_setter();
 
-      std::vector<std::string> variables_to_remove;
-      std::unordered_map<std::string, StorageView> variables_to_add;
-
       DataType model_dtype = DataType::FLOAT;
       for (const auto& variable_pair : _variable_index) {
         const std::string& name = variable_pair.first;
@@ -308,6 +1030,12 @@ namespace ctranslate2 {
           break;
         }
       }
+      for (const auto& variable_pair : _lazy_variables) {
+        if (is_quantizable(variable_pair.first)) {
+          model_dtype = variable_pair.second.dtype;
+          break;
+        }
+      }
 
       _effective_compute_type = resolve_compute_type(_compute_type,
                                                      model_dtype,
@@ -315,108 +1043,195 @@ namespace ctranslate2 {
                                                      _device_index);
       const DataType target_dtype = compute_type_to_data_type(_effective_compute_type);
 
-      for (auto& variable_pair : _variable_index) {
-        const auto& name = variable_pair.first;
-        auto& variable = variable_pair.second;
-
-        // Convert "weight" variables to the expected compute type.
-        if (is_quantizable(name)) {
-          ensure_dtype(name,
-                       variable,
-                       target_dtype,
-                       variables_to_add,
-                       variables_to_remove);
-        } else if (!variable.is_scalar() && name.find("_scale") == std::string::npos) {
-          // Other parameters may be converted from or to float16 (e.g. bias).
-          if (target_dtype == DataType::FLOAT16) {
-            if (variable.dtype() == DataType::FLOAT) {
-              variable = variable.to_float16();
-            }
-          } else {
-            if (variable.dtype() == DataType::FLOAT16) {
-              variable = variable.to_float();
-            }
-          }
-        }
-      }
+      // Variables are still on the CPU at this point and can be converted independently.
+      std::vector<std::pair<const std::string, StorageView>*> variables;
+      variables.reserve(_variable_index.size());
+      for (auto& variable_pair : _variable_index)
+        variables.emplace_back(&variable_pair);
+      std::vector<VariableUpdates> updates(variables.size());
 
-      // Add needed variables.
-      for (auto& variable_pair : variables_to_add)
-        _variable_index.emplace(std::move(variable_pair));
+      parallel_for_each(variables.size(), [&](const size_t i) {
+        convert_variable(variables[i]->first,
+                         variables[i]->second,
+                         target_dtype,
+                         updates[i].variables_to_add,
+                         updates[i].variables_to_remove);
+      });
 
-      // Remove no longer needed variables.
-      for (const auto& name : variables_to_remove)
-        _variable_index.erase(name);
+      apply_variable_updates(_variable_index, updates);
 
       // Second pass to move variables on the target device.
       move_variables_to_device(_variable_index, _device);
     }
 
     // This method runs some precomputations on linear weights when possible.
-    void Model::process_linear_weights() {
+    void Model::process_linear_weights(const std::string& cache_dir) {
       if (_device != Device::CPU)
         return;  // There is currently no processing for non CPU device.
 
       const bool should_pack_weights = cpu::should_pack_gemm_weights();
+
+      std::vector<const std::pair<const std::string, StorageView>*> weights;
+      for (const auto& pair : _variable_index) {
+        if (is_linear_weight(pair.first))
+          weights.emplace_back(&pair);
+      }
+
+      const bool is_int8 = compute_type_to_data_type(_effective_compute_type) == DataType::INT8;
+      const bool should_compute_compensation = is_int8 && cpu::prefer_u8s8s32_gemm();
+      std::string cache_path;
+
+      if (!cache_dir.empty()
+          && !weights.empty()
+          && (should_pack_weights || should_compute_compensation)) {
+        cache_path = get_processed_weights_cache_path(cache_dir,
+                                                      weights,
+                                                      _effective_compute_type,
+                                                      should_pack_weights);
+        if (load_processed_weights(cache_path))
+          return;
+      }
+
+      std::vector<VariableUpdates> updates(weights.size());
+
+      parallel_for_each(weights.size(), [&](const size_t i) {
+        process_linear_weight(weights[i]->first,
+                              weights[i]->second,
+                              updates[i].variables_to_add,
+                              updates[i].variables_to_remove);
+      });
+
+      // Errors are ignored since the cache is optional.
+      if (!cache_path.empty()) {
+        std::vector<SavedVariable> processed_weights;
+        for (const auto& update : updates) {
+          for (const auto& variable_pair : update.variables_to_add) {
+            const StorageView& variable = variable_pair.second;
+            processed_weights.push_back({variable_pair.first, &variable, variable.reserved_memory()});
+          }
+        }
+        save_processed_weights(cache_path, _spec, _spec_revision, processed_weights);
+      }
+
+      apply_variable_updates(_variable_index, updates);
+    }
+
+    void Model::process_linear_weight(const std::string& name,
+                                      const StorageView& weight,
+                                      std::unordered_map<std::string, StorageView>& variables_to_add,
+                                      std::vector<std::string>& variables_to_remove) const {
+      const bool should_pack_weights = cpu::should_pack_gemm_weights();
       const bool transpose = true;
       const float alpha = 1;
 
-      std::vector<std::string> variables_to_remove;
-      std::unordered_map<std::string, StorageView> variables_to_add;
+      const DataType dtype = weight.dtype();
+      const dim_t k = weight.dim(1);
+      const dim_t n = weight.dim(0);
+
+      // If the target Gemm implementation prefers the u8s8s32 format, we can shift
+      // the input of linear layers to the u8 domain and add a compensation term.
+      // This term only depends on the linear weight, so we can compute it once and
+      // store it as a model variable.
+      if (dtype == DataType::INT8 && cpu::prefer_u8s8s32_gemm()) {
+        StorageView compensation({n}, DataType::INT32);
+        primitives<Device::CPU>::compute_u8_compensation(weight.data<int8_t>(),
+                                                         transpose,
+                                                         k, n,
+                                                         alpha,
+                                                         compensation.data<int32_t>());
+        variables_to_add.emplace(name + "_compensation", std::move(compensation));
+      }
 
-      for (const auto& pair : _variable_index) {
-        const std::string& name = pair.first;
-        if (!is_linear_weight(name))
-          continue;
+      // If requested, linear weights can be packed for the Gemm call.
+      if (should_pack_weights && is_packable(name)) {
+        StorageView packed_weight(dtype);
 
-        const StorageView& weight = pair.second;
-        const DataType dtype = weight.dtype();
-        const dim_t k = weight.dim(1);
-        const dim_t n = weight.dim(0);
-
-        // If the target Gemm implementation prefers the u8s8s32 format, we can shift
-        // the input of linear layers to the u8 domain and add a compensation term.
-        // This term only depends on the linear weight, so we can compute it once and
-        // store it as a model variable.
-        if (dtype == DataType::INT8 && cpu::prefer_u8s8s32_gemm()) {
-          StorageView compensation({n}, DataType::INT32);
-          primitives<Device::CPU>::compute_u8_compensation(weight.data<int8_t>(),
-                                                           transpose,
-                                                           k, n,
-                                                           alpha,
-                                                           compensation.data<int32_t>());
-          variables_to_add.emplace(name + "_compensation", std::move(compensation));
+        switch (dtype) {
+        case DataType::FLOAT:
+          pack_weight<float>(weight, transpose, k, n, alpha, packed_weight);
+          break;
+        case DataType::INT16:
+          pack_weight<int16_t>(weight, transpose, k, n, alpha, packed_weight);
+          break;
+        case DataType::INT8:
+          pack_weight<int8_t>(weight, transpose, k, n, alpha, packed_weight);
+          break;
+        default:
+          break;
         }
 
-        // If requested, linear weights can be packed for the Gemm call.
-        if (should_pack_weights && is_packable(name)) {
-          StorageView packed_weight(dtype);
-
-          switch (dtype) {
-          case DataType::FLOAT:
-            pack_weight<float>(weight, transpose, k, n, alpha, packed_weight);
-            break;
-          case DataType::INT16:
-            pack_weight<int16_t>(weight, transpose, k, n, alpha, packed_weight);
-            break;
-          case DataType::INT8:
-            pack_weight<int8_t>(weight, transpose, k, n, alpha, packed_weight);
-            break;
-          default:
-            break;
-          }
-
-          if (!packed_weight.empty()) {
-            variables_to_add.emplace(name + "_packed", std::move(packed_weight));
-            variables_to_remove.emplace_back(name);  // The original weight is no longer needed.
-          }
+        if (!packed_weight.empty()) {
+          variables_to_add.emplace(name + "_packed", std::move(packed_weight));
+          variables_to_remove.emplace_back(name);  // The original weight is no longer needed.
         }
       }
+    }
 
-      for (auto& pair : variables_to_add)
-        _variable_index.emplace(std::move(pair));
-      for (const auto& name : variables_to_remove)
-        _variable_index.erase(name);
+    bool Model::load_processed_weights(const std::string& path) {
+      std::vector<std::pair<VariableEntry, StorageView>> variables;
+      std::shared_ptr<const MappedFile> mapped_file;
+      if (!read_processed_weights(path, variables, mapped_file))
+        return false;
+
+      const std::string packed_suffix = "_packed";
+      for (auto& variable_pair : variables) {
+        const auto& name = variable_pair.first.name;
+        if (ends_with(name, packed_suffix))  // The original weight is no longer needed.
+          _variable_index.erase(name.substr(0, name.size() - packed_suffix.size()));
+        register_mapped_buffer(variable_pair.second, variable_pair.first.num_bytes);
+        _variable_index.emplace(name, std::move(variable_pair.second));
+      }
+
+      if (mapped_file)
+        _mapped_memory.emplace_back(std::move(mapped_file));
+      return true;
+    }
+
+    void Model::share_variables() {
+      if (_device != Device::CPU)
+        return;  // The content hash is computed on the host memory.
+
+      // Only the variables owning their data are shared. The other variables are views on
+      // these variables (e.g. aliases) or on mapped memory.
+      std::vector<StorageView*> variables;
+      std::unordered_multimap<const void*, StorageView*> views;
+      for (auto& variable_pair : _variable_index) {
+        StorageView& variable = variable_pair.second;
+        if (!variable.owns_data())
+          views.emplace(variable.buffer(), &variable);
+        else if (variable.reserved_memory() >= min_shared_variable_bytes)
+          variables.emplace_back(&variable);
+      }
+
+      std::vector<uint64_t> hashes(variables.size());
+      parallel_for_each(variables.size(), [&](const size_t i) {
+        const StorageView& variable = *variables[i];
+        uint64_t hash = hash_bytes(variable.shape().data(),
+                                   variable.rank() * sizeof (dim_t),
+                                   static_cast<uint64_t>(variable.dtype()));
+        hashes[i] = hash_bytes(variable.buffer(), variable.reserved_memory(), hash);
+      });
+
+      auto& registry = get_shared_variable_registry();
+      registry.prune();
+
+      for (size_t i = 0; i < variables.size(); ++i) {
+        StorageView& variable = *variables[i];
+        const void* buffer = variable.buffer();
+        std::shared_ptr<const StorageView> shared_variable = registry.get_or_register(variable,
+                                                                                      hashes[i]);
+        auto& shared_storage = const_cast<StorageView&>(*shared_variable);
+
+        // The views on a duplicated variable should also be updated before it is released.
+        if (shared_variable->buffer() != buffer) {
+          auto range = views.equal_range(buffer);
+          for (auto it = range.first; it != range.second; ++it)
+            it->second->shallow_copy(shared_storage);
+        }
+
+        variable.shallow_copy(shared_storage);
+        _mapped_memory.emplace_back(std::move(shared_variable));
+      }
     }
 
     static DataType get_dtype_from_item_size(uint8_t item_size) {
@@ -467,6 +1282,19 @@ namespace ctranslate2 {
                                  + "(Forward compatibility is not guaranteed.)");
     }
 
+    ModelFileHeader read_model_header(std::istream& in) {
+      const auto binary_version = consume<uint32_t>(in);
+      check_version(binary_version, current_binary_version, "binary version");
+      if (!in || binary_version < 6)
+        throw std::runtime_error("The model file does not have a variable index");
+
+      ModelFileHeader header;
+      header.spec = consume<std::string>(in);
+      header.spec_revision = consume<uint32_t>(in);
+      read_variable_index(in, header.variables, header.aliases);
+      return header;
+    }
+
     std::shared_ptr<const Model> Model::load(const std::string& path,
                                              const std::string& device,
                                              int device_index,
@@ -487,6 +1315,16 @@ namespace ctranslate2 {
                                              Device device,
                                              int device_index,
                                              ComputeType compute_type) {
+      const std::string shared_memory_name = model_reader.get_shared_memory_name();
+      if (!shared_memory_name.empty())
+        return load_shared(model_reader, shared_memory_name, device, device_index, compute_type);
+      return read_model(model_reader, device, device_index, compute_type);
+    }
+
+    std::shared_ptr<Model> Model::read_model(ModelReader& model_reader,
+                                             Device device,
+                                             int device_index,
+                                             ComputeType compute_type) {
       std::unique_ptr<std::istream> model_file_ptr = model_reader.get_required_file(binary_file,
                                                                                     /*binary=*/true);
       std::istream& model_file = *model_file_ptr;
@@ -504,54 +1342,439 @@ namespace ctranslate2 {
         spec_revision = 1;
       }
 
-      Model* model = create_model(model_reader, spec, spec_revision);
+      std::shared_ptr<Model> model(create_model(model_reader, spec, spec_revision));
+      model->_spec = spec;
       model->set_device(device, device_index);
       model->set_compute_type(compute_type);
 
       check_version(spec_revision, model->current_spec_revision(), "revision");
 
-      const auto num_variables = consume<uint32_t>(model_file);
-      model->_variable_index.reserve(num_variables);
-      for (uint32_t i = 0; i < num_variables; ++i) {
-        const auto name = consume<std::string>(model_file);
-        const size_t rank = consume<uint8_t>(model_file);
-        const auto* dimensions = consume<uint32_t>(model_file, rank);
+      // When the model file is mapped in memory, variables are views on the mapped data.
+      // Variables that are converted in finalize() are replaced by new buffers, so only
+      // variables that are already in the target type will reference the mapping.
+      const std::shared_ptr<const MappedFile> mapped_file = model_reader.map_file(binary_file);
+
+      std::vector<std::pair<std::string, std::string>> aliases;
+
+      if (binary_version >= 6) {
+        // The header contains an index of all variables with their absolute offset in the file.
+        // The variable data are aligned so that they can be directly viewed when mapped.
+        std::vector<VariableEntry> entries;
+        read_variable_index(model_file, entries, aliases);
+
+        // Models in shared memory are built from the finalized variables so they can't be lazy.
+        if (model_reader.lazy_load() && model_reader.get_shared_memory_name().empty()) {
+          model->_lazy = true;
+          model->_lazy_mapped_file = mapped_file;
+          if (mapped_file)
+            model->_mapped_memory.emplace_back(mapped_file);
+          for (auto& entry : entries)
+            model->_lazy_variables.emplace(entry.name, std::move(entry));
+          for (auto& alias : aliases)
+            model->_lazy_aliases.emplace(std::move(alias));
+          model->_lazy_file = std::move(model_file_ptr);
+          model->finalize();
+          return model;
+        }
 
-        DataType dtype;
-        dim_t num_bytes = 0;
-        if (binary_version >= 4) {
-          const auto type_id = consume<uint8_t>(model_file);
-          dtype = static_cast<DataType>(type_id);
-          num_bytes = consume<uint32_t>(model_file);
-        } else {
-          const auto item_size = consume<uint8_t>(model_file);
-          dtype = get_dtype_from_item_size(item_size);
-          num_bytes = consume<uint32_t>(model_file) * item_size;
+        model->_variable_index.reserve(entries.size());
+        for (const auto& entry : entries) {
+          StorageView variable = read_variable(model_file,
+                                               mapped_file.get(),
+                                               entry.offset,
+                                               entry.shape,
+                                               entry.dtype,
+                                               entry.num_bytes);
+          model->register_mapped_buffer(variable, entry.num_bytes);
+          model->register_variable(entry.name, variable);
         }
 
-        StorageView variable({dimensions, dimensions + rank}, dtype);
-        consume<char>(model_file, num_bytes, static_cast<char*>(variable.buffer()));
-        model->register_variable(name, variable);
+      } else {
+        const auto num_variables = consume<uint32_t>(model_file);
+        model->_variable_index.reserve(num_variables);
+        for (uint32_t i = 0; i < num_variables; ++i) {
+          const auto name = consume<std::string>(model_file);
+          const size_t rank = consume<uint8_t>(model_file);
+          const auto* dimensions = consume<uint32_t>(model_file, rank);
+          const Shape shape(dimensions, dimensions + rank);
+          delete [] dimensions;
+
+          DataType dtype;
+          dim_t num_bytes = 0;
+          if (binary_version >= 4) {
+            const auto type_id = consume<uint8_t>(model_file);
+            dtype = static_cast<DataType>(type_id);
+            num_bytes = consume<uint32_t>(model_file);
+          } else {
+            const auto item_size = consume<uint8_t>(model_file);
+            dtype = get_dtype_from_item_size(item_size);
+            num_bytes = consume<uint32_t>(model_file) * item_size;
+          }
 
-        delete [] dimensions;
+          StorageView variable = read_variable(model_file,
+                                               mapped_file.get(),
+                                               model_file.tellg(),
+                                               shape,
+                                               dtype,
+                                               num_bytes);
+          model->register_mapped_buffer(variable, num_bytes);
+          model->register_variable(name, variable);
+        }
+
+        if (binary_version >= 3) {
+          const auto num_aliases = consume<uint32_t>(model_file);
+          aliases.reserve(num_aliases);
+          for (uint32_t i = 0; i < num_aliases; ++i) {
+            auto alias = consume<std::string>(model_file);
+            auto variable_name = consume<std::string>(model_file);
+            aliases.emplace_back(std::move(alias), std::move(variable_name));
+          }
+        }
       }
 
+      if (mapped_file)
+        model->_mapped_memory.emplace_back(mapped_file);
+
       model->finalize();
 
       // Register aliases, which are shallow copies of finalized variables.
-      if (binary_version >= 3) {
-        const auto num_aliases = consume<uint32_t>(model_file);
-        for (uint32_t i = 0; i < num_aliases; ++i) {
-          const auto alias = consume<std::string>(model_file);
-          const auto variable_name = consume<std::string>(model_file);
-          model->register_variable_alias(alias, variable_name);
-          // Also alias the quantization scale that could be associated to variable_name.
-          model->register_variable_alias(alias + "_scale", variable_name + "_scale");
+      for (const auto& pair : aliases) {
+        const auto& alias = pair.first;
+        const auto& variable_name = pair.second;
+        model->register_variable_alias(alias, variable_name);
+        // Also alias the quantization scale that could be associated to variable_name.
+        model->register_variable_alias(alias + "_scale", variable_name + "_scale");
+      }
+
+      if (!model->check_processed_weights())
+        model->process_linear_weights(model_reader.processed_weights_cache_dir());
+      if (model_reader.deduplicate_weights() && model_reader.get_shared_memory_name().empty())
+        model->share_variables();
+      return model;
+    }
+
+    // Lists the variables to save. Variables sharing the same buffer are saved once and the
+    // others are saved as aliases. buffer_bytes is the size of the variable buffers, see
+    // Model::get_buffer_bytes.
+    static void
+    collect_saved_variables(const std::unordered_map<std::string, StorageView>& variable_index,
+                            const std::unordered_map<const void*, dim_t>& buffer_bytes,
+                            std::vector<SavedVariable>& variables,
+                            std::vector<std::pair<std::string, std::string>>& aliases) {
+      std::vector<std::string> names;
+      names.reserve(variable_index.size());
+      for (const auto& pair : variable_index)
+        names.emplace_back(pair.first);
+      std::sort(names.begin(), names.end());
+
+      std::unordered_map<const void*, std::string> buffer_to_name;
+      for (const auto& name : names) {
+        const StorageView& variable = variable_index.at(name);
+        auto it = buffer_to_name.find(variable.buffer());
+        if (it != buffer_to_name.end()) {
+          aliases.emplace_back(name, it->second);
+        } else {
+          buffer_to_name.emplace(variable.buffer(), name);
+          const auto bytes_it = buffer_bytes.find(variable.buffer());
+          variables.push_back({name,
+                               &variable,
+                               (bytes_it != buffer_bytes.end()
+                                ? bytes_it->second
+                                : variable.reserved_memory())});
+        }
+      }
+    }
+
+    static const std::string processed_weights_isa = "processed_weights/cpu_isa";
+    static const std::string processed_weights_backend = "processed_weights/gemm_backend";
+
+    void Model::save(const std::string& model_dir, const bool with_processed_weights) const {
+      if (_device != Device::CPU)
+        throw std::invalid_argument("Only models on CPU can be saved");
+
+      // Materialize all variables of a lazy model.
+      if (_lazy) {
+        for (const auto& variable_pair : _lazy_variables)
+          get_variable_if_exists(variable_pair.first);
+        for (const auto& alias_pair : _lazy_aliases)
+          get_variable_if_exists(alias_pair.first);
+      }
+
+      // The views below only cover the variable shape so the buffer sizes are collected from
+      // the model variables.
+      std::unordered_map<std::string, StorageView> variable_index;
+      std::unordered_map<const void*, dim_t> buffer_bytes;
+      {
+        std::lock_guard<std::mutex> lock(_lazy_mutex);
+        buffer_bytes = get_buffer_bytes();
+        for (const auto& variable_pair : _variable_index) {
+          const std::string& name = variable_pair.first;
+          if (ends_with(name, "_packed") && !with_processed_weights)
+            throw std::invalid_argument("The model contains packed weights: unset "
+                                        "CT2_USE_EXPERIMENTAL_PACKED_GEMM or save the "
+                                        "processed weights");
+          if (ends_with(name, "_compensation") && !with_processed_weights)
+            continue;
+          StorageView view(variable_pair.second.dtype());
+          view.shallow_copy(const_cast<StorageView&>(variable_pair.second));
+          variable_index.emplace(name, std::move(view));
+        }
+      }
+
+      // Processed weights are specific to the CPU ISA and the Gemm backend.
+      if (with_processed_weights) {
+        const auto backend = cpu::get_gemm_backend(_effective_compute_type);
+        variable_index.emplace(processed_weights_isa,
+                               StorageView(static_cast<int32_t>(cpu::get_cpu_isa())));
+        variable_index.emplace(processed_weights_backend,
+                               StorageView(static_cast<int32_t>(backend)));
+      }
+
+      std::vector<SavedVariable> variables;
+      std::vector<std::pair<std::string, std::string>> aliases;
+      collect_saved_variables(variable_index, buffer_bytes, variables, aliases);
+
+      // Revision 1 variable names are renamed when they are registered, so the model
+      // is saved with the variable names of revision 2.
+      const size_t spec_revision = std::max(_spec_revision, size_t(2));
+
+      const std::string path = model_dir + "/" + binary_file;
+      std::ofstream model_file(path, std::ios_base::out | std::ios_base::binary);
+      if (!model_file)
+        throw std::runtime_error("Failed to open " + path + " for writing");
+      write_model_file(model_file, _spec, spec_revision, variables, aliases);
+      model_file.close();
+      if (!model_file)
+        throw std::runtime_error("Failed to write the model to " + path);
+    }
+
+    bool Model::check_processed_weights() const {
+      const auto* isa = get_variable_if_exists(processed_weights_isa);
+      const auto* backend = get_variable_if_exists(processed_weights_backend);
+      if (!isa || !backend)
+        return false;
+      const auto expected_backend = cpu::get_gemm_backend(_effective_compute_type);
+      if (_device != Device::CPU
+          || isa->as_scalar<int32_t>() != static_cast<int32_t>(cpu::get_cpu_isa())
+          || backend->as_scalar<int32_t>() != static_cast<int32_t>(expected_backend))
+        throw std::runtime_error("This model contains linear weights that were processed for "
+                                 "another device, CPU ISA, or Gemm backend");
+      return true;
+    }
+
+    // Shared memory models start with this header followed by the model in the binary format v6.
+    struct SharedModelHeader {
+      std::atomic<uint32_t> state;
+      uint32_t compute_type;
+      int64_t creator_pid;
+      uint64_t model_size;
+    };
+
+    static const size_t shared_model_header_size = align_offset(sizeof (SharedModelHeader));
+
+    enum SharedModelState : uint32_t {
+      CREATING = 0,
+      READY = 1,
+      FAILED = 2,
+    };
+
+    static bool is_process_alive(const int64_t pid) {
+#ifdef _WIN32
+      (void)pid;
+      return true;
+#else
+      return kill(static_cast<pid_t>(pid), 0) == 0 || errno != ESRCH;
+#endif
+    }
+
+    static int64_t get_process_id() {
+#ifdef _WIN32
+      return 0;
+#else
+      return getpid();
+#endif
+    }
+
+    // Stream buffer reading or writing a memory region.
+    class MemoryStreamBuf : public std::streambuf {
+    public:
+      MemoryStreamBuf(char* data, size_t size) {
+        setg(data, data, data + size);
+        setp(data, data + size);
+      }
+
+    protected:
+      pos_type seekoff(off_type off,
+                       std::ios_base::seekdir dir,
+                       std::ios_base::openmode which) override {
+        if (!(which & std::ios_base::in))
+          return pos_type(off_type(-1));
+        char* base = (dir == std::ios_base::beg ? eback()
+                      : dir == std::ios_base::cur ? gptr()
+                      : egptr());
+        char* position = base + off;
+        if (position < eback() || position > egptr())
+          return pos_type(off_type(-1));
+        setg(eback(), position, egptr());
+        return pos_type(position - eback());
+      }
+
+      pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+      }
+    };
+
+    // Stream buffer that only counts the number of written bytes.
+    class CountingStreamBuf : public std::streambuf {
+    public:
+      size_t count() const {
+        return _count;
+      }
+
+    protected:
+      std::streamsize xsputn(const char*, std::streamsize n) override {
+        _count += n;
+        return n;
+      }
+
+      int_type overflow(int_type c) override {
+        ++_count;
+        return traits_type::not_eof(c);
+      }
+
+    private:
+      size_t _count = 0;
+    };
+
+    std::shared_ptr<const Model> Model::load_shared(ModelReader& model_reader,
+                                                    const std::string& shared_memory_name,
+                                                    Device device,
+                                                    int device_index,
+                                                    ComputeType compute_type) {
+      if (device != Device::CPU)
+        throw std::invalid_argument("Models in shared memory can only be loaded on CPU");
+
+      std::shared_ptr<SharedMemory> segment = SharedMemory::create(shared_memory_name);
+
+      if (segment) {
+        // This process created the segment and should build the model.
+        segment->resize(shared_model_header_size);
+        auto* header = reinterpret_cast<SharedModelHeader*>(segment->data());
+        header->creator_pid = get_process_id();
+
+        try {
+          const auto model = read_model(model_reader, device, device_index, compute_type);
+          model->write_shared(*segment);
+          header = reinterpret_cast<SharedModelHeader*>(segment->data());
+          header->state.store(SharedModelState::READY, std::memory_order_release);
+        } catch (...) {
+          header = reinterpret_cast<SharedModelHeader*>(segment->data());
+          header->state.store(SharedModelState::FAILED, std::memory_order_release);
+          SharedMemory::unlink(shared_memory_name);
+          throw;
+        }
+
+        // Attach the segment in read-only mode like the other processes.
+        segment = SharedMemory::open(shared_memory_name);
+        if (!segment)
+          throw std::runtime_error("Shared memory " + shared_memory_name + " was removed");
+
+      } else {
+        segment = SharedMemory::open(shared_memory_name);
+        if (!segment)
+          throw std::runtime_error("Shared memory " + shared_memory_name + " was removed");
+
+        // Wait for the creator process to build the model.
+        while (true) {
+          if (segment->size() >= shared_model_header_size) {
+            const auto* header = reinterpret_cast<const SharedModelHeader*>(segment->data());
+            const auto state = header->state.load(std::memory_order_acquire);
+            if (state == SharedModelState::READY
+                && segment->size() >= shared_model_header_size + header->model_size)
+              break;
+            if (state == SharedModelState::FAILED)
+              throw std::runtime_error("The process creating the shared memory "
+                                       + shared_memory_name + " failed to load the model");
+            if (header->creator_pid > 0 && !is_process_alive(header->creator_pid))
+              throw std::runtime_error("The process creating the shared memory "
+                                       + shared_memory_name + " exited before completion. "
+                                       + "The segment should be removed.");
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          segment->remap();
         }
       }
 
-      model->process_linear_weights();
-      return std::shared_ptr<const Model>(model);
+      const auto* header = reinterpret_cast<const SharedModelHeader*>(segment->data());
+      const auto saved_compute_type = static_cast<ComputeType>(header->compute_type);
+      if (compute_type != ComputeType::DEFAULT && compute_type != saved_compute_type)
+        throw std::invalid_argument("The model in shared memory " + shared_memory_name
+                                    + " was not loaded with the requested compute type");
+
+      return attach_shared(model_reader, std::move(segment));
+    }
+
+    void Model::write_shared(SharedMemory& segment) const {
+      std::vector<SavedVariable> variables;
+      std::vector<std::pair<std::string, std::string>> aliases;
+      collect_saved_variables(_variable_index, get_buffer_bytes(), variables, aliases);
+
+      CountingStreamBuf counter;
+      std::ostream counting_stream(&counter);
+      write_model_file(counting_stream, _spec, _spec_revision, variables, aliases);
+      const size_t model_size = counter.count();
+
+      segment.resize(shared_model_header_size + model_size);
+      MemoryStreamBuf buffer(segment.data() + shared_model_header_size, model_size);
+      std::ostream model_stream(&buffer);
+      write_model_file(model_stream, _spec, _spec_revision, variables, aliases);
+      if (!model_stream)
+        throw std::runtime_error("Failed to write the model in shared memory");
+
+      auto* header = reinterpret_cast<SharedModelHeader*>(segment.data());
+      header->compute_type = static_cast<uint32_t>(_effective_compute_type);
+      header->model_size = model_size;
+    }
+
+    std::shared_ptr<const Model> Model::attach_shared(ModelReader& model_reader,
+                                                      std::shared_ptr<SharedMemory> segment) {
+      const auto* header = reinterpret_cast<const SharedModelHeader*>(segment->data());
+      char* model_data = segment->data() + shared_model_header_size;
+      MemoryStreamBuf buffer(model_data, header->model_size);
+      std::istream model_file(&buffer);
+
+      const ModelFileHeader model_header = read_model_header(model_file);
+      const auto& entries = model_header.variables;
+      const auto& aliases = model_header.aliases;
+
+      std::shared_ptr<Model> model(create_model(model_reader,
+                                                model_header.spec,
+                                                model_header.spec_revision));
+      model->_spec = model_header.spec;
+      model->set_device(Device::CPU);
+      model->set_compute_type(static_cast<ComputeType>(header->compute_type));
+
+      // The saved variables are already finalized: they are registered as is and directly
+      // view the shared memory.
+      model->_variable_index.reserve(entries.size() + aliases.size());
+      for (const auto& entry : entries) {
+        if (entry.offset < 0
+            || entry.offset % variable_alignment != 0
+            || static_cast<uint64_t>(entry.offset + entry.num_bytes) > header->model_size)
+          throw std::runtime_error("Invalid offset for variable " + entry.name
+                                   + " in shared memory");
+        StorageView variable(entry.dtype);
+        TYPE_DISPATCH(entry.dtype,
+                      variable.view(reinterpret_cast<T*>(model_data + entry.offset), entry.shape));
+        model->register_mapped_buffer(variable, entry.num_bytes);
+        model->_variable_index.emplace(entry.name, std::move(variable));
+      }
+      for (const auto& alias : aliases)
+        model->register_variable_alias(alias.first, alias.second);
+
+      model->_mapped_memory.emplace_back(std::move(segment));
+      model->finalize();
+      return model;
     }
 
     bool contains_model(const std::string& path) {
@@ -559,6 +1782,26 @@ namespace ctranslate2 {
     }
 
 
+    std::shared_ptr<const MappedFile> ModelReader::map_file(const std::string&) {
+      return nullptr;
+    }
+
+    std::string ModelReader::get_shared_memory_name() const {
+      return "";
+    }
+
+    bool ModelReader::lazy_load() const {
+      return read_bool_from_env("CT2_USE_LAZY_LOADING");
+    }
+
+    std::string ModelReader::processed_weights_cache_dir() const {
+      return read_string_from_env("CT2_PACKED_WEIGHTS_CACHE_DIR");
+    }
+
+    bool ModelReader::deduplicate_weights() const {
+      return read_bool_from_env("CT2_USE_WEIGHT_DEDUPLICATION");
+    }
+
     std::unique_ptr<std::istream> ModelReader::get_required_file(const std::string& filename,
                                                                  const bool binary) {
       std::unique_ptr<std::istream> file = get_file(filename, binary);
@@ -588,5 +1831,28 @@ namespace ctranslate2 {
       return stream;
     }
 
+    std::shared_ptr<const MappedFile> ModelFileReader::map_file(const std::string& filename) {
+#ifdef _WIN32
+      (void)filename;
+      return nullptr;
+#else
+      if (!read_bool_from_env("CT2_USE_MMAP"))
+        return nullptr;
+      return std::make_shared<MappedFile>(_model_dir + _path_separator + filename);
+#endif
+    }
+
+
+    SharedMemoryModelReader::SharedMemoryModelReader(std::string model_dir,
+                                                     std::string shared_memory_name,
+                                                     std::string path_separator)
+      : ModelFileReader(std::move(model_dir), std::move(path_separator))
+      , _shared_memory_name(std::move(shared_memory_name)) {
+    }
+
+    std::string SharedMemoryModelReader::get_shared_memory_name() const {
+      return _shared_memory_name;
+    }
+
   }
 }
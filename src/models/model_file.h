@@ -0,0 +1,58 @@
+#pragma once
+
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ctranslate2/models/model.h"
+
+namespace ctranslate2 {
+  namespace models {
+
+    // Serialization of the model files with binary version >= 6.
+    // See also the model serialization in python/ctranslate2/specs/model_spec.py.
+
+    struct ModelFileHeader {
+      std::string spec;
+      size_t spec_revision;
+      std::vector<VariableEntry> variables;
+      std::vector<std::pair<std::string, std::string>> aliases;
+    };
+
+    // Reads the header of a file with binary version >= 6, including the variable index.
+    // Throws if the file uses an older or unsupported binary version.
+    ModelFileHeader read_model_header(std::istream& in);
+
+    // A variable to save. num_bytes can be larger than the variable size when its buffer
+    // holds more data than its shape (e.g. packed weights).
+    struct SavedVariable {
+      std::string name;
+      const StorageView* variable;
+      dim_t num_bytes;
+    };
+
+    // Writes variables in the current binary version. The variables should be on the CPU.
+    void write_model_file(std::ostream& out,
+                          const std::string& spec,
+                          const size_t spec_revision,
+                          const std::vector<SavedVariable>& variables,
+                          const std::vector<std::pair<std::string, std::string>>& aliases);
+
+    // Saves the processed linear weights of a model in a cache file. The checksum of the
+    // variables is saved in a separate file path + ".checksum". Returns false on error.
+    bool save_processed_weights(const std::string& path,
+                                const std::string& spec,
+                                const size_t spec_revision,
+                                const std::vector<SavedVariable>& variables);
+
+    // Reads the processed weights saved by save_processed_weights, with their entry in the
+    // cache file. The variables are views on mapped_file when possible. Returns false if the
+    // cache file or its checksum is missing, truncated, or corrupted.
+    bool read_processed_weights(const std::string& path,
+                                std::vector<std::pair<VariableEntry, StorageView>>& variables,
+                                std::shared_ptr<const MappedFile>& mapped_file);
+
+  }
+}
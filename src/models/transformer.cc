@@ -1,5 +1,6 @@
 #include "ctranslate2/models/transformer.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "device_dispatch.h"
@@ -103,7 +104,7 @@ namespace ctranslate2 {
     void PositionEncoder::operator()(StorageView& input, dim_t index) {
       const dim_t max_time = input.dim(1);
       const dim_t depth = input.dim(-1);
-      const StorageView& encodings = get_position_encoding(max_time,
+      const StorageView& encodings = get_position_encoding(index + max_time,
                                                            depth,
                                                            input.device(),
                                                            input.dtype());
@@ -115,6 +116,23 @@ namespace ctranslate2 {
                                                                        input.size())));
     }
 
+    void PositionEncoder::operator()(StorageView& input, const std::vector<dim_t>& positions) {
+      const dim_t num_positions = positions.size();
+      const dim_t depth = input.dim(-1);
+      const dim_t max_position = *std::max_element(positions.begin(), positions.end());
+      const StorageView& encodings = get_position_encoding(max_position + 1,
+                                                           depth,
+                                                           input.device(),
+                                                           input.dtype());
+      const StorageView indices({num_positions},
+                                std::vector<int32_t>(positions.begin(), positions.end()),
+                                input.device());
+      StorageView batch_encodings(input.dtype(), input.device());
+      ops::Gather()(encodings, indices, batch_encodings);
+      batch_encodings.reshape(input.shape());
+      ops::Add()(input, batch_encodings, input);
+    }
+
     const StorageView& PositionEncoder::get_position_encoding(dim_t max_time,
                                                               dim_t depth,
                                                               Device device,
@@ -219,24 +237,33 @@ namespace ctranslate2 {
                                              StorageView* cached_attn_values,
                                              StorageView& output,
                                              StorageView* attention,
-                                             const Padder* padder) const {
+                                             const Padder* padder,
+                                             const StorageView* self_attention_bias) const {
       PROFILE("TransformerDecoderLayer");
       StorageView context(input.dtype(), input.device());
       if (_encoder_attention) {
         _self_attention(input, nullptr, nullptr, output,
-                        &cached_self_attn_keys, &cached_self_attn_values);
+                        &cached_self_attn_keys, &cached_self_attn_values,
+                        nullptr, nullptr, self_attention_bias);
         (*_encoder_attention)(output, memory, memory_lengths, context,
                               cached_attn_keys, cached_attn_values, attention, padder);
       } else {
         _self_attention(input, nullptr, nullptr, context,
-                        &cached_self_attn_keys, &cached_self_attn_values);
+                        &cached_self_attn_keys, &cached_self_attn_values,
+                        nullptr, nullptr, self_attention_bias);
       }
       _ff(context, output);
     }
 
 
+    // Number of hidden vectors alive at the same time in a layer: the input, the projected
+    // queries, keys, and values, the attention context, and the feed forward inner
+    // activations (usually 4 times the model dimension).
+    static const dim_t num_alive_hidden_vectors = 10;
+
     TransformerEncoder::TransformerEncoder(const TransformerModel& model, const std::string& scope)
-      : _embeddings(model, scope + "/embeddings")
+      : _num_heads(model.num_heads())
+      , _embeddings(model, scope + "/embeddings")
       , _compute_type(model.effective_compute_type())
       , _position_encoder(model.with_relative_position()
                           ? nullptr
@@ -263,6 +290,14 @@ namespace ctranslate2 {
       return _output_norm.output_size();
     }
 
+    size_t TransformerEncoder::estimate_memory_usage(dim_t length) const {
+      // The layer activations and the attention weights of a single layer are alive at the
+      // same time.
+      const dim_t num_values = (length * output_size() * num_alive_hidden_vectors
+                                + _num_heads * length * length);
+      return num_values * dtype_size(output_type());
+    }
+
     void TransformerEncoder::operator()(const StorageView& ids,
                                         const StorageView& lengths,
                                         StorageView& output) {
@@ -294,6 +329,7 @@ namespace ctranslate2 {
                                            const std::string& scope,
                                            const bool with_encoder_attention)
       : Decoder(model.device())
+      , _num_heads(model.num_heads())
       , _with_encoder_attention(with_encoder_attention)
       , _compute_type(model.effective_compute_type())
       , _embeddings(model, scope + "/embeddings")
@@ -332,6 +368,19 @@ namespace ctranslate2 {
       _proj.reset_mask();
     }
 
+    size_t TransformerDecoder::estimate_memory_usage(dim_t memory_length,
+                                                     dim_t max_length) const {
+      const dim_t depth = _output_norm.output_size();
+      const dim_t attended_length = max_length + (_with_encoder_attention ? memory_length : 0);
+      // The cached keys and values of each layer, the activations and attention weights of
+      // the current step, and the logits with the log probabilities.
+      const dim_t num_values = (dim_t(_layers.size()) * 2 * attended_length * depth
+                                + depth * num_alive_hidden_vectors
+                                + _num_heads * attended_length
+                                + 2 * output_size());
+      return num_values * dtype_size(output_type());
+    }
+
     layers::DecoderState TransformerDecoder::initial_state() const {
       const DataType dtype = output_type();
       layers::DecoderState state;
@@ -357,20 +406,77 @@ namespace ctranslate2 {
                                         layers::DecoderState& state,
                                         StorageView* logits,
                                         StorageView* attention) {
+      decode(ids, step, nullptr, nullptr, state, logits, attention);
+    }
+
+    void TransformerDecoder::forward_prefix(dim_t start_step,
+                                            const StorageView& ids,
+                                            layers::DecoderState& state,
+                                            StorageView* attention) {
+      decode(ids, start_step, nullptr, nullptr, state, nullptr, attention);
+    }
+
+    void TransformerDecoder::forward_prefix(const std::vector<dim_t>& lengths,
+                                            const StorageView& ids,
+                                            layers::DecoderState& state,
+                                            StorageView* attention) {
+      decode(ids, 0, nullptr, &lengths, state, nullptr, attention);
+    }
+
+    void TransformerDecoder::operator()(const std::vector<dim_t>& steps,
+                                        const StorageView& ids,
+                                        layers::DecoderState& state,
+                                        StorageView* logits,
+                                        StorageView* attention) {
+      decode(ids, 0, &steps, nullptr, state, logits, attention);
+    }
+
+    // Returns the position of each input when the batch entry b is at step steps[b] (or step)
+    // and its inputs are the last lengths[b] ids. The padding positions get the first position.
+    static std::vector<dim_t> get_input_positions(const dim_t batch_size,
+                                                  const dim_t time,
+                                                  const dim_t step,
+                                                  const std::vector<dim_t>* steps,
+                                                  const std::vector<dim_t>* lengths) {
+      std::vector<dim_t> positions;
+      positions.reserve(batch_size * time);
+      for (dim_t b = 0; b < batch_size; ++b) {
+        const dim_t first_position = steps ? steps->at(b) : step;
+        const dim_t num_padding_positions = lengths ? time - lengths->at(b) : 0;
+        for (dim_t t = 0; t < time; ++t)
+          positions.emplace_back(first_position + std::max(t - num_padding_positions, dim_t(0)));
+      }
+      return positions;
+    }
+
+    void TransformerDecoder::decode(const StorageView& ids,
+                                    dim_t step,
+                                    const std::vector<dim_t>* steps,
+                                    const std::vector<dim_t>* lengths,
+                                    layers::DecoderState& state,
+                                    StorageView* logits,
+                                    StorageView* attention) {
       PROFILE("TransformerDecoder");
       StorageView layer_in(output_type(), ids.device());
       StorageView layer_out(output_type(), ids.device());
+      const dim_t batch_size = ids.dim(0);
+      const dim_t time = ids.dim(1);
 
       _embeddings(ids, layer_in);
-      if (_position_encoder)
-        (*_position_encoder)(layer_in, step);
+      if (_position_encoder) {
+        if (steps || lengths)
+          (*_position_encoder)(layer_in,
+                               get_input_positions(batch_size, time, step, steps, lengths));
+        else
+          (*_position_encoder)(layer_in, step);
+      }
 
       StorageView* memory = nullptr;
       const StorageView* memory_lengths = nullptr;
       std::unique_ptr<Padder> memory_padder;
       if (_with_encoder_attention) {
         memory_lengths = &state.at("memory_lengths");
-        if (step == 0) {
+        if (!steps && step == 0) {
           memory = &state.at("memory");
           if (Padder::allow_padding_removal(memory->device(), _compute_type)) {
             memory_padder.reset(new Padder(*memory_lengths, memory->dim(1)));
@@ -379,6 +485,10 @@ namespace ctranslate2 {
         }
       }
 
+      StorageView self_attention_bias;
+      if (steps || lengths || time > 1)
+        self_attention_bias = make_self_attention_bias(batch_size, time, steps, lengths, state);
+
       for (size_t l = 0; l < _layers.size(); ++l) {
         const std::string l_str = std::to_string(l);
         (*_layers[l])(layer_in,
@@ -390,11 +500,12 @@ namespace ctranslate2 {
                       _with_encoder_attention ? &state.at("memory_values_" + l_str) : nullptr,
                       layer_out,
                       l + 1 == _layers.size() ? attention : nullptr,
-                      memory_padder.get());
+                      memory_padder.get(),
+                      self_attention_bias ? &self_attention_bias : nullptr);
         layer_in = std::move(layer_out);
       }
 
-      if (step == 0) {
+      if (!steps && step == 0) {
         // The memory is no longer needed as its projections were cached in the first step.
         state.erase("memory");
       }
@@ -405,5 +516,111 @@ namespace ctranslate2 {
       }
     }
 
+    StorageView
+    TransformerDecoder::make_self_attention_bias(dim_t batch_size,
+                                                 dim_t time,
+                                                 const std::vector<dim_t>* steps,
+                                                 const std::vector<dim_t>* lengths,
+                                                 layers::DecoderState& state) const {
+      // Each input attends to the cached positions and to the previous inputs. With continuous
+      // batching, the self-attention cache of an entry at step t is saved in the last t
+      // positions, and the inputs of an entry can be padded on the left (see forward_prefix):
+      // these padding positions are masked.
+      dim_t cache_time = state.at("self_keys_0") ? state.at("self_keys_0").dim(2) : 0;
+
+      // Remove the cached positions that are padding for all entries.
+      if (steps) {
+        const dim_t max_step = *std::max_element(steps->begin(), steps->end());
+        if (cache_time > max_step) {
+          const ops::Split split(2, {cache_time - max_step, max_step});
+          StorageView padding(output_type(), _device);
+          for (size_t l = 0; l < _layers.size(); ++l) {
+            const std::string l_str = std::to_string(l);
+            for (const auto& name : {"self_keys_" + l_str, "self_values_" + l_str}) {
+              StorageView& cache = state.at(name);
+              StorageView full_cache(std::move(cache));
+              split(full_cache, padding, cache);
+            }
+          }
+          cache_time = max_step;
+        }
+      }
+
+      const auto get_cache_padding = [steps, cache_time](const dim_t b) {
+        return steps ? cache_time - steps->at(b) : dim_t(0);
+      };
+      const auto get_input_padding = [lengths, time](const dim_t b) {
+        return lengths ? time - lengths->at(b) : dim_t(0);
+      };
+
+      if (time == 1) {
+        bool with_padding = false;
+        for (dim_t b = 0; b < batch_size && !with_padding; ++b)
+          with_padding = get_cache_padding(b) > 0;
+        if (!with_padding)
+          return StorageView();
+      }
+
+      const dim_t keys_time = cache_time + time;
+      StorageView bias({batch_size, _num_heads, time, keys_time}, 0.f);
+      auto* bias_data = bias.data<float>();
+      for (dim_t b = 0; b < batch_size; ++b) {
+        const dim_t cache_padding = get_cache_padding(b);
+        const dim_t input_padding = get_input_padding(b);
+        for (dim_t h = 0; h < _num_heads; ++h) {
+          for (dim_t t = 0; t < time; ++t) {
+            auto* row = bias_data + ((b * _num_heads + h) * time + t) * keys_time;
+            std::fill(row, row + cache_padding, -1e9f);
+            std::fill(row + cache_time + t + 1, row + keys_time, -1e9f);
+            // Padding inputs still attend to themselves so that no row is fully masked.
+            if (t >= input_padding)
+              std::fill(row + cache_time, row + cache_time + input_padding, -1e9f);
+          }
+        }
+      }
+      return bias.to(output_type()).to(_device);
+    }
+
+    static void pad_time_dimension(StorageView& x, const dim_t time, const bool left) {
+      // x has shape [batch, heads, time, depth].
+      const dim_t padding_time = time - x.dim(2);
+      if (padding_time <= 0)
+        return;
+      StorageView padding({x.dim(0), x.dim(1), padding_time, x.dim(3)}, x.dtype(), x.device());
+      TYPE_DISPATCH(padding.dtype(), padding.fill(static_cast<T>(0.f)));
+      StorageView unpadded(std::move(x));
+      if (left)
+        ops::Concat(2)({&padding, &unpadded}, x);
+      else
+        ops::Concat(2)({&unpadded, &padding}, x);
+    }
+
+    void TransformerDecoder::append_state(layers::DecoderState& state,
+                                          layers::DecoderState& other_state) const {
+      for (auto& pair : other_state) {
+        const std::string& name = pair.first;
+        StorageView& other = pair.second;
+        auto it = state.find(name);
+        if (it == state.end() || !it->second) {
+          state[name] = std::move(other);
+          continue;
+        }
+
+        StorageView& value = it->second;
+        if (starts_with(name, "self_") || starts_with(name, "memory_keys")
+            || starts_with(name, "memory_values")) {
+          // The self-attention cache is padded on the left (see make_self_attention_bias) and
+          // the memory is padded on the right (masked with memory_lengths).
+          const bool left = starts_with(name, "self_");
+          const dim_t time = std::max(value.dim(2), other.dim(2));
+          pad_time_dimension(value, time, left);
+          pad_time_dimension(other, time, left);
+        }
+
+        StorageView previous_value(std::move(value));
+        ops::Concat(0)({&previous_value, &other}, value);
+      }
+    }
+
   }
 }
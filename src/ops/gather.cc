@@ -20,7 +20,9 @@ namespace ctranslate2 {
     static bool support_gather_batch_inplace(const StorageView& data, const StorageView& input) {
       // We can gather in place if the output is not larger than data and indices are in
       // increasing order (i.e. we never need to gather from a previous index).
+      // Views are not updated in place since the viewed buffer can be shared with other storages.
       return (input.device() == Device::CPU
+              && data.owns_data()
               && input.size() <= data.dim(0)
               && std::is_sorted(input.data<int32_t>(), input.data<int32_t>() + input.size()));
     }
@@ -0,0 +1,163 @@
+#include "ctranslate2/translation_cache.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+namespace ctranslate2 {
+
+  template <typename T>
+  static void append_value(std::string& key, const T& value) {
+    key.append(reinterpret_cast<const char*>(&value), sizeof (value));
+  }
+
+  static void append_tokens(std::string& key, const std::vector<std::string>& tokens) {
+    append_value(key, tokens.size());
+    for (const auto& token : tokens) {
+      append_value(key, token.size());
+      key.append(token);
+    }
+  }
+
+  static size_t estimate_memory_usage(const std::string& key, const TranslationResult& result) {
+    // The key is stored in the entry and in the index.
+    size_t memory_usage = 2 * (sizeof (std::string) + key.size());
+    for (const auto& hypothesis : result.hypotheses()) {
+      memory_usage += sizeof (hypothesis);
+      for (const auto& token : hypothesis)
+        memory_usage += sizeof (token) + token.size();
+    }
+    memory_usage += result.scores().size() * sizeof (float);
+    for (const auto& hypothesis_attention : result.attention()) {
+      for (const auto& step_attention : hypothesis_attention)
+        memory_usage += sizeof (step_attention) + step_attention.size() * sizeof (float);
+    }
+    return memory_usage;
+  }
+
+  TranslationCache::TranslationCache(size_t max_memory, size_t num_shards)
+    : _max_shard_memory(max_memory / std::max(num_shards, size_t(1))) {
+    if (num_shards == 0)
+      throw std::invalid_argument("The translation cache should have at least one shard");
+    _shards.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; ++i)
+      _shards.emplace_back(new Shard());
+  }
+
+  bool TranslationCache::is_cacheable(const TranslationOptions& options) {
+    return options.sampling_topk == 1 && !options.callback;
+  }
+
+  std::string TranslationCache::make_key(const models::Model& model,
+                                         const std::vector<std::string>& source,
+                                         const std::vector<std::string>* target_prefix,
+                                         const TranslationOptions& options) {
+    std::string key;
+    append_value(key, &model);
+    append_value(key, options.beam_size);
+    append_value(key, options.length_penalty);
+    append_value(key, options.coverage_penalty);
+    append_value(key, options.max_decoding_length);
+    append_value(key, options.min_decoding_length);
+    append_value(key, options.sampling_temperature);
+    append_value(key, options.use_vmap);
+    append_value(key, options.num_hypotheses);
+    append_value(key, options.return_scores);
+    append_value(key, options.return_attention);
+    append_value(key, options.return_alternatives);
+    append_value(key, options.replace_unknowns);
+    append_tokens(key, source);
+    if (target_prefix)
+      append_tokens(key, *target_prefix);
+    return key;
+  }
+
+  TranslationCache::Shard& TranslationCache::get_shard(const std::string& key) {
+    return *_shards[std::hash<std::string>()(key) % _shards.size()];
+  }
+
+  void TranslationCache::erase(Shard& shard, std::list<Entry>::iterator it) {
+    shard.memory_usage -= it->memory_usage;
+    shard.index.erase(it->key);
+    shard.entries.erase(it);
+  }
+
+  bool TranslationCache::get(const std::string& key,
+                             const std::shared_ptr<const models::Model>& model,
+                             std::vector<TranslationResult>& results) {
+    Shard& shard = get_shard(key);
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        auto entry = it->second;
+        if (entry->model.lock() == model) {
+          shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+          results.emplace_back(entry->result);
+          _num_hits += 1;
+          return true;
+        }
+        erase(shard, entry);
+      }
+    }
+    _num_misses += 1;
+    return false;
+  }
+
+  void TranslationCache::put(const std::string& key,
+                             const std::shared_ptr<const models::Model>& model,
+                             TranslationResult result) {
+    const size_t memory_usage = estimate_memory_usage(key, result);
+    if (memory_usage > _max_shard_memory)
+      return;
+
+    Shard& shard = get_shard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+      erase(shard, it->second);
+
+    shard.entries.emplace_front(Entry{key, model, std::move(result), memory_usage});
+    shard.index.emplace(key, shard.entries.begin());
+    shard.memory_usage += memory_usage;
+
+    while (shard.memory_usage > _max_shard_memory)
+      erase(shard, std::prev(shard.entries.end()));
+  }
+
+  void TranslationCache::clear() {
+    for (auto& shard : _shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      shard->entries.clear();
+      shard->index.clear();
+      shard->memory_usage = 0;
+    }
+  }
+
+  size_t TranslationCache::memory_usage() const {
+    size_t memory_usage = 0;
+    for (const auto& shard : _shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      memory_usage += shard->memory_usage;
+    }
+    return memory_usage;
+  }
+
+  size_t TranslationCache::num_hits() const {
+    return _num_hits;
+  }
+
+  size_t TranslationCache::num_misses() const {
+    return _num_misses;
+  }
+
+  float TranslationCache::hit_ratio() const {
+    const size_t num_hits = _num_hits;
+    const size_t num_lookups = num_hits + _num_misses;
+    if (num_lookups == 0)
+      return 0;
+    return static_cast<float>(num_hits) / static_cast<float>(num_lookups);
+  }
+
+}
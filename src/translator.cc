@@ -2,10 +2,12 @@
 
 #include <algorithm>
 #include <numeric>
+#include <set>
 
 #include "ctranslate2/decoding.h"
 #include "ctranslate2/ops/ops.h"
 #include "ctranslate2/profiler.h"
+#include "type_dispatch.h"
 
 namespace ctranslate2 {
 
@@ -44,6 +46,42 @@ namespace ctranslate2 {
       throw std::invalid_argument("Random sampling should be used with beam_size = 1");
     if (min_decoding_length > max_decoding_length)
       throw std::invalid_argument("min_decoding_length is greater than max_decoding_length");
+    if (target_length_ratio < 0)
+      throw std::invalid_argument("target_length_ratio must be >= 0");
+  }
+
+  DecodingCostModel
+  TranslationOptions::get_decoding_cost_model(float default_target_length_ratio) const {
+    DecodingCostModel cost_model;
+    cost_model.beam_size = beam_size;
+    cost_model.target_length_ratio = (target_length_ratio > 0
+                                      ? target_length_ratio
+                                      : default_target_length_ratio);
+    cost_model.max_target_length = max_decoding_length;
+    return cost_model;
+  }
+
+  bool TranslationOptions::can_deduplicate_examples() const {
+    return sampling_topk == 1 && !callback && !is_example_cancelled;
+  }
+
+  bool TranslationOptions::can_be_cancelled() const {
+    return (cancellation_token
+            || deadline != std::chrono::steady_clock::time_point::max());
+  }
+
+  bool TranslationOptions::should_stop() const {
+    return ((cancellation_token && cancellation_token->is_cancelled())
+            || (deadline != std::chrono::steady_clock::time_point::max()
+                && std::chrono::steady_clock::now() >= deadline));
+  }
+
+  void TranslationOptions::check_cancellation() const {
+    if (cancellation_token && cancellation_token->is_cancelled())
+      throw std::runtime_error("The translation was cancelled");
+    if (deadline != std::chrono::steady_clock::time_point::max()
+        && std::chrono::steady_clock::now() >= deadline)
+      throw std::runtime_error("The translation deadline is exceeded");
   }
 
 
@@ -58,7 +96,8 @@ namespace ctranslate2 {
     set_model(model);
   }
 
-  Translator::Translator(const Translator& other) {
+  Translator::Translator(const Translator& other)
+    : _encoder_cache(other.get_encoder_cache()) {
     if (other._model)
       set_model(other._model);
   }
@@ -85,6 +124,76 @@ namespace ctranslate2 {
     return translate_batch_with_prefix(batch_source, batch_target_prefix, options)[0];
   }
 
+  TranslationSession::TranslationSession() = default;
+  TranslationSession::~TranslationSession() = default;
+  TranslationSession::TranslationSession(TranslationSession&& other) = default;
+  TranslationSession& TranslationSession::operator=(TranslationSession&& other) = default;
+
+  void TranslationSession::clear() {
+    _model.reset();
+    _source.clear();
+    _prefix_state.reset();
+  }
+
+  TranslationResult
+  Translator::translate_with_session(const std::vector<std::string>& source,
+                                     const std::vector<std::string>& target_prefix,
+                                     const TranslationOptions& options,
+                                     TranslationSession& session) {
+    PROFILE("translate_with_session");
+    if (!options.validated)
+      options.validate();
+    options.check_cancellation();
+    assert_has_model();
+    if (source.empty())
+      return TranslationResult(options.num_hypotheses, options.return_attention);
+
+    auto scoped_device_setter = _model->get_scoped_device_setter();
+    const auto variables_guard = use_layers();
+    const std::vector<std::vector<std::string>> batch_source(1, source);
+    const std::vector<std::vector<std::string>> batch_target_prefix(1, target_prefix);
+    const auto& target_vocabulary = _seq2seq_model->get_target_vocabulary();
+    const size_t start_id = target_vocabulary.to_id(Vocabulary::bos_token);
+    const std::vector<size_t> prefix_ids = target_vocabulary.to_ids(batch_target_prefix)[0];
+
+    try {
+      // The previous state can be reused if the new prefix extends the previous one.
+      if (!session._prefix_state
+          || session._model.lock() != _model
+          || session._source != source
+          || !update_prefix_state(*_decoder, *session._prefix_state, start_id, prefix_ids)) {
+        session.clear();
+        std::unique_ptr<DecoderPrefixState> prefix_state(new DecoderPrefixState());
+        prefix_state->state = encode(batch_source);
+        update_prefix_state(*_decoder, *prefix_state, start_id, prefix_ids);
+        session._model = _model;
+        session._source = source;
+        session._prefix_state = std::move(prefix_state);
+      }
+    } catch (...) {
+      // The state may be partially updated.
+      session.clear();
+      throw;
+    }
+
+    // The decoding works on views of the session state which is kept for the next prefix.
+    // Operations updating the state (cache concatenation, beam expansion, gathers) allocate
+    // new storages for views, so the session state is not modified nor copied.
+    layers::DecoderState state;
+    for (auto& pair : session._prefix_state->state) {
+      StorageView view(pair.second.dtype(), pair.second.device());
+      if (!pair.second.empty())
+        view.shallow_copy(pair.second);
+      state.emplace(pair.first, std::move(view));
+    }
+    return run_batch_decoding(batch_source,
+                              batch_target_prefix,
+                              state,
+                              options,
+                              /*example_index=*/nullptr,
+                              session._prefix_state.get())[0];
+  }
+
   std::vector<TranslationResult>
   Translator::translate_batch(const std::vector<std::vector<std::string>>& batch_tokens) {
     TranslationOptions options;
@@ -104,6 +213,7 @@ namespace ctranslate2 {
                                           const TranslationOptions& options) {
     if (!options.validated)
       options.validate();
+    options.check_cancellation();
     if (!options.rebatch_input)
       return run_batch_translation(source, target_prefix, options);
 
@@ -111,9 +221,12 @@ namespace ctranslate2 {
     std::vector<TranslationResult> results(source.size(), empty_result);
 
     for (const auto& batch : rebatch_input(source, target_prefix, options)) {
-      auto batch_results = run_batch_translation(batch.source, batch.target, options);
-      for (size_t i = 0; i < batch_results.size(); ++i)
-        results[batch.example_index[i]] = std::move(batch_results[i]);
+      options.check_cancellation();
+      auto batch_results = run_batch_translation(batch.source,
+                                                 batch.target,
+                                                 options,
+                                                 &batch.example_index);
+      set_batch_results(batch, std::move(batch_results), results);
     }
 
     return results;
@@ -138,61 +251,107 @@ namespace ctranslate2 {
   std::vector<TranslationResult>
   Translator::run_batch_translation(const std::vector<std::vector<std::string>>& source,
                                     const std::vector<std::vector<std::string>>& target_prefix,
-                                    const TranslationOptions& options) {
+                                    const TranslationOptions& options,
+                                    const std::vector<size_t>* example_index) {
     PROFILE("run_batch_translation");
     assert_has_model();
     auto scoped_device_setter = _model->get_scoped_device_setter();
+    const auto variables_guard = use_layers();
 
-    const auto& source_vocabulary = _seq2seq_model->get_source_vocabulary();
-    const auto& target_vocabulary = _seq2seq_model->get_target_vocabulary();
-    const auto source_ids = source_vocabulary.to_ids(source,
-                                                     _seq2seq_model->with_source_bos(),
-                                                     _seq2seq_model->with_source_eos());
-    const auto target_prefix_ids = target_vocabulary.to_ids(target_prefix);
+    // Encode sequence.
+    layers::DecoderState state = encode(source);
+    return run_batch_decoding(source, target_prefix, state, options, example_index);
+  }
 
-    const Device device = _model->device();
-    const dim_t preferred_size_multiple = get_preferred_size_multiple(
-      _model->effective_compute_type(),
-      device,
-      _model->device_index());
-    std::pair<StorageView, StorageView> inputs = layers::make_sequence_inputs(
-      source_ids,
-      device,
-      preferred_size_multiple);
-    StorageView& ids = inputs.first;
-    StorageView& lengths = inputs.second;
+  std::vector<EncodedBatch>
+  Translator::encode_batch(const std::vector<std::vector<std::string>>& source,
+                           const std::vector<std::vector<std::string>>& target_prefix,
+                           const TranslationOptions& options) {
+    PROFILE("encode_batch");
+    if (!options.validated)
+      options.validate();
+    options.check_cancellation();
+    assert_has_model();
+    auto scoped_device_setter = _model->get_scoped_device_setter();
+    const auto variables_guard = use_layers();
+
+    std::vector<EncodedBatch> encoded_batches;
+    if (!options.rebatch_input) {
+      EncodedBatch encoded_batch;
+      encoded_batch.source = source;
+      encoded_batch.target = target_prefix;
+      encoded_batch.example_index.resize(source.size());
+      std::iota(encoded_batch.example_index.begin(), encoded_batch.example_index.end(), 0);
+      encoded_batches.emplace_back(std::move(encoded_batch));
+    } else {
+      for (auto& batch : rebatch_input(source, target_prefix, options)) {
+        EncodedBatch encoded_batch;
+        static_cast<Batch&>(encoded_batch) = std::move(batch);
+        encoded_batches.emplace_back(std::move(encoded_batch));
+      }
+    }
 
-    // Encode sequence.
-    StorageView encoded(_encoder->output_type(), device);
-    (*_encoder)(ids, lengths, encoded);
+    for (auto& encoded_batch : encoded_batches) {
+      options.check_cancellation();
+      encoded_batch.state = encode(encoded_batch.source);
+    }
+    return encoded_batches;
+  }
+
+  std::vector<TranslationResult>
+  Translator::decode_batch(EncodedBatch& batch, const TranslationOptions& options) {
+    PROFILE("decode_batch");
+    options.check_cancellation();
+    assert_has_model();
+    auto scoped_device_setter = _model->get_scoped_device_setter();
+    const auto variables_guard = use_layers();
+    return run_batch_decoding(batch.source,
+                              batch.target,
+                              batch.state,
+                              options,
+                              &batch.example_index);
+  }
+
+  std::vector<TranslationResult>
+  Translator::run_batch_decoding(const std::vector<std::vector<std::string>>& source,
+                                 const std::vector<std::vector<std::string>>& target_prefix,
+                                 layers::DecoderState& state,
+                                 const TranslationOptions& options,
+                                 const std::vector<size_t>* example_index,
+                                 const DecoderPrefixState* prefix_state) {
+    const auto& target_vocabulary = _seq2seq_model->get_target_vocabulary();
+    const auto target_prefix_ids = target_vocabulary.to_ids(target_prefix);
 
     // If set, extract the subset of candidates to generate.
-    const auto* vocabulary_map = _seq2seq_model->get_vocabulary_map();
-    std::vector<size_t> output_ids_map;
-    if (options.use_vmap && vocabulary_map) {
-      output_ids_map = vocabulary_map->get_candidates(source);
-    } else if (target_vocabulary.size() % preferred_size_multiple != 0) {
-      output_ids_map.resize(target_vocabulary.size());
-      std::iota(output_ids_map.begin(), output_ids_map.end(), size_t(0));
+    const std::vector<size_t> output_ids_map = update_vocabulary_mask(source, options);
+
+    // Cancelled examples are removed from the decoding batch.
+    std::function<bool(size_t)> is_cancelled;
+    if (options.can_be_cancelled() || options.is_example_cancelled) {
+      is_cancelled = [&options, example_index](size_t i) {
+        if (options.should_stop())
+          return true;
+        return (options.is_example_cancelled
+                && options.is_example_cancelled(example_index ? example_index->at(i) : i));
+      };
     }
 
-    if (!output_ids_map.empty()) {
-      // Pad vocabulary size to the preferred size multiple.
-      while (output_ids_map.size() % preferred_size_multiple != 0)
-        output_ids_map.push_back(0);
-
-      _decoder->set_vocabulary_mask(
-        StorageView({static_cast<dim_t>(output_ids_map.size())},
-                    std::vector<int32_t>(output_ids_map.begin(), output_ids_map.end()),
-                    device));
-    } else {
-      _decoder->reset_vocabulary_mask();
+    GenerationCallback callback;
+    if (options.callback) {
+      callback = [&options, &target_vocabulary, example_index](
+        const GenerationStepResult<size_t>& result) {
+        std::vector<std::string> tokens;
+        tokens.reserve(result.tokens.size());
+        for (const size_t id : result.tokens)
+          tokens.emplace_back(target_vocabulary.to_token(id));
+        options.callback({example_index ? example_index->at(result.batch_id) : result.batch_id,
+                          result.step,
+                          std::move(tokens),
+                          result.is_last});
+      };
     }
 
     // Decode.
-    layers::DecoderState state = _decoder->initial_state();
-    state.emplace(std::string("memory"), std::move(encoded));
-    state.emplace(std::string("memory_lengths"), std::move(lengths));
     const size_t start_id = target_vocabulary.to_id(Vocabulary::bos_token);
     const size_t end_id = target_vocabulary.to_id(Vocabulary::eos_token);
     const size_t batch_size = source.size();
@@ -211,7 +370,11 @@ namespace ctranslate2 {
       options.num_hypotheses,
       options.return_alternatives,
       options.return_scores,
-      options.return_attention || options.replace_unknowns);
+      options.return_attention || options.replace_unknowns,
+      is_cancelled ? &is_cancelled : nullptr,
+      callback ? &callback : nullptr,
+      prefix_state);
+    options.check_cancellation();
 
     // Convert generated ids to tokens.
     std::vector<TranslationResult> final_results;
@@ -249,6 +412,182 @@ namespace ctranslate2 {
     return final_results;
   }
 
+  size_t
+  Translator::estimate_memory_usage(const std::vector<std::vector<std::string>>& source,
+                                    const std::vector<std::vector<std::string>>& target_prefix,
+                                    const TranslationOptions& options) {
+    assert_has_model();
+    auto scoped_device_setter = _model->get_scoped_device_setter();
+    const auto variables_guard = use_layers();
+    const dim_t batch_size = source.size();
+    dim_t source_length = 0;
+    for (const auto& tokens : source)
+      source_length = std::max(source_length, dim_t(tokens.size()));
+    if (source_length == 0)
+      return 0;
+    source_length += (dim_t(_seq2seq_model->with_source_bos())
+                      + dim_t(_seq2seq_model->with_source_eos()));
+
+    dim_t max_length = options.max_decoding_length;
+    for (const auto& tokens : target_prefix)
+      max_length = std::max(max_length, dim_t(tokens.size()) + 1);
+    const dim_t num_hypotheses = std::max(options.beam_size, options.num_hypotheses);
+
+    const size_t encoder_memory = _encoder->estimate_memory_usage(source_length);
+    const size_t decoder_memory = _decoder->estimate_memory_usage(source_length, max_length);
+    // The encoder output is kept during the decoding.
+    const size_t encoder_output_memory = (encoder_memory > 0
+                                          ? source_length * _encoder->output_size()
+                                          * dtype_size(_encoder->output_type())
+                                          : 0);
+    return batch_size * std::max(encoder_memory,
+                                 encoder_output_memory + num_hypotheses * decoder_memory);
+  }
+
+  dim_t Translator::get_preferred_size_multiple() const {
+    return ctranslate2::get_preferred_size_multiple(_model->effective_compute_type(),
+                                                    _model->device(),
+                                                    _model->device_index());
+  }
+
+  layers::DecoderState
+  Translator::encode(const std::vector<std::vector<std::string>>& source) {
+    const auto& source_vocabulary = _seq2seq_model->get_source_vocabulary();
+    const auto source_ids = source_vocabulary.to_ids(source,
+                                                     _seq2seq_model->with_source_bos(),
+                                                     _seq2seq_model->with_source_eos());
+
+    const Device device = _model->device();
+    std::pair<StorageView, StorageView> inputs = layers::make_sequence_inputs(
+      source_ids,
+      device,
+      get_preferred_size_multiple());
+    StorageView& ids = inputs.first;
+    StorageView& lengths = inputs.second;
+
+    StorageView encoded(_encoder->output_type(), device);
+    // Examples are rarely empty as rebatch_input removes them: the cache is not used then.
+    const auto encoder_cache = get_encoder_cache();
+    const bool has_empty_example = std::any_of(source.begin(), source.end(),
+                                               [](const std::vector<std::string>& example) {
+                                                 return example.empty();
+                                               });
+    if (encoder_cache && !has_empty_example)
+      encode_with_cache(*encoder_cache, source_ids, ids, lengths, encoded);
+    else
+      (*_encoder)(ids, lengths, encoded);
+
+    layers::DecoderState state = _decoder->initial_state();
+    state.emplace(std::string("memory"), std::move(encoded));
+    state.emplace(std::string("memory_lengths"), std::move(lengths));
+    return state;
+  }
+
+  void Translator::encode_with_cache(EncoderCache& cache,
+                                     const std::vector<std::vector<size_t>>& source_ids,
+                                     const StorageView& ids,
+                                     const StorageView& lengths,
+                                     StorageView& encoded) {
+    const Device device = _model->device();
+    const DataType dtype = _encoder->output_type();
+    const size_t batch_size = source_ids.size();
+
+    // The cached outputs have shape [1, length, depth] without padding.
+    std::vector<StorageView> outputs(batch_size, StorageView(dtype, device));
+    std::vector<size_t> missing_index;
+    for (size_t b = 0; b < batch_size; ++b) {
+      if (!cache.get(_model, source_ids[b], outputs[b]))
+        missing_index.emplace_back(b);
+    }
+
+    if (!missing_index.empty()) {
+      const bool encode_batch = (missing_index.size() == batch_size);
+      StorageView missing_encoded(dtype, device);
+      if (encode_batch) {
+        (*_encoder)(ids, lengths, missing_encoded);
+      } else {
+        const auto inputs = layers::make_sequence_inputs(index_vector(source_ids, missing_index),
+                                                         device,
+                                                         get_preferred_size_multiple());
+        (*_encoder)(inputs.first, inputs.second, missing_encoded);
+      }
+
+      std::vector<StorageView> rows(missing_index.size(), StorageView(dtype, device));
+      std::vector<StorageView*> rows_ptr;
+      rows_ptr.reserve(rows.size());
+      for (auto& row : rows)
+        rows_ptr.emplace_back(&row);
+      ops::Split(0)(missing_encoded, rows_ptr);
+
+      for (size_t i = 0; i < missing_index.size(); ++i) {
+        const size_t b = missing_index[i];
+        const dim_t length = source_ids[b].size();
+        const dim_t padding_length = rows[i].dim(1) - length;
+        if (padding_length > 0) {
+          StorageView padding(dtype, device);
+          ops::Split(1, {length, padding_length})(rows[i], outputs[b], padding);
+        } else {
+          outputs[b] = std::move(rows[i]);
+        }
+        cache.put(_model, source_ids[b], outputs[b]);
+      }
+
+      if (encode_batch) {
+        encoded = std::move(missing_encoded);
+        return;
+      }
+    }
+
+    // Pad the outputs to the batch length and concatenate them.
+    const dim_t max_length = ids.dim(1);
+    const dim_t depth = outputs[0].dim(2);
+    std::vector<StorageView*> padded_outputs;
+    padded_outputs.reserve(batch_size);
+    for (auto& output : outputs) {
+      const dim_t padding_length = max_length - output.dim(1);
+      if (padding_length > 0) {
+        StorageView padding({1, padding_length, depth}, dtype, device);
+        TYPE_DISPATCH(dtype, padding.fill(T(0)));
+        StorageView padded_output(dtype, device);
+        ops::Concat(1)({&output, &padding}, padded_output);
+        output = std::move(padded_output);
+      }
+      padded_outputs.emplace_back(&output);
+    }
+    ops::Concat(0)(padded_outputs, encoded);
+  }
+
+  std::vector<size_t>
+  Translator::update_vocabulary_mask(const std::vector<std::vector<std::string>>& source,
+                                     const TranslationOptions& options) {
+    const auto& target_vocabulary = _seq2seq_model->get_target_vocabulary();
+    const auto* vocabulary_map = _seq2seq_model->get_vocabulary_map();
+    const dim_t preferred_size_multiple = get_preferred_size_multiple();
+
+    std::vector<size_t> output_ids_map;
+    if (options.use_vmap && vocabulary_map) {
+      output_ids_map = vocabulary_map->get_candidates(source);
+    } else if (target_vocabulary.size() % preferred_size_multiple != 0) {
+      output_ids_map.resize(target_vocabulary.size());
+      std::iota(output_ids_map.begin(), output_ids_map.end(), size_t(0));
+    }
+
+    if (!output_ids_map.empty()) {
+      // Pad vocabulary size to the preferred size multiple.
+      while (output_ids_map.size() % preferred_size_multiple != 0)
+        output_ids_map.push_back(0);
+
+      _decoder->set_vocabulary_mask(
+        StorageView({static_cast<dim_t>(output_ids_map.size())},
+                    std::vector<int32_t>(output_ids_map.begin(), output_ids_map.end()),
+                    _model->device()));
+    } else {
+      _decoder->reset_vocabulary_mask();
+    }
+
+    return output_ids_map;
+  }
+
   Device Translator::device() const {
     assert_has_model();
     return _model->device();
@@ -288,8 +627,29 @@ namespace ctranslate2 {
     _model = model;
     _seq2seq_model = seq2seq_model;
     auto scoped_device_setter = _model->get_scoped_device_setter();
-    _encoder = seq2seq_model->make_encoder();
-    _decoder = seq2seq_model->make_decoder();
+    if (_model->is_lazy()) {
+      _encoder.reset();
+      _decoder.reset();
+    } else {
+      build_layers();
+    }
+  }
+
+  void Translator::build_layers() {
+    auto scoped_device_setter = _model->get_scoped_device_setter();
+    _encoder = _seq2seq_model->make_encoder();
+    _decoder = _seq2seq_model->make_decoder();
+    _variables_generation = _model->variables_generation();
+  }
+
+  models::ModelVariablesGuard Translator::use_layers() {
+    assert_has_model();
+    // The guard is taken before checking the generation so that the variables can not be
+    // released between the check and the translation.
+    models::ModelVariablesGuard variables_guard(*_model);
+    if (!_encoder || !_decoder || _variables_generation != _model->variables_generation())
+      build_layers();
+    return variables_guard;
   }
 
   void Translator::detach_model() {
@@ -302,11 +662,212 @@ namespace ctranslate2 {
     _seq2seq_model = nullptr;
   }
 
+  const std::shared_ptr<const models::Model>& Translator::get_model() const {
+    return _model;
+  }
+
+  void Translator::set_encoder_cache(std::shared_ptr<EncoderCache> cache) {
+    std::atomic_store(&_encoder_cache, std::move(cache));
+  }
+
+  std::shared_ptr<EncoderCache> Translator::get_encoder_cache() const {
+    return std::atomic_load(&_encoder_cache);
+  }
+
   void Translator::assert_has_model() const {
     if (!_model)
       throw std::runtime_error("No model is attached to this translator");
   }
 
+  ContinuousBatchTranslator::ContinuousBatchTranslator(Translator& translator,
+                                                       const TranslationOptions& options)
+    : _translator(translator)
+    , _variables_guard(translator.use_layers())
+    , _options(options)
+    , _sampler(make_sampler(options)) {
+    if (!is_supported(options))
+      throw std::invalid_argument("These translation options can not be used with "
+                                  "continuous batching");
+    _translator.assert_has_model();
+    auto scoped_device_setter = _translator._model->get_scoped_device_setter();
+
+    const auto& target_vocabulary = _translator._seq2seq_model->get_target_vocabulary();
+    _start_id = target_vocabulary.to_id(Vocabulary::bos_token);
+    _end_id = target_vocabulary.to_id(Vocabulary::eos_token);
+
+    // The vocabulary mask does not depend on the source since the vocabulary map is not used.
+    _output_ids_map = _translator.update_vocabulary_mask({}, options);
+    _search.reset(new ContinuousGreedySearch(*_translator._decoder,
+                                             *_sampler,
+                                             _end_id,
+                                             !_output_ids_map.empty()
+                                             ? &_output_ids_map
+                                             : nullptr,
+                                             [this](const GenerationStepResult<size_t>& result) {
+                                               on_step_result(result);
+                                             }));
+  }
+
+  ContinuousBatchTranslator::~ContinuousBatchTranslator() {
+    if (_translator._model) {
+      // Release the decoder state on the model device.
+      auto scoped_device_setter = _translator._model->get_scoped_device_setter();
+      _search.reset();
+    }
+  }
+
+  bool ContinuousBatchTranslator::is_supported(const TranslationOptions& options) {
+    return (options.beam_size == 1
+            && options.num_hypotheses == 1
+            && !options.use_vmap
+            && !options.return_attention
+            && !options.return_alternatives
+            && !options.replace_unknowns);
+  }
+
+  bool ContinuousBatchTranslator::accept(const TranslationOptions& options) const {
+    // The sampler is shared by all running examples.
+    return (is_supported(options)
+            && options.sampling_topk == _options.sampling_topk
+            && options.sampling_temperature == _options.sampling_temperature);
+  }
+
+  void ContinuousBatchTranslator::add(size_t batch_id,
+                                      const std::vector<std::vector<std::string>>& source,
+                                      const TranslationOptions& options) {
+    PROFILE("ContinuousBatchTranslator::add");
+    if (!accept(options))
+      throw std::invalid_argument("These translation options are not compatible with the "
+                                  "running batches");
+    if (!options.validated)
+      options.validate();
+    options.check_cancellation();
+    if (_batches.count(batch_id) != 0)
+      throw std::invalid_argument("Batch " + std::to_string(batch_id) + " is already running");
+
+    auto scoped_device_setter = _translator._model->get_scoped_device_setter();
+
+    RunningBatch batch;
+    batch.results.assign(source.size(), TranslationResult(options.num_hypotheses,
+                                                          options.return_attention));
+    batch.num_running_examples = 0;
+    batch.callback = options.callback;
+
+    // Empty examples are not translated.
+    std::vector<std::vector<std::string>> batch_source;
+    std::vector<size_t> example_ids;
+    batch_source.reserve(source.size());
+    example_ids.reserve(source.size());
+    for (size_t i = 0; i < source.size(); ++i) {
+      if (source[i].empty())
+        continue;
+      batch_source.emplace_back(source[i]);
+      example_ids.emplace_back(_next_example_id + i);
+    }
+
+    if (batch_source.empty()) {
+      _finished_batches.emplace_back(batch_id, std::move(batch.results));
+      return;
+    }
+
+    layers::DecoderState state = _translator.encode(batch_source);
+
+    // The examples are registered before the first decoding step which reports the first
+    // generated tokens.
+    for (const size_t example_id : example_ids) {
+      _examples.emplace(example_id, std::make_pair(batch_id, example_id - _next_example_id));
+      batch.num_running_examples += 1;
+    }
+    _next_example_id += source.size();
+    _batches.emplace(batch_id, std::move(batch));
+
+    try {
+      _search->add(std::move(state),
+                   example_ids,
+                   std::vector<size_t>(example_ids.size(), _start_id),
+                   options.max_decoding_length,
+                   options.min_decoding_length,
+                   options.return_scores);
+    } catch (...) {
+      for (const size_t example_id : example_ids)
+        _examples.erase(example_id);
+      _batches.erase(batch_id);
+      throw;
+    }
+
+    collect_finished_examples();
+  }
+
+  void ContinuousBatchTranslator::step() {
+    auto scoped_device_setter = _translator._model->get_scoped_device_setter();
+    _search->step();
+    collect_finished_examples();
+  }
+
+  size_t ContinuousBatchTranslator::num_examples() const {
+    return _search->num_sequences();
+  }
+
+  std::vector<std::pair<size_t, std::vector<TranslationResult>>>
+  ContinuousBatchTranslator::get_finished_batches() {
+    auto finished_batches = std::move(_finished_batches);
+    _finished_batches.clear();
+    return finished_batches;
+  }
+
+  void ContinuousBatchTranslator::cancel(size_t batch_id) {
+    auto batch_it = _batches.find(batch_id);
+    if (batch_it == _batches.end())
+      return;
+    _batches.erase(batch_it);
+
+    auto scoped_device_setter = _translator._model->get_scoped_device_setter();
+    _search->remove([this, batch_id](size_t example_id) {
+      auto it = _examples.find(example_id);
+      if (it == _examples.end() || it->second.first != batch_id)
+        return false;
+      _examples.erase(it);
+      return true;
+    });
+  }
+
+  void ContinuousBatchTranslator::on_step_result(const GenerationStepResult<size_t>& result) {
+    const auto& position = _examples.at(result.batch_id);
+    const RunningBatch& batch = _batches.at(position.first);
+    if (!batch.callback)
+      return;
+    const auto& target_vocabulary = _translator._seq2seq_model->get_target_vocabulary();
+    std::vector<std::string> tokens;
+    tokens.reserve(result.tokens.size());
+    for (const size_t id : result.tokens)
+      tokens.emplace_back(target_vocabulary.to_token(id));
+    batch.callback({position.second, result.step, std::move(tokens), result.is_last});
+  }
+
+  void ContinuousBatchTranslator::collect_finished_examples() {
+    const auto& target_vocabulary = _translator._seq2seq_model->get_target_vocabulary();
+
+    for (auto& finished : _search->get_finished()) {
+      auto example_it = _examples.find(finished.first);
+      const size_t batch_id = example_it->second.first;
+      const size_t index = example_it->second.second;
+      _examples.erase(example_it);
+
+      GenerationResult<size_t>& result = finished.second;
+      auto batch_it = _batches.find(batch_id);
+      RunningBatch& batch = batch_it->second;
+      batch.results[index] = TranslationResult(target_vocabulary.to_tokens(result.hypotheses()),
+                                               result.scores(),
+                                               result.attention());
+
+      batch.num_running_examples -= 1;
+      if (batch.num_running_examples == 0) {
+        _finished_batches.emplace_back(batch_id, std::move(batch.results));
+        _batches.erase(batch_it);
+      }
+    }
+  }
+
   std::vector<Batch>
   rebatch_input(const std::vector<std::vector<std::string>>& source,
                 const std::vector<std::vector<std::string>>& target_prefix,
@@ -317,14 +878,21 @@ namespace ctranslate2 {
       max_batch_size = 1;  // Disable batching in return_alternatives mode.
       batch_type = BatchType::Examples;
     }
-    return rebatch_input(source, target_prefix, max_batch_size, batch_type);
+    return rebatch_input(source,
+                         target_prefix,
+                         max_batch_size,
+                         batch_type,
+                         options.get_decoding_cost_model(),
+                         options.can_deduplicate_examples());
   }
 
   std::vector<Batch>
   rebatch_input(const std::vector<std::vector<std::string>>& source,
                 const std::vector<std::vector<std::string>>& target,
                 size_t max_batch_size,
-                BatchType batch_type) {
+                BatchType batch_type,
+                const DecodingCostModel& cost_model,
+                bool deduplicate) {
     if (!target.empty() && target.size() != source.size())
       throw std::invalid_argument("Batch size mismatch: got "
                                   + std::to_string(source.size()) + " for source and "
@@ -343,8 +911,33 @@ namespace ctranslate2 {
     // 2. Decoding functions remove finished translations from the batch. On CPU, arrays are
     //    updated in place so it is more efficient to remove content at the end. Shorter sentences
     //    are more likely to finish first so we sort the batch accordingly.
-    std::vector<size_t> example_index(global_batch_size);
-    std::iota(example_index.begin(), example_index.end(), 0);
+    std::vector<size_t> example_index;
+    // Pairs (index of the duplicated example, index of the translated example).
+    std::vector<std::pair<size_t, size_t>> duplicates;
+    if (deduplicate) {
+      const auto compare = [&source, &target](size_t i1, size_t i2) {
+        if (source[i1] != source[i2])
+          return source[i1] < source[i2];
+        return !target.empty() && target[i1] < target[i2];
+      };
+      std::set<size_t, decltype(compare)> unique_examples(compare);
+      example_index.reserve(global_batch_size);
+      for (size_t i = 0; i < global_batch_size; ++i) {
+        if (source[i].empty()) {
+          example_index.emplace_back(i);
+          continue;
+        }
+        const auto inserted = unique_examples.emplace(i);
+        if (inserted.second)
+          example_index.emplace_back(i);
+        else
+          duplicates.emplace_back(i, *inserted.first);
+      }
+    } else {
+      example_index.resize(global_batch_size);
+      std::iota(example_index.begin(), example_index.end(), 0);
+    }
+
     std::sort(example_index.begin(), example_index.end(),
               [&source](size_t i1, size_t i2) {
                 return source[i1].size() > source[i2].size();
@@ -367,7 +960,7 @@ namespace ctranslate2 {
       batch_reader.add(new VectorReader(index_vector(target, example_index)));
 
     for (size_t offset = 0;;) {
-      auto batch_tokens = batch_reader.get_next(max_batch_size, batch_type);
+      auto batch_tokens = batch_reader.get_next(max_batch_size, batch_type, cost_model);
       if (batch_tokens[0].empty())
         break;
 
@@ -385,7 +978,29 @@ namespace ctranslate2 {
       batches.emplace_back(std::move(batch));
     }
 
+    if (!duplicates.empty()) {
+      // Position of each translated example: (batch index, index in the batch).
+      std::vector<std::pair<size_t, size_t>> position(global_batch_size);
+      for (size_t b = 0; b < batches.size(); ++b) {
+        for (size_t i = 0; i < batches[b].example_index.size(); ++i)
+          position[batches[b].example_index[i]] = std::make_pair(b, i);
+      }
+      for (const auto& duplicate : duplicates) {
+        const auto& translated = position[duplicate.second];
+        batches[translated.first].duplicates.emplace_back(translated.second, duplicate.first);
+      }
+    }
+
     return batches;
   }
 
+  void set_batch_results(const Batch& batch,
+                         std::vector<TranslationResult> batch_results,
+                         std::vector<TranslationResult>& results) {
+    for (const auto& duplicate : batch.duplicates)
+      results[duplicate.second] = batch_results[duplicate.first];
+    for (size_t i = 0; i < batch_results.size(); ++i)
+      results[batch.example_index[i]] = std::move(batch_results[i]);
+  }
+
 }
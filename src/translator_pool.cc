@@ -1,23 +1,62 @@
 #include "ctranslate2/translator_pool.h"
 
+#include <algorithm>
+#include <unordered_set>
+
 #include "ctranslate2/utils.h"
 
+#include "cpu/cpu_info.h"
+
 namespace ctranslate2 {
 
   TranslatorPool::TranslatorPool(size_t num_translators,
                                  size_t num_threads_per_translator,
                                  const std::shared_ptr<const models::Model>& model) {
-    create_translators(model, num_translators, num_threads_per_translator);
+    create_translators(model, num_translators, num_threads_per_translator, model->device());
+  }
+
+  TranslatorPool::TranslatorPool(size_t num_translators,
+                                 size_t num_threads_per_translator,
+                                 size_t max_models_memory,
+                                 Device device,
+                                 int device_index,
+                                 ComputeType compute_type)
+    : _multi_model(true)
+    , _max_models_memory(max_models_memory)
+    , _device(device)
+    , _device_index(device_index)
+    , _compute_type(compute_type) {
+    create_translators(nullptr, num_translators, num_threads_per_translator, device);
+  }
+
+  // Returns the exception failing the jobs that are not run when the pool is destroyed.
+  static std::exception_ptr make_shutdown_exception() {
+    return std::make_exception_ptr(std::runtime_error("The translator pool is shutting down"));
   }
 
   TranslatorPool::~TranslatorPool() {
-    {
-      std::lock_guard<std::mutex> lock(_mutex);
-      _request_end = true;
-    }
-    _cv.notify_all();  // Request all workers to end their loop.
+    _request_end = true;
+    notify_all_workers();  // Request all workers to end their loop.
+    { std::lock_guard<std::mutex> lock(_encoded_jobs_mutex); }
+    _can_encode_more_jobs.notify_all();
     for (auto& worker : _workers)
       worker.join();
+
+    // Fail the jobs that were not run.
+    for (auto& queue : _queues) {
+      for (auto& job : queue->jobs.pop_if([](const Job&) { return true; }))
+        job->fail(make_shutdown_exception());
+    }
+    while (!_encoded_jobs.empty()) {
+      auto& merged = _encoded_jobs.front();
+      {
+        auto scoped_device_setter = merged->model->get_scoped_device_setter();
+        merged->encoded_batches.clear();
+      }
+      for (auto& job : merged->jobs)
+        job->fail(make_shutdown_exception());
+      _encoded_jobs.pop();
+    }
   }
 
   std::future<std::vector<TranslationResult>>
@@ -33,6 +72,28 @@ namespace ctranslate2 {
     return post(std::move(source), std::move(target_prefix), std::move(options));
   }
 
+  std::future<std::vector<TranslationResult>>
+  TranslatorPool::translate_batch_async(const std::string& model_id,
+                                        std::vector<std::vector<std::string>> source,
+                                        TranslationOptions options) {
+    return translate_batch_async(model_id,
+                                 std::move(source),
+                                 std::vector<std::vector<std::string>>(),
+                                 std::move(options));
+  }
+
+  std::future<std::vector<TranslationResult>>
+  TranslatorPool::translate_batch_async(const std::string& model_id,
+                                        std::vector<std::vector<std::string>> source,
+                                        std::vector<std::vector<std::string>> target_prefix,
+                                        TranslationOptions options) {
+    return post_translation(get_model(model_id),
+                            std::move(source),
+                            std::move(target_prefix),
+                            std::move(options),
+                            /*throttle=*/false);
+  }
+
   std::future<std::vector<TranslationResult>>
   TranslatorPool::post(std::vector<std::vector<std::string>> source,
                        TranslationOptions options,
@@ -48,25 +109,148 @@ namespace ctranslate2 {
                        std::vector<std::vector<std::string>> target_prefix,
                        TranslationOptions options,
                        bool throttle) {
-    auto* job = new TranslationJob(std::move(source),
-                                   std::move(target_prefix),
-                                   std::move(options));
+    return post_translation(get_model(),
+                            std::move(source),
+                            std::move(target_prefix),
+                            std::move(options),
+                            throttle);
+  }
+
+  std::future<std::vector<TranslationResult>>
+  TranslatorPool::post_translation(std::shared_ptr<const models::Model> model,
+                                   std::vector<std::vector<std::string>> source,
+                                   std::vector<std::vector<std::string>> target_prefix,
+                                   TranslationOptions options,
+                                   bool throttle) {
+    auto cache = std::atomic_load(&_translation_cache);
+    if (!cache || !model || !TranslationCache::is_cacheable(options)) {
+      auto* job = new TranslationJob(std::move(source),
+                                     std::move(target_prefix),
+                                     std::move(options),
+                                     std::move(model));
+      auto future = job->get_future();
+      post_job(std::unique_ptr<Job>(job), throttle);
+      return future;
+    }
+
+    // Lookup the examples in the cache and only translate the missing examples.
+    const size_t batch_size = source.size();
+    std::vector<std::string> keys;
+    std::vector<TranslationResult> cached_results;
+    std::vector<size_t> cached_index;
+    std::vector<std::vector<std::string>> missing_source;
+    std::vector<std::vector<std::string>> missing_target_prefix;
+    for (size_t i = 0; i < batch_size; ++i) {
+      const auto* example_prefix = target_prefix.empty() ? nullptr : &target_prefix[i];
+      auto key = TranslationCache::make_key(*model, source[i], example_prefix, options);
+      if (!source[i].empty() && cache->get(key, model, cached_results)) {
+        cached_index.emplace_back(i);
+        continue;
+      }
+      keys.emplace_back(std::move(key));
+      missing_source.emplace_back(std::move(source[i]));
+      if (example_prefix)
+        missing_target_prefix.emplace_back(std::move(target_prefix[i]));
+    }
+
+    if (missing_source.empty()) {
+      std::promise<std::vector<TranslationResult>> promise;
+      promise.set_value(std::move(cached_results));
+      return promise.get_future();
+    }
+
+    auto* job = new TranslationJob(std::move(missing_source),
+                                   std::move(missing_target_prefix),
+                                   std::move(options),
+                                   std::move(model));
+    job->set_cache(std::move(cache),
+                   std::move(keys),
+                   std::move(cached_results),
+                   std::move(cached_index));
     auto future = job->get_future();
     post_job(std::unique_ptr<Job>(job), throttle);
     return future;
   }
 
   void TranslatorPool::post_job(std::unique_ptr<Job> job, bool throttle) {
-    std::unique_lock<std::mutex> lock(_mutex);
-    if (throttle)
-      _can_add_more_work.wait(lock, [this]{ return _work.size() < 2 * _workers.size(); });
+    if (throttle) {
+      _num_throttled_posts += 1;
+      std::unique_lock<std::mutex> lock(_mutex);
+      _can_add_more_work.wait(lock, [this]{ return _num_queued_jobs < 2 * _workers.size(); });
+      _num_throttled_posts -= 1;
+    }
+
+    const size_t index = select_queue(*job);
+    WorkerQueue& queue = *_queues[index];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.emplace(std::move(job));
+      queue.notified = true;
+      _num_queued_jobs += 1;
+    }
+    queue.cv.notify_one();
+
+    // If the translator owning this queue is busy, an idle translator can steal the job.
+    if (!queue.idle)
+      notify_idle_worker(index);
+  }
+
+  size_t TranslatorPool::num_job_queues() const {
+    // With pipelined translation, the jobs are posted to the encoding translators.
+    const size_t num_encoders = _num_encoders;
+    return num_encoders > 0 ? num_encoders : _queues.size();
+  }
+
+  size_t TranslatorPool::select_queue(const Job& job) {
+    const size_t num_queues = num_job_queues();
+
+    // The jobs that can be merged are posted to the same queue.
+    if (can_merge(job))
+      return merge_hash(static_cast<const TranslationJob&>(job)) % num_queues;
 
-    // locked again here
+    const size_t offset = _next_queue++;
+    for (size_t i = 0; i < num_queues; ++i) {
+      const size_t index = (offset + i) % num_queues;
+      if (_queues[index]->idle)
+        return index;
+    }
+    return offset % num_queues;
+  }
+
+  void TranslatorPool::notify_idle_worker(size_t index) {
+    const size_t num_queues = num_job_queues();
+    for (size_t i = 1; i < num_queues; ++i) {
+      WorkerQueue& queue = *_queues[(index + i) % num_queues];
+      if (queue.idle) {
+        {
+          std::lock_guard<std::mutex> lock(queue.mutex);
+          queue.notified = true;
+        }
+        queue.cv.notify_one();
+        return;
+      }
+    }
+  }
 
-    _work.emplace(std::move(job));
+  void TranslatorPool::notify_all_workers() {
+    for (auto& queue : _queues) {
+      {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->notified = true;
+      }
+      queue->cv.notify_all();
+    }
+  }
 
-    lock.unlock();
-    _cv.notify_one();
+  void TranslatorPool::on_jobs_removed(size_t num_jobs) {
+    if (num_jobs == 0)
+      return;
+    _num_queued_jobs -= num_jobs;
+    if (_num_throttled_posts > 0) {
+      // Lock the mutex so that the notification is not lost by a post checking the condition.
+      { std::lock_guard<std::mutex> lock(_mutex); }
+      _can_add_more_work.notify_all();
+    }
   }
 
   std::vector<TranslationResult>
@@ -78,7 +262,31 @@ namespace ctranslate2 {
   std::vector<TranslationResult>
   TranslatorPool::translate_batch(const std::vector<std::vector<std::string>>& source,
                                   const std::vector<std::vector<std::string>>& target_prefix,
-                                  const TranslationOptions& user_options) {
+                                  const TranslationOptions& options) {
+    return translate_batch_with_model(get_model(), source, target_prefix, options);
+  }
+
+  std::vector<TranslationResult>
+  TranslatorPool::translate_batch(const std::string& model_id,
+                                  const std::vector<std::vector<std::string>>& source,
+                                  const TranslationOptions& options) {
+    return translate_batch(model_id, source, std::vector<std::vector<std::string>>(), options);
+  }
+
+  std::vector<TranslationResult>
+  TranslatorPool::translate_batch(const std::string& model_id,
+                                  const std::vector<std::vector<std::string>>& source,
+                                  const std::vector<std::vector<std::string>>& target_prefix,
+                                  const TranslationOptions& options) {
+    return translate_batch_with_model(get_model(model_id), source, target_prefix, options);
+  }
+
+  std::vector<TranslationResult>
+  TranslatorPool::translate_batch_with_model(
+    const std::shared_ptr<const models::Model>& model,
+    const std::vector<std::vector<std::string>>& source,
+    const std::vector<std::vector<std::string>>& target_prefix,
+    const TranslationOptions& user_options) {
     TranslationOptions options = user_options;
     options.validate();
     options.validated = true;
@@ -87,15 +295,32 @@ namespace ctranslate2 {
       return std::vector<TranslationResult>();
 
     // Rebatch the input and post each sub-batch in the translation queue.
+    if (options.batch_type == BatchType::DecodingCost && options.target_length_ratio == 0)
+      options.target_length_ratio = estimated_target_length_ratio();
     auto batches = rebatch_input(source, target_prefix, options);
     options.rebatch_input = false;
 
     std::vector<std::future<std::vector<TranslationResult>>> futures;
     futures.reserve(batches.size());
     for (auto& batch : batches) {
-      futures.emplace_back(post(std::move(batch.source),
-                                std::move(batch.target),
-                                options));
+      TranslationOptions batch_options = options;
+      if (options.callback) {
+        // Report the index of the example in the input batch.
+        const auto& callback = options.callback;
+        const auto& example_index = batch.example_index;
+        batch_options.callback = [callback, example_index](const TranslationStepResult& result) {
+          callback({example_index[result.batch_id],
+                    result.step,
+                    result.tokens,
+                    result.is_last});
+        };
+      }
+
+      futures.emplace_back(post_translation(model,
+                                            std::move(batch.source),
+                                            std::move(batch.target),
+                                            std::move(batch_options),
+                                            /*throttle=*/false));
     }
 
     const TranslationResult empty_result(options.num_hypotheses, options.return_attention);
@@ -103,18 +328,244 @@ namespace ctranslate2 {
 
     // Wait for the result of each sub-batch.
     for (size_t batch_id = 0; batch_id < batches.size(); ++batch_id) {
-      auto batch_results = futures[batch_id].get();
-      for (size_t i = 0; i < batch_results.size(); ++i)
-        results[batches[batch_id].example_index[i]] = std::move(batch_results[i]);
+      set_batch_results(batches[batch_id], futures[batch_id].get(), results);
     }
 
     return results;
   }
 
+  void TranslatorPool::replace_model(std::shared_ptr<const models::Model> model) {
+    if (_multi_model)
+      throw std::invalid_argument("The models of a pool translating with multiple models can't "
+                                  "be replaced");
+    if (model && !dynamic_cast<const models::SequenceToSequenceModel*>(model.get()))
+      throw std::invalid_argument("TranslatorPool expects a model of type "
+                                  "SequenceToSequenceModel");
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _model = std::move(model);
+    }
+
+    notify_all_workers();  // Wake up the workers so that they detach the previous model.
+  }
+
+  void TranslatorPool::set_idle_model_timeout(std::chrono::milliseconds timeout) {
+    _idle_model_timeout_ms = timeout.count();
+    notify_all_workers();  // Wake up the workers so that they schedule the next unloading.
+  }
+
+  std::shared_ptr<const models::Model> TranslatorPool::get_model() {
+    if (_multi_model)
+      throw std::invalid_argument("This pool translates with multiple models: the model id "
+                                  "should be set");
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_model)
+      throw std::runtime_error("No model is attached to this pool");
+    _model_last_use = std::chrono::steady_clock::now();
+    return _model;
+  }
+
+  std::shared_ptr<const models::Model>
+  TranslatorPool::get_model(const std::string& model_id) {
+    if (!_multi_model)
+      throw std::invalid_argument("This pool translates with a single model: the model id "
+                                  "should not be set");
+
+    bool removed_models = false;
+    const auto find_model = [this, &model_id, &removed_models]()
+      -> std::shared_ptr<const models::Model> {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (auto it = _models.begin(); it != _models.end(); ++it) {
+        if (it->id == model_id) {
+          _models.splice(_models.begin(), _models, it);  // Mark as most recently used.
+          it->last_use = std::chrono::steady_clock::now();
+          if (!it->loaded) {
+            // The variables of the lazy model will be materialized again by the next jobs.
+            it->loaded = true;
+            it->memory_usage = it->model->get_full_memory_usage();
+            _models_memory_usage += it->memory_usage;
+            removed_models = evict_models();
+          }
+          return it->model;
+        }
+      }
+      return nullptr;
+    };
+
+    auto model = find_model();
+    if (!model) {
+      std::lock_guard<std::mutex> loading_lock(_models_loading_mutex);
+      model = find_model();  // The model could be loaded by another thread in the meantime.
+      if (!model)
+        model = load_model(model_id);
+    }
+
+    if (removed_models)
+      notify_all_workers();  // Wake up the workers so that they detach the evicted models.
+    return model;
+  }
+
+  std::shared_ptr<const models::Model>
+  TranslatorPool::load_model(const std::string& model_id) {
+    const auto model = models::Model::load(model_id, _device, _device_index, _compute_type);
+    if (!dynamic_cast<const models::SequenceToSequenceModel*>(model.get()))
+      throw std::invalid_argument("Model " + model_id + " is not a sequence to sequence model");
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      // Lazy models are charged with the memory used when all variables are materialized.
+      const size_t memory_usage = model->get_full_memory_usage();
+      _models.emplace_front(LoadedModel{model_id,
+                                        model,
+                                        memory_usage,
+                                        std::chrono::steady_clock::now(),
+                                        /*loaded=*/true});
+      _models_memory_usage += memory_usage;
+      evict_models();
+    }
+
+    notify_all_workers();  // Wake up the workers so that they detach the evicted models.
+    return model;
+  }
+
+  bool TranslatorPool::evict_models() {
+    if (_max_models_memory == 0 || _models.size() < 2)
+      return false;
+
+    // Evict the least recently used models, except the most recently used one. The memory is
+    // released when the running jobs are finished and the translators detached the evicted
+    // models. Lazy models remain registered and only release their variables, now if they are
+    // not used or later by an idle worker (see unload_idle_models).
+    bool removed_models = false;
+    auto it = std::prev(_models.end());
+    while (it != _models.begin() && _models_memory_usage > _max_models_memory) {
+      const auto previous = std::prev(it);
+      if (it->loaded) {
+        _models_memory_usage -= it->memory_usage;
+        if (it->model->is_lazy()) {
+          it->loaded = false;
+          it->memory_usage = 0;
+          it->model->unload_variables();
+        } else {
+          _models.erase(it);
+          removed_models = true;
+        }
+      }
+      it = previous;
+    }
+    return removed_models;
+  }
+
+  void TranslatorPool::unload_idle_models(std::chrono::steady_clock::time_point& next_wakeup) {
+    const std::chrono::milliseconds timeout(_idle_model_timeout_ms);
+    const auto now = std::chrono::steady_clock::now();
+
+    // Returns true if the model was idle and its variables were released.
+    const auto unload_if_idle = [&timeout, &now, &next_wakeup](
+      const std::shared_ptr<const models::Model>& model,
+      std::chrono::steady_clock::time_point& last_use) {
+      if (timeout.count() <= 0 || !model || !model->is_lazy())
+        return false;
+      if (now < last_use + timeout) {
+        next_wakeup = std::min(next_wakeup, last_use + timeout);
+        return false;
+      }
+      if (model->unload_variables())
+        return true;
+      // The model is used by a running job.
+      last_use = now;
+      next_wakeup = std::min(next_wakeup, last_use + timeout);
+      return false;
+    };
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_multi_model) {
+      unload_if_idle(_model, _model_last_use);
+      return;
+    }
+
+    for (auto& loaded_model : _models) {
+      if (!loaded_model.loaded) {
+        // The model was evicted while it was used by a running job.
+        loaded_model.model->unload_variables();
+      } else if (unload_if_idle(loaded_model.model, loaded_model.last_use)) {
+        _models_memory_usage -= loaded_model.memory_usage;
+        loaded_model.memory_usage = 0;
+        loaded_model.loaded = false;
+      }
+    }
+  }
+
+  bool TranslatorPool::is_outdated(const std::shared_ptr<const models::Model>& model) {
+    if (!model)
+      return false;
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_multi_model)
+      return model != _model;
+    for (const auto& loaded_model : _models) {
+      if (loaded_model.model == model)
+        return false;
+    }
+    return true;
+  }
+
+  // Returns the CPU cores to which each translator should be pinned, or an empty vector if
+  // the translators should not be pinned.
+  static std::vector<std::vector<int>>
+  get_translators_cores(size_t num_translators, size_t num_threads_per_translator) {
+    static const int core_offset = read_int_from_env("CT2_TRANSLATORS_CORE_OFFSET", -1);
+    static const bool numa_placement = read_bool_from_env("CT2_TRANSLATORS_NUMA_PLACEMENT");
+    if (core_offset < 0 && !numa_placement)
+      return {};
+
+#ifndef __linux__
+    throw std::invalid_argument("Pinning translators to CPU cores is only supported on Linux");
+#endif
+    if (core_offset >= 0 && numa_placement)
+      throw std::invalid_argument("CT2_TRANSLATORS_CORE_OFFSET and "
+                                  "CT2_TRANSLATORS_NUMA_PLACEMENT can not be used together");
+
+    // Each translator is pinned to a contiguous set of cores, one per computation thread.
+    const size_t num_cores_per_translator = std::max(num_threads_per_translator, size_t(1));
+    std::vector<std::vector<int>> translators_cores(num_translators);
+
+    if (core_offset >= 0) {
+      for (size_t i = 0; i < num_translators; ++i) {
+        for (size_t j = 0; j < num_cores_per_translator; ++j)
+          translators_cores[i].push_back(core_offset + i * num_cores_per_translator + j);
+      }
+      return translators_cores;
+    }
+
+    // Distribute the translators on the NUMA nodes in a round-robin fashion, so that the
+    // computation threads of a translator and its memory are on the same node.
+    const auto& nodes = cpu::cpu_numa_nodes();
+    std::vector<size_t> nodes_offset(nodes.size(), 0);
+    for (size_t i = 0; i < num_translators; ++i) {
+      const size_t node = i % nodes.size();
+      const auto& node_cores = nodes[node];
+      size_t& offset = nodes_offset[node];
+      if (offset + num_cores_per_translator > node_cores.size())
+        throw std::invalid_argument("The NUMA node " + std::to_string(node)
+                                    + " does not have enough cores to pin "
+                                    + std::to_string(num_translators) + " translators with "
+                                    + std::to_string(num_cores_per_translator)
+                                    + " threads each");
+      translators_cores[i].assign(node_cores.begin() + offset,
+                                  node_cores.begin() + offset + num_cores_per_translator);
+      offset += num_cores_per_translator;
+    }
+
+    return translators_cores;
+  }
+
   void TranslatorPool::create_translators(const std::shared_ptr<const models::Model>& model,
                                           size_t num_translators,
-                                          size_t num_threads_per_translator) {
-    if (model->device() == Device::CUDA) {
+                                          size_t num_threads_per_translator,
+                                          Device device) {
+    _model = model;
+    if (device == Device::CUDA) {
       // On GPU, we currently don't benefit much from running translators in parallel, even
       // when using separate streams. This could be revisited/improved in the future.
       num_translators = 1;
@@ -122,33 +573,43 @@ namespace ctranslate2 {
       num_threads_per_translator = 1;
     }
 
-    static const int core_offset = read_int_from_env("CT2_TRANSLATORS_CORE_OFFSET", -1);
-    if (core_offset >= 0) {
-#ifdef __linux__
-      if (num_threads_per_translator > 1) {
-        throw std::invalid_argument("Pinning translators to CPU cores requires intra_threads = 1");
-      }
-#else
-      throw std::invalid_argument("Pinning translators to CPU cores is only supported on Linux");
-#endif
-    }
+    const auto translators_cores = get_translators_cores(num_translators,
+                                                         num_threads_per_translator);
+
+    _queues.reserve(num_translators);
+    for (size_t i = 0; i < num_translators; ++i)
+      _queues.emplace_back(new WorkerQueue());
 
     _translators.reserve(num_translators);
     _workers.reserve(num_translators);
     for (size_t i = 0; i < num_translators; ++i) {
-      _translators.emplace_back(model);
+      if (model)
+        _translators.emplace_back(model);
+      else
+        _translators.emplace_back();
       _workers.emplace_back(&TranslatorPool::work_loop,
                             this,
-                            std::ref(_translators.back()),
+                            i,
                             num_threads_per_translator);
 #ifdef __linux__
-      if (core_offset >= 0) {
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(core_offset + i, &cpuset);
+      if (!translators_cores.empty()) {
+        // The OpenMP threads created by the worker inherit its affinity, and the memory it
+        // allocates is first touched on the NUMA node of these cores.
+        // The CPU set is allocated dynamically since the core ids can be larger than
+        // CPU_SETSIZE.
+        const std::vector<int>& cores = translators_cores[i];
+        const size_t num_cores = *std::max_element(cores.begin(), cores.end()) + 1;
+        cpu_set_t* cpuset = CPU_ALLOC(num_cores);
+        if (!cpuset)
+          throw std::bad_alloc();
+        const size_t size = CPU_ALLOC_SIZE(num_cores);
+        CPU_ZERO_S(size, cpuset);
+        for (const int core : cores)
+          CPU_SET_S(core, size, cpuset);
         const int status = pthread_setaffinity_np(_workers.back().native_handle(),
-                                                  sizeof (cpu_set_t),
-                                                  &cpuset);
+                                                  size,
+                                                  cpuset);
+        CPU_FREE(cpuset);
         if (status != 0) {
           throw std::runtime_error("Error calling pthread_setaffinity_np: "
                                    + std::to_string(status));
@@ -158,50 +619,880 @@ namespace ctranslate2 {
     }
   }
 
-  void TranslatorPool::work_loop(Translator& translator, size_t num_threads) {
+  void TranslatorPool::work_loop(size_t index, size_t num_threads) {
     // set_num_threads is called here because it sets the number of OpenMP threads for
     // the current thread.
     set_num_threads(num_threads);
 
-    while (true) {
-      std::unique_lock<std::mutex> lock(_mutex);
-      _cv.wait(lock, [this]{ return !_work.empty() || _request_end; });
+    Translator& translator = _translators[index];
+    WorkerQueue& own_queue = *_queues[index];
 
-      if (_request_end) {
-        lock.unlock();
-        // The CUDA context is destroyed when the thread exits, so we clear the translation
-        // resources now when the CUDA context is still active.
+    while (!_request_end) {
+      const size_t num_encoders = _num_encoders;
+      const bool is_decoder = (num_encoders > 0 && index >= num_encoders);
+
+      // The encoded jobs are also decoded when the pipelining was just disabled.
+      if (index >= num_encoders) {
+        // Mark the translator as idle before looking at the encoded jobs, so that a job
+        // encoded in the meantime notifies this translator.
+        if (is_decoder)
+          own_queue.idle = true;
+        std::unique_ptr<MergedJobs> merged;
+        {
+          std::lock_guard<std::mutex> lock(_encoded_jobs_mutex);
+          if (!_encoded_jobs.empty()) {
+            merged = std::move(_encoded_jobs.front());
+            _encoded_jobs.pop();
+          }
+        }
+
+        if (merged) {
+          own_queue.idle = false;
+          _can_encode_more_jobs.notify_all();
+          decode_merged_jobs(translator, std::move(merged));
+          continue;
+        }
+      }
+
+      // Take the most urgent jobs from all queues, possibly stealing them from the queue of
+      // a busy translator. The decoding translators only take the jobs remaining in their
+      // queue.
+      auto next_wakeup = std::chrono::steady_clock::time_point::max();
+      std::vector<std::unique_ptr<Job>> jobs;
+      if (is_decoder) {
+        jobs = pop_jobs(own_queue, next_wakeup);
+      } else {
+        // Mark the translator as idle before looking at the queues, so that a job posted
+        // in the meantime notifies this translator.
+        own_queue.idle = true;
+        jobs = pop_next_jobs(index, next_wakeup);
+      }
+
+      if (!jobs.empty()) {
+        own_queue.idle = false;
+        auto* translation_job = dynamic_cast<TranslationJob*>(jobs[0].get());
+        if (jobs.size() == 1 && translation_job && translation_job->use_continuous_batching()) {
+          jobs[0].release();
+          run_continuous_batching(translator,
+                                  index,
+                                  std::unique_ptr<TranslationJob>(translation_job));
+        } else if (num_encoders > 0 && !is_decoder) {
+          encode_merged_jobs(translator, std::move(jobs));
+        } else {
+          run_merged_jobs(translator, std::move(jobs));
+        }
+        continue;
+      }
+
+      if (is_outdated(translator.get_model())) {
+        // Release the translator reference to the replaced or evicted model.
         translator.detach_model();
-        break;
+        continue;
       }
 
-      auto job = std::move(_work.front());
-      _work.pop();
-      lock.unlock();
+      unload_idle_models(next_wakeup);
+
+      std::unique_lock<std::mutex> lock(own_queue.mutex);
+      // Jobs that are already in the queue are waiting for micro-batching (see pop_jobs).
+      const auto wake_up = [this, &own_queue]{
+        return own_queue.notified || _request_end;
+      };
+      if (next_wakeup == std::chrono::steady_clock::time_point::max())
+        own_queue.cv.wait(lock, wake_up);
+      else
+        own_queue.cv.wait_until(lock, next_wakeup, wake_up);
+      own_queue.notified = false;
+    }
+
+    // The CUDA context is destroyed when the thread exits, so we clear the translation
+    // resources now when the CUDA context is still active.
+    translator.detach_model();
+  }
 
-      _can_add_more_work.notify_one();
+  std::vector<std::unique_ptr<TranslatorPool::Job>>
+  TranslatorPool::pop_jobs(WorkerQueue& queue,
+                           std::chrono::steady_clock::time_point& next_wakeup) {
+    std::vector<std::unique_ptr<Job>> jobs;
+    StoppedJobs stopped_jobs;
 
-      job->run(translator);
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      stopped_jobs = pop_stopped_jobs(queue.jobs);
+
+      const auto now = std::chrono::steady_clock::now();
+      const Job* next_job = select_jobs(queue.jobs, now, next_wakeup);
+      const MergeGroup* next_group = (next_job && can_merge(*next_job)
+                                      ? JobQueue::merge_group(*next_job)
+                                      : nullptr);
+
+      if (next_group) {
+        jobs = queue.jobs.pop_if([next_group](const Job& job) {
+          return JobQueue::merge_group(job) == next_group;
+        });
+      } else if (next_job) {
+        jobs = queue.jobs.pop_if([next_job](const Job& job) {
+          return &job == next_job;
+        });
+      }
     }
+
+    on_jobs_removed(jobs.size());
+    fail_stopped_jobs(std::move(stopped_jobs));
+    return jobs;
   }
 
-  template <typename OutputType>
-  void TranslatorPool::BaseJob<OutputType>::run(Translator& translator) {
+  std::vector<std::unique_ptr<TranslatorPool::Job>>
+  TranslatorPool::pop_next_jobs(size_t index,
+                                std::chrono::steady_clock::time_point& next_wakeup) {
+    const size_t num_queues = _queues.size();
+    WorkerQueue* next_queue = nullptr;
+    JobQueue::Key next_key;
+
+    for (size_t i = 0; i < num_queues; ++i) {
+      WorkerQueue& queue = *_queues[(index + i) % num_queues];
+      JobQueue::Key key;
+      if (peek_jobs(queue, next_wakeup, key) && (!next_queue || key < next_key)) {
+        next_queue = &queue;
+        next_key = key;
+      }
+    }
+
+    // The selected jobs could have been taken by another translator in the meantime, in
+    // which case the next jobs of this queue are taken instead.
+    if (!next_queue)
+      return {};
+    return pop_jobs(*next_queue, next_wakeup);
+  }
+
+  bool TranslatorPool::peek_jobs(WorkerQueue& queue,
+                                 std::chrono::steady_clock::time_point& next_wakeup,
+                                 JobQueue::Key& key) {
+    bool found = false;
+    StoppedJobs stopped_jobs;
+
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      stopped_jobs = pop_stopped_jobs(queue.jobs);
+
+      const auto now = std::chrono::steady_clock::now();
+      const Job* next_job = select_jobs(queue.jobs, now, next_wakeup);
+      if (next_job) {
+        key = JobQueue::make_key(*next_job);
+        found = true;
+      }
+    }
+
+    fail_stopped_jobs(std::move(stopped_jobs));
+    return found;
+  }
+
+  const TranslatorPool::Job*
+  TranslatorPool::select_jobs(const JobQueue& jobs,
+                              std::chrono::steady_clock::time_point now,
+                              std::chrono::steady_clock::time_point& next_wakeup) const {
+    // Take the most urgent job, or group of mergeable jobs, that can run now. The groups
+    // waiting for more jobs do not block the next jobs of the queue.
+    const size_t max_tokens = _micro_batching_max_tokens;
+    const auto max_delay = std::chrono::microseconds(_micro_batching_max_delay_us);
+    std::unordered_set<const MergeGroup*> waiting_groups;
+    const Job* next_job = nullptr;
+
+    jobs.for_each([&](const Job& job) {
+      if (next_job)
+        return;
+      const MergeGroup* group = can_merge(job) ? JobQueue::merge_group(job) : nullptr;
+      if (!group) {
+        next_job = &job;
+        return;
+      }
+      if (!waiting_groups.emplace(group).second)
+        return;  // This job waits with the group.
+
+      // Wait for more jobs until the batch is large enough or the first job waited
+      // too long.
+      const auto ready_time = job.submission_time() + max_delay;
+      if ((max_tokens == 0 || group->num_tokens < max_tokens) && now < ready_time)
+        next_wakeup = std::min(next_wakeup, ready_time);
+      else
+        next_job = &job;
+    });
+
+    return next_job;
+  }
+
+  TranslatorPool::StoppedJobs TranslatorPool::pop_stopped_jobs(JobQueue& jobs) {
+    StoppedJobs stopped_jobs;
+    for (auto& job : jobs.pop_if([](const Job& job) {
+          return bool(job.get_stop_exception());
+        })) {
+      auto exception = job->get_stop_exception();
+      stopped_jobs.emplace_back(std::move(job), std::move(exception));
+    }
+    return stopped_jobs;
+  }
+
+  void TranslatorPool::fail_stopped_jobs(StoppedJobs stopped_jobs) {
+    on_jobs_removed(stopped_jobs.size());
+    for (auto& stopped_job : stopped_jobs)
+      stopped_job.first->fail(stopped_job.second);
+  }
+
+  void TranslatorPool::JobQueue::add_to_merge_group(Job& job) {
+    const auto* translation_job = dynamic_cast<const TranslationJob*>(&job);
+    if (!translation_job || !is_mergeable(*translation_job))
+      return;
+
+    // The empty groups are only erased here so that pop_if can compare the group of the
+    // remaining jobs.
+    MergeGroup* group = nullptr;
+    for (auto it = _merge_groups.begin(); it != _merge_groups.end();) {
+      if (it->num_jobs == 0) {
+        it = _merge_groups.erase(it);
+      } else {
+        if (!group && are_mergeable(*translation_job, *it))
+          group = &*it;
+        ++it;
+      }
+    }
+
+    if (!group) {
+      _merge_groups.emplace_back();
+      group = &_merge_groups.back();
+      group->model = translation_job->model();
+      group->with_target_prefix = !translation_job->target_prefix().empty();
+      group->options = translation_job->options();
+    }
+
+    job._merge_group = group;
+    job._num_merge_tokens = translation_job->num_tokens();
+    group->num_jobs += 1;
+    group->num_tokens += job._num_merge_tokens;
+  }
+
+  void TranslatorPool::JobQueue::remove_from_merge_group(Job& job) {
+    MergeGroup* group = job._merge_group;
+    if (!group)
+      return;
+    group->num_jobs -= 1;
+    group->num_tokens -= job._num_merge_tokens;
+    job._merge_group = nullptr;
+    job._num_merge_tokens = 0;
+
+    // Release the model and the options callbacks until the group is erased.
+    if (group->num_jobs == 0) {
+      group->model.reset();
+      group->options = TranslationOptions();
+    }
+  }
+
+  void TranslatorPool::set_micro_batching(std::chrono::microseconds max_delay,
+                                          size_t max_tokens) {
+    _micro_batching_max_delay_us = max_delay.count();
+    _micro_batching_max_tokens = max_tokens;
+    notify_all_workers();
+  }
+
+  bool TranslatorPool::can_merge(const Job& job) const {
+    if (_micro_batching_max_delay_us <= 0)
+      return false;
+    const auto* translation_job = dynamic_cast<const TranslationJob*>(&job);
+    return translation_job && is_mergeable(*translation_job);
+  }
+
+  bool TranslatorPool::is_mergeable(const TranslationJob& job) {
+    // The batches posted by translate_batch are not merged as they were split on purpose.
+    // Alternatives can not be returned from a prefix in a batch of multiple examples.
+    return (job.options().rebatch_input
+            && !job.options().return_alternatives
+            && !job.use_continuous_batching());
+  }
+
+  bool TranslatorPool::are_mergeable(const TranslationJob& job, const MergeGroup& group) {
+    const TranslationOptions& x = job.options();
+    const TranslationOptions& y = group.options;
+    return (job.model() == group.model
+            && job.target_prefix().empty() != group.with_target_prefix
+            && x.max_batch_size == y.max_batch_size
+            && x.batch_type == y.batch_type
+            && x.target_length_ratio == y.target_length_ratio
+            && x.beam_size == y.beam_size
+            && x.length_penalty == y.length_penalty
+            && x.coverage_penalty == y.coverage_penalty
+            && x.max_decoding_length == y.max_decoding_length
+            && x.min_decoding_length == y.min_decoding_length
+            && x.sampling_topk == y.sampling_topk
+            && x.sampling_temperature == y.sampling_temperature
+            && x.use_vmap == y.use_vmap
+            && x.num_hypotheses == y.num_hypotheses
+            && x.return_scores == y.return_scores
+            && x.return_attention == y.return_attention
+            && x.return_alternatives == y.return_alternatives
+            && x.replace_unknowns == y.replace_unknowns);
+  }
+
+  size_t TranslatorPool::merge_hash(const TranslationJob& job) {
+    const TranslationOptions& options = job.options();
+    size_t hash = std::hash<const models::Model*>()(job.model().get());
+    const auto combine = [&hash](size_t value) {
+      hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    };
+    combine(job.target_prefix().empty());
+    combine(options.max_batch_size);
+    combine(static_cast<size_t>(options.batch_type));
+    combine(options.beam_size);
+    combine(options.max_decoding_length);
+    combine(options.min_decoding_length);
+    combine(options.sampling_topk);
+    combine(options.num_hypotheses);
+    return hash;
+  }
+
+  std::unique_ptr<TranslatorPool::MergedJobs>
+  TranslatorPool::merge_jobs(std::vector<std::unique_ptr<Job>> jobs) const {
+    std::unique_ptr<MergedJobs> merged(new MergedJobs());
+    merged->jobs = std::move(jobs);
+    const auto& first_job = static_cast<const TranslationJob&>(*merged->jobs[0]);
+    merged->options = first_job.options();
+    merged->source = &first_job.source();
+    merged->target_prefix = &first_job.target_prefix();
+    if (merged->options.batch_type == BatchType::DecodingCost
+        && merged->options.target_length_ratio == 0)
+      merged->options.target_length_ratio = estimated_target_length_ratio();
+    if (merged->jobs.size() == 1)
+      return merged;
+
+    // Each job can be cancelled separately: the merged batch only removes the examples
+    // of the stopped jobs from the decoding.
+    for (const auto& job : merged->jobs) {
+      const auto& translation_job = static_cast<const TranslationJob&>(*job);
+      const size_t batch_size = translation_job.source().size();
+      merged->merged_source.insert(merged->merged_source.end(),
+                                   translation_job.source().begin(),
+                                   translation_job.source().end());
+      merged->merged_target_prefix.insert(merged->merged_target_prefix.end(),
+                                          translation_job.target_prefix().begin(),
+                                          translation_job.target_prefix().end());
+      merged->example_offset.insert(merged->example_offset.end(),
+                                    batch_size,
+                                    merged->example_job.size());
+      merged->example_job.insert(merged->example_job.end(), batch_size, &translation_job);
+    }
+    merged->source = &merged->merged_source;
+    merged->target_prefix = &merged->merged_target_prefix;
+
+    const auto& example_job = merged->example_job;
+    const auto& example_offset = merged->example_offset;
+    TranslationOptions& options = merged->options;
+    options.rebatch_input = true;
+    options.deadline = std::chrono::steady_clock::time_point::max();
+    options.cancellation_token = nullptr;
+    options.is_example_cancelled = [&example_job](size_t i) {
+      return example_job[i]->options().should_stop();
+    };
+    options.callback = nullptr;
+    for (const auto* job : example_job) {
+      if (!job->options().callback)
+        continue;
+      options.callback = [&example_job, &example_offset](const TranslationStepResult& result) {
+        const auto& callback = example_job[result.batch_id]->options().callback;
+        if (callback)
+          callback({result.batch_id - example_offset[result.batch_id],
+                    result.step,
+                    result.tokens,
+                    result.is_last});
+      };
+      break;
+    }
+    return merged;
+  }
+
+  void TranslatorPool::set_merged_results(MergedJobs& merged,
+                                          std::vector<TranslationResult> results) {
+    size_t offset = 0;
+    for (auto& job : merged.jobs) {
+      auto& translation_job = static_cast<TranslationJob&>(*job);
+      const size_t batch_size = translation_job.source().size();
+      auto exception = merged.jobs.size() > 1 ? translation_job.get_stop_exception() : nullptr;
+      if (exception) {
+        translation_job.fail(exception);
+      } else {
+        std::vector<TranslationResult> job_results(
+          std::make_move_iterator(results.begin() + offset),
+          std::make_move_iterator(results.begin() + offset + batch_size));
+        record_translation_lengths(translation_job, job_results);
+        translation_job.set_results(std::move(job_results));
+      }
+      offset += batch_size;
+    }
+  }
+
+  void TranslatorPool::run_merged_jobs(Translator& translator,
+                                       std::vector<std::unique_ptr<Job>> jobs) {
+    std::unique_ptr<MergedJobs> merged = merge_jobs(std::move(jobs));
     try {
-      _promise.set_value(compute(translator));
+      const auto& model = merged->jobs[0]->model();
+      if (model && translator.get_model() != model)
+        translator.set_model(model);
+
+      merged->memory_usage = fit_memory_budget(translator,
+                                               *merged->source,
+                                               *merged->target_prefix,
+                                               merged->options);
+      reserve_memory(merged->memory_usage);
+      std::vector<TranslationResult> results;
+      try {
+        results = translator.translate_batch_with_prefix(*merged->source,
+                                                         *merged->target_prefix,
+                                                         merged->options);
+      } catch (...) {
+        release_memory(merged->memory_usage);
+        throw;
+      }
+      release_memory(merged->memory_usage);
+      set_merged_results(*merged, std::move(results));
     } catch (...) {
+      const auto exception = std::current_exception();
+      for (auto& job : merged->jobs)
+        job->fail(exception);
+    }
+  }
+
+  void TranslatorPool::encode_merged_jobs(Translator& translator,
+                                          std::vector<std::unique_ptr<Job>> jobs) {
+    std::unique_ptr<MergedJobs> merged = merge_jobs(std::move(jobs));
+
+    {
+      // Do not encode more jobs than the decoding translators can take.
+      std::unique_lock<std::mutex> lock(_encoded_jobs_mutex);
+      _can_encode_more_jobs.wait(lock, [this]{
+        return _request_end || _encoded_jobs.size() < _translators.size() - _num_encoders;
+      });
+      if (_request_end) {
+        for (auto& job : merged->jobs)
+          job->fail(make_shutdown_exception());
+        return;
+      }
+    }
+
+    try {
+      const auto& model = merged->jobs[0]->model();
+      if (model && translator.get_model() != model)
+        translator.set_model(model);
+
+      merged->memory_usage = fit_memory_budget(translator,
+                                               *merged->source,
+                                               *merged->target_prefix,
+                                               merged->options);
+      reserve_memory(merged->memory_usage);
       try {
-        // Store the exception in the shared state so that future.get() will throw it.
-        _promise.set_exception(std::current_exception());
+        merged->encoded_batches = translator.encode_batch(*merged->source,
+                                                          *merged->target_prefix,
+                                                          merged->options);
       } catch (...) {
-        // set_exception may throw too.
+        release_memory(merged->memory_usage);
+        throw;
       }
+      merged->model = translator.get_model();
+    } catch (...) {
+      const auto exception = std::current_exception();
+      for (auto& job : merged->jobs)
+        job->fail(exception);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_encoded_jobs_mutex);
+      _encoded_jobs.emplace(std::move(merged));
     }
+    notify_idle_decoder();
   }
 
-  std::vector<TranslationResult>
-  TranslatorPool::TranslationJob::compute(Translator& translator) const {
-    return translator.translate_batch_with_prefix(_source, _target_prefix, _options);
+  void TranslatorPool::decode_merged_jobs(Translator& translator,
+                                          std::unique_ptr<MergedJobs> merged) {
+    const auto& options = merged->options;
+    const TranslationResult empty_result(options.num_hypotheses, options.return_attention);
+    std::vector<TranslationResult> results(merged->source->size(), empty_result);
+    std::exception_ptr exception;
+
+    try {
+      if (translator.get_model() != merged->model)
+        translator.set_model(merged->model);
+
+      for (auto& batch : merged->encoded_batches) {
+        set_batch_results(batch, translator.decode_batch(batch, options), results);
+      }
+    } catch (...) {
+      exception = std::current_exception();
+    }
+
+    // The encoder output is released on the model device.
+    {
+      auto scoped_device_setter = merged->model->get_scoped_device_setter();
+      merged->encoded_batches.clear();
+    }
+    release_memory(merged->memory_usage);
+
+    if (exception) {
+      for (auto& job : merged->jobs)
+        job->fail(exception);
+    } else {
+      set_merged_results(*merged, std::move(results));
+    }
+  }
+
+  void TranslatorPool::notify_idle_decoder() {
+    for (size_t i = _num_encoders; i < _queues.size(); ++i) {
+      WorkerQueue& queue = *_queues[i];
+      if (queue.idle) {
+        {
+          std::lock_guard<std::mutex> lock(queue.mutex);
+          queue.notified = true;
+        }
+        queue.cv.notify_one();
+        return;
+      }
+    }
+  }
+
+  void TranslatorPool::set_pipelining(size_t num_encoders) {
+    if (num_encoders >= _translators.size())
+      throw std::invalid_argument("The number of encoding translators should be smaller than "
+                                  "the number of translators");
+    _num_encoders = num_encoders;
+    notify_all_workers();
+  }
+
+  void TranslatorPool::set_translation_cache(size_t max_memory, size_t num_shards) {
+    std::shared_ptr<TranslationCache> cache;
+    if (max_memory > 0)
+      cache = std::make_shared<TranslationCache>(max_memory, num_shards);
+    std::atomic_store(&_translation_cache, std::move(cache));
+  }
+
+  float TranslatorPool::translation_cache_hit_ratio() const {
+    const auto cache = std::atomic_load(&_translation_cache);
+    return cache ? cache->hit_ratio() : 0;
+  }
+
+  void TranslatorPool::set_encoder_cache(size_t max_memory) {
+    std::shared_ptr<EncoderCache> cache;
+    if (max_memory > 0)
+      cache = std::make_shared<EncoderCache>(max_memory);
+    std::atomic_store(&_encoder_cache, cache);
+    for (auto& translator : _translators)
+      translator.set_encoder_cache(cache);
+  }
+
+  float TranslatorPool::encoder_cache_hit_ratio() const {
+    const auto cache = std::atomic_load(&_encoder_cache);
+    return cache ? cache->hit_ratio() : 0;
+  }
+
+  float TranslatorPool::estimated_target_length_ratio() const {
+    const size_t num_source_tokens = _num_translated_source_tokens;
+    const size_t num_target_tokens = _num_translated_target_tokens;
+    if (num_source_tokens == 0 || num_target_tokens == 0)
+      return 1;
+    return static_cast<float>(num_target_tokens) / static_cast<float>(num_source_tokens);
+  }
+
+  void TranslatorPool::record_translation_lengths(const TranslationJob& job,
+                                                  const std::vector<TranslationResult>& results) {
+    // The ratio of the total lengths is the least squares fit of target_length =
+    // ratio * source_length when the variance of the target length is proportional to the
+    // source length. Alternatives are excluded as their output is only a partial translation.
+    if (job.options().return_alternatives)
+      return;
+    size_t num_source_tokens = 0;
+    size_t num_target_tokens = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+      if (results[i].num_hypotheses() == 0)
+        continue;
+      num_source_tokens += job.source()[i].size();
+      num_target_tokens += results[i].output().size();
+    }
+    _num_translated_source_tokens += num_source_tokens;
+    _num_translated_target_tokens += num_target_tokens;
+  }
+
+  size_t
+  TranslatorPool::fit_memory_budget(Translator& translator,
+                                    const std::vector<std::vector<std::string>>& source,
+                                    const std::vector<std::vector<std::string>>& target_prefix,
+                                    TranslationOptions& options) const {
+    const size_t memory_budget = _memory_budget;
+    if (memory_budget == 0 || source.empty())
+      return 0;
+
+    const size_t memory_usage = translator.estimate_memory_usage(source, target_prefix, options);
+    if (memory_usage == 0)
+      return 0;
+
+    // The estimation pads all examples to the longest one, so it is proportional to the
+    // number of examples.
+    const size_t example_memory_usage = (memory_usage + source.size() - 1) / source.size();
+    size_t batch_size = source.size();
+    if (options.rebatch_input
+        && options.max_batch_size > 0
+        && options.batch_type == BatchType::Examples)
+      batch_size = std::min(batch_size, options.max_batch_size);
+    if (batch_size * example_memory_usage <= memory_budget)
+      return batch_size * example_memory_usage;
+
+    const size_t max_batch_size = memory_budget / example_memory_usage;
+    if (max_batch_size == 0)
+      throw std::runtime_error("The estimated memory usage of the translation ("
+                               + std::to_string(example_memory_usage)
+                               + " bytes per example) exceeds the memory budget ("
+                               + std::to_string(memory_budget) + " bytes)");
+
+    options.rebatch_input = true;
+    options.max_batch_size = max_batch_size;
+    options.batch_type = BatchType::Examples;
+    return max_batch_size * example_memory_usage;
+  }
+
+  void TranslatorPool::reserve_memory(size_t memory) {
+    if (memory == 0)
+      return;
+    std::unique_lock<std::mutex> lock(_memory_mutex);
+    // A job can always run alone, e.g. if the budget was reduced after it was estimated.
+    _memory_released.wait(lock, [this, memory]{
+      return (_memory_budget == 0
+              || _memory_usage == 0
+              || _memory_usage + memory <= _memory_budget);
+    });
+    _memory_usage += memory;
+  }
+
+  bool TranslatorPool::try_reserve_memory(size_t memory) {
+    if (memory == 0)
+      return true;
+    std::lock_guard<std::mutex> lock(_memory_mutex);
+    if (_memory_budget > 0 && _memory_usage > 0 && _memory_usage + memory > _memory_budget)
+      return false;
+    _memory_usage += memory;
+    return true;
+  }
+
+  void TranslatorPool::release_memory(size_t memory) {
+    if (memory == 0)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(_memory_mutex);
+      _memory_usage -= memory;
+    }
+    _memory_released.notify_all();
+  }
+
+  void TranslatorPool::set_memory_budget(size_t max_memory) {
+    {
+      std::lock_guard<std::mutex> lock(_memory_mutex);
+      _memory_budget = max_memory;
+    }
+    _memory_released.notify_all();
+  }
+
+  size_t TranslatorPool::estimated_memory_usage() {
+    std::lock_guard<std::mutex> lock(_memory_mutex);
+    return _memory_usage;
+  }
+
+  void TranslatorPool::run_continuous_batching(Translator& translator,
+                                               size_t index,
+                                               std::unique_ptr<TranslationJob> job) {
+    static const size_t default_max_continuous_batch_size = 64;
+    const TranslationOptions& options = job->options();
+    const size_t max_batch_size = (options.max_batch_size > 0
+                                   && options.batch_type == BatchType::Examples
+                                   ? options.max_batch_size
+                                   : default_max_continuous_batch_size);
+
+    std::unique_ptr<ContinuousBatchTranslator> batch_translator;
+    size_t memory_usage = 0;
+    try {
+      if (job->model() && translator.get_model() != job->model())
+        translator.set_model(job->model());
+      memory_usage = (_memory_budget > 0
+                      ? translator.estimate_memory_usage(job->source(), {}, options)
+                      : 0);
+      if (memory_usage > _memory_budget) {
+        // The job is translated in smaller batches.
+        std::vector<std::unique_ptr<Job>> jobs;
+        jobs.emplace_back(std::move(job));
+        run_merged_jobs(translator, std::move(jobs));
+        return;
+      }
+      batch_translator.reset(new ContinuousBatchTranslator(translator, options));
+    } catch (...) {
+      job->set_exception(std::current_exception());
+      return;
+    }
+
+    // The estimated memory of each job is reserved until the job leaves the batch.
+    struct RunningJob {
+      std::unique_ptr<TranslationJob> job;
+      size_t memory_usage;
+    };
+    std::unordered_map<size_t, RunningJob> running_jobs;
+    size_t next_job_id = 0;
+
+    const auto add_job = [&](std::unique_ptr<TranslationJob> translation_job,
+                             size_t job_memory_usage) {
+      const size_t job_id = next_job_id++;
+      try {
+        batch_translator->add(job_id, translation_job->source(), translation_job->options());
+        running_jobs.emplace(job_id, RunningJob{std::move(translation_job), job_memory_usage});
+      } catch (...) {
+        release_memory(job_memory_usage);
+        translation_job->set_exception(std::current_exception());
+      }
+    };
+
+    const auto try_reserve_job_memory = [&](const TranslationJob& translation_job,
+                                            size_t& job_memory_usage) {
+      job_memory_usage = 0;
+      if (_memory_budget == 0)
+        return true;
+      try {
+        job_memory_usage = translator.estimate_memory_usage(translation_job.source(),
+                                                            {},
+                                                            translation_job.options());
+      } catch (...) {
+        return false;
+      }
+      return try_reserve_memory(job_memory_usage);
+    };
+
+    const auto can_join = [&](const Job* queued_job) {
+      const auto* translation_job = dynamic_cast<const TranslationJob*>(queued_job);
+      return (translation_job
+              && translation_job->use_continuous_batching()
+              && batch_translator->accept(translation_job->options())
+              && (!queued_job->model() || queued_job->model() == translator.get_model()));
+    };
+
+    reserve_memory(memory_usage);
+    add_job(std::move(job), memory_usage);
+
+    while (true) {
+      for (auto& finished_batch : batch_translator->get_finished_batches()) {
+        auto it = running_jobs.find(finished_batch.first);
+        release_memory(it->second.memory_usage);
+        record_translation_lengths(*it->second.job, finished_batch.second);
+        it->second.job->set_results(std::move(finished_batch.second));
+        running_jobs.erase(it);
+      }
+
+      if (batch_translator->num_examples() == 0)
+        break;
+
+      // Take the next compatible jobs from the queues, starting with the translator queue.
+      std::vector<std::pair<std::unique_ptr<TranslationJob>, size_t>> new_jobs;
+      size_t num_examples = batch_translator->num_examples();
+      for (size_t i = 0; i < _queues.size() && num_examples < max_batch_size; ++i) {
+        WorkerQueue& queue = *_queues[(index + i) % _queues.size()];
+        size_t num_removed_jobs = 0;
+        {
+          std::lock_guard<std::mutex> lock(queue.mutex);
+          size_t job_memory_usage = 0;
+          while (!queue.jobs.empty()
+                 && num_examples < max_batch_size
+                 && !queue.jobs.front()->get_stop_exception()
+                 && can_join(queue.jobs.front().get())
+                 && try_reserve_job_memory(
+                   static_cast<const TranslationJob&>(*queue.jobs.front()), job_memory_usage)) {
+            auto* next_job = static_cast<TranslationJob*>(queue.jobs.pop().release());
+            num_examples += next_job->source().size();
+            new_jobs.emplace_back(std::unique_ptr<TranslationJob>(next_job), job_memory_usage);
+            num_removed_jobs += 1;
+          }
+        }
+        on_jobs_removed(num_removed_jobs);
+      }
+
+      if (!new_jobs.empty()) {
+        for (auto& new_job : new_jobs)
+          add_job(std::move(new_job.first), new_job.second);
+      }
+
+      // Remove the jobs that were cancelled or exceeded their deadline from the batch.
+      for (auto it = running_jobs.begin(); it != running_jobs.end();) {
+        auto exception = it->second.job->get_stop_exception();
+        if (exception) {
+          batch_translator->cancel(it->first);
+          release_memory(it->second.memory_usage);
+          it->second.job->fail(exception);
+          it = running_jobs.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      if (batch_translator->num_examples() == 0)
+        break;
+
+      try {
+        batch_translator->step();
+      } catch (...) {
+        const auto exception = std::current_exception();
+        for (auto& running_job : running_jobs) {
+          release_memory(running_job.second.memory_usage);
+          running_job.second.job->set_exception(exception);
+        }
+        return;
+      }
+    }
+  }
+
+  template <typename OutputType>
+  void TranslatorPool::BaseJob<OutputType>::set_value(OutputType result) {
+    _promise.set_value(std::move(result));
+  }
+
+  template <typename OutputType>
+  void TranslatorPool::BaseJob<OutputType>::set_exception(std::exception_ptr exception) {
+    try {
+      // Store the exception in the shared state so that future.get() will throw it.
+      _promise.set_exception(exception);
+    } catch (...) {
+      // set_exception may throw too.
+    }
+  }
+
+  size_t TranslatorPool::TranslationJob::num_tokens() const {
+    size_t num_tokens = 0;
+    for (const auto& example : _source)
+      num_tokens += example.size();
+    return num_tokens;
+  }
+
+  void TranslatorPool::TranslationJob::set_results(std::vector<TranslationResult> results) {
+    if (_cache) {
+      for (size_t i = 0; i < results.size(); ++i) {
+        if (!_source[i].empty())
+          _cache->put(_cache_keys[i], _model, results[i]);
+      }
+    }
+
+    if (!_cached_index.empty()) {
+      // Insert the cached results at their position in the posted batch.
+      std::vector<TranslationResult> batch_results;
+      batch_results.reserve(results.size() + _cached_results.size());
+      auto result = std::make_move_iterator(results.begin());
+      auto cached_result = std::make_move_iterator(_cached_results.begin());
+      for (size_t i = 0, c = 0; i < results.size() + _cached_results.size(); ++i) {
+        if (c < _cached_index.size() && _cached_index[c] == i) {
+          batch_results.emplace_back(*cached_result++);
+          ++c;
+        } else {
+          batch_results.emplace_back(*result++);
+        }
+      }
+      results = std::move(batch_results);
+    }
+
+    set_value(std::move(results));
   }
 
   void TranslatorPool::open_input_file(const std::string& file, std::ifstream& stream) const {
@@ -268,8 +1559,15 @@ namespace ctranslate2 {
   }
 
   size_t TranslatorPool::num_queued_batches() {
+    return _num_queued_jobs;
+  }
+
+  size_t TranslatorPool::num_loaded_models() {
     const std::lock_guard<std::mutex> lock(_mutex);
-    return _work.size();
+    return std::count_if(_models.begin(), _models.end(),
+                         [](const LoadedModel& loaded_model) {
+                           return loaded_model.loaded;
+                         });
   }
 
   size_t TranslatorPool::num_translators() const {
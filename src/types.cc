@@ -23,6 +23,20 @@ namespace ctranslate2 {
     }
   }
 
+  size_t dtype_size(DataType type) {
+    switch (type) {
+    case DataType::FLOAT:
+    case DataType::INT32:
+      return 4;
+    case DataType::INT16:
+    case DataType::FLOAT16:
+      return 2;
+    case DataType::INT8:
+    default:
+      return 1;
+    }
+  }
+
   ComputeType str_to_compute_type(const std::string& compute_type) {
     if (compute_type == "int8")
       return ComputeType::INT8;
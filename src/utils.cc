@@ -2,9 +2,16 @@
 
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 
 #ifdef _WIN32
 #  include <malloc.h>
+#else
+#  include <cerrno>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
 #endif
 
 #ifdef CT2_WITH_MKL
@@ -191,6 +198,33 @@ namespace ctranslate2 {
     return parts;
   }
 
+  static inline uint64_t mix_hash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = mix_hash(seed ^ size) ^ 0xcbf29ce484222325ULL;
+
+    // Process 8 bytes at a time, then the remaining bytes.
+    size_t i = 0;
+    for (; i + sizeof (uint64_t) <= size; i += sizeof (uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, bytes + i, sizeof (word));
+      h = (h ^ mix_hash(word)) * prime;
+    }
+    for (; i < size; ++i)
+      h = (h ^ bytes[i]) * prime;
+
+    return mix_hash(h);
+  }
+
   std::mt19937& get_random_generator() {
     static thread_local std::mt19937 generator(
       std::chrono::system_clock::now().time_since_epoch().count());
@@ -222,4 +256,125 @@ namespace ctranslate2 {
 #endif
   }
 
+  MappedFile::MappedFile(const std::string& path)
+    : _data(nullptr)
+    , _size(0) {
+#ifdef _WIN32
+    throw std::runtime_error("Memory mapping model files is not supported on Windows");
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("Failed to open file " + path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      throw std::runtime_error("Failed to get the size of file " + path);
+    }
+    _size = st.st_size;
+    if (_size > 0) {
+      void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("Failed to map file " + path + " in memory");
+      }
+      _data = static_cast<const char*>(data);
+    }
+    // The mapping remains valid after the file descriptor is closed.
+    close(fd);
+#endif
+  }
+
+  MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (_data)
+      munmap(const_cast<char*>(_data), _size);
+#endif
+  }
+
+  SharedMemory::SharedMemory(int fd, bool writable)
+    : _fd(fd)
+    , _writable(writable)
+    , _data(nullptr)
+    , _size(0) {
+    remap();
+  }
+
+  std::shared_ptr<SharedMemory> SharedMemory::create(const std::string& name) {
+#ifdef _WIN32
+    throw std::runtime_error("Shared memory is not supported on Windows");
+#else
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+      if (errno == EEXIST)
+        return nullptr;
+      throw std::runtime_error("Failed to create shared memory " + name);
+    }
+    return std::shared_ptr<SharedMemory>(new SharedMemory(fd, /*writable=*/true));
+#endif
+  }
+
+  std::shared_ptr<SharedMemory> SharedMemory::open(const std::string& name) {
+#ifdef _WIN32
+    throw std::runtime_error("Shared memory is not supported on Windows");
+#else
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+      if (errno == ENOENT)
+        return nullptr;
+      throw std::runtime_error("Failed to open shared memory " + name);
+    }
+    return std::shared_ptr<SharedMemory>(new SharedMemory(fd, /*writable=*/false));
+#endif
+  }
+
+  void SharedMemory::unlink(const std::string& name) {
+#ifdef _WIN32
+    throw std::runtime_error("Shared memory is not supported on Windows");
+#else
+    shm_unlink(name.c_str());
+#endif
+  }
+
+  SharedMemory::~SharedMemory() {
+#ifndef _WIN32
+    if (_data)
+      munmap(_data, _size);
+    close(_fd);
+#endif
+  }
+
+  void SharedMemory::resize(size_t size) {
+#ifdef _WIN32
+    (void)size;
+#else
+    if (!_writable)
+      throw std::runtime_error("Can't resize a shared memory opened in read-only mode");
+    if (ftruncate(_fd, size) != 0)
+      throw std::runtime_error("Failed to resize shared memory to " + std::to_string(size)
+                               + " bytes");
+    remap();
+#endif
+  }
+
+  void SharedMemory::remap() {
+#ifndef _WIN32
+    if (_data) {
+      munmap(_data, _size);
+      _data = nullptr;
+      _size = 0;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) != 0)
+      throw std::runtime_error("Failed to get the size of the shared memory");
+    if (st.st_size == 0)
+      return;
+    const int protection = _writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* data = mmap(nullptr, st.st_size, protection, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED)
+      throw std::runtime_error("Failed to map shared memory");
+    _data = static_cast<char*>(data);
+    _size = st.st_size;
+#endif
+  }
+
 }
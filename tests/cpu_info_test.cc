@@ -0,0 +1,18 @@
+#include "test_utils.h"
+#include "cpu/cpu_info.h"
+
+TEST(CpuInfoTest, ParseCpuList) {
+  EXPECT_EQ(cpu::parse_cpu_list("0-3,8-11"),
+            (std::vector<int>{0, 1, 2, 3, 8, 9, 10, 11}));
+  EXPECT_EQ(cpu::parse_cpu_list("0"), (std::vector<int>{0}));
+  EXPECT_EQ(cpu::parse_cpu_list("1,3,5-6"), (std::vector<int>{1, 3, 5, 6}));
+  EXPECT_EQ(cpu::parse_cpu_list("1030-1032"), (std::vector<int>{1030, 1031, 1032}));
+  EXPECT_TRUE(cpu::parse_cpu_list("").empty());
+}
+
+TEST(CpuInfoTest, NumaNodes) {
+  const auto& nodes = cpu::cpu_numa_nodes();
+  ASSERT_FALSE(nodes.empty());
+  for (const auto& cores : nodes)
+    EXPECT_FALSE(cores.empty());
+}
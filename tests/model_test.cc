@@ -1,5 +1,23 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+
 #include <ctranslate2/models/model.h>
+#include <ctranslate2/translator.h>
+#include <ctranslate2/utils.h>
+
+#ifndef _WIN32
+#  include <dirent.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
 
+#include "models/model_file.h"
 #include "test_utils.h"
 
 extern std::string g_data_dir;
@@ -7,3 +25,641 @@ extern std::string g_data_dir;
 TEST(ModelTest, ContainsModel) {
   ASSERT_TRUE(models::contains_model(g_data_dir + "/models/v2/aren-transliteration"));
 }
+
+class LazyModelReader : public models::ModelFileReader {
+public:
+  LazyModelReader(const std::string& model_dir)
+    : models::ModelFileReader(model_dir) {
+  }
+
+  bool lazy_load() const override {
+    return true;
+  }
+};
+
+TEST(ModelTest, LoadLazyModel) {
+  LazyModelReader model_reader(g_data_dir + "/models/v6/aren-transliteration");
+  const auto model = models::Model::load(model_reader);
+  ASSERT_TRUE(model->is_lazy());
+  const size_t num_variables_after_load = model->get_variables().size();
+
+  // The full memory usage is estimated from the variable index.
+  EXPECT_EQ(model->get_full_memory_usage(),
+            models::Model::load(g_data_dir + "/models/v6/aren-transliteration")->get_memory_usage());
+
+  // The translator layers are built on the first translation.
+  Translator translator(model);
+  EXPECT_EQ(model->get_variables().size(), num_variables_after_load);
+
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(translator.translate(input).output(), expected);
+  EXPECT_GT(model->get_variables().size(), num_variables_after_load);
+
+  // The variables are materialized again after being unloaded, and the translator rebuilds
+  // its layers which referenced the released variables.
+  const size_t generation = model->variables_generation();
+  EXPECT_TRUE(model->unload_variables());
+  EXPECT_TRUE(model->get_variables().empty());
+  EXPECT_EQ(model->variables_generation(), generation + 1);
+  EXPECT_EQ(translator.translate(input).output(), expected);
+  EXPECT_EQ(Translator(model).translate(input).output(), expected);
+
+  // The variables are not released while they are in use.
+  {
+    const models::ModelVariablesGuard variables_guard(*model);
+    EXPECT_FALSE(model->unload_variables());
+    EXPECT_FALSE(model->get_variables().empty());
+  }
+  EXPECT_TRUE(model->unload_variables());
+}
+
+TEST(ModelTest, UnloadLazyModelWhileTranslating) {
+  LazyModelReader model_reader(g_data_dir + "/models/v6/aren-transliteration");
+  const auto model = models::Model::load(model_reader);
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+
+  // The variables are released between the translations, never during a translation.
+  Translator translator(model);
+  std::atomic<bool> done(false);
+  std::thread unloader([&model, &done]() {
+    while (!done)
+      model->unload_variables();
+  });
+  for (size_t i = 0; i < 20; ++i)
+    EXPECT_EQ(translator.translate(input).output(), expected);
+  done = true;
+  unloader.join();
+}
+
+TEST(ModelTest, GetVariablesWhileMaterializing) {
+  LazyModelReader model_reader(g_data_dir + "/models/v6/aren-transliteration");
+  const auto model = models::Model::load(model_reader);
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+
+  // The translator materializes the variables while the snapshots are taken.
+  std::atomic<bool> done(false);
+  std::thread reader([&model, &done]() {
+    while (!done) {
+      for (const auto& pair : model->get_variables())
+        EXPECT_EQ(pair.second, model->get_variable_if_exists(pair.first));
+    }
+  });
+  EXPECT_EQ(Translator(model).translate(input).output(), expected);
+  done = true;
+  reader.join();
+}
+
+#ifndef _WIN32
+class MappedModelReader : public models::ModelFileReader {
+public:
+  MappedModelReader(const std::string& model_dir)
+    : models::ModelFileReader(model_dir)
+    , _model_dir(model_dir) {
+  }
+
+  std::shared_ptr<const MappedFile> map_file(const std::string& filename) override {
+    return std::make_shared<MappedFile>(_model_dir + "/" + filename);
+  }
+
+private:
+  const std::string _model_dir;
+};
+
+TEST(ModelTest, LoadMappedModel) {
+  MappedModelReader model_reader(g_data_dir + "/models/v2/aren-transliteration");
+  const auto model = models::Model::load(model_reader, Device::CPU, 0, ComputeType::FLOAT);
+
+  size_t num_views = 0;
+  for (const auto& pair : model->get_variables()) {
+    if (!pair.second->owns_data())
+      ++num_views;
+  }
+  EXPECT_GT(num_views, 0);
+
+  Translator translator(model);
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(translator.translate(input).output(), expected);
+}
+
+TEST(ModelTest, LoadSharedMemoryModel) {
+  const std::string model_dir = g_data_dir + "/models/v2/aren-transliteration-i16";
+  const std::string shared_memory_name = "/ct2-test-" + std::to_string(getpid());
+  models::SharedMemoryModelReader model_reader(model_dir, shared_memory_name);
+
+  // The first load creates the shared memory and the second load attaches to it.
+  const auto model_creator = models::Model::load(model_reader);
+  const auto model_attached = models::Model::load(model_reader);
+  SharedMemory::unlink(shared_memory_name);
+
+  EXPECT_EQ(model_attached->effective_compute_type(), model_creator->effective_compute_type());
+  const auto variables = model_attached->get_variables();
+  EXPECT_EQ(variables.size(), model_creator->get_variables().size());
+  for (const auto& pair : variables) {
+    const StorageView& variable = *pair.second;
+    EXPECT_FALSE(variable.owns_data());
+    // Both models view the same shared memory but can be mapped at different addresses.
+    expect_storage_eq(variable, model_creator->get_variable(pair.first));
+  }
+
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(Translator(model_attached).translate(input).output(), expected);
+}
+
+class DeduplicatedModelReader : public models::ModelFileReader {
+public:
+  DeduplicatedModelReader(const std::string& model_dir)
+    : models::ModelFileReader(model_dir) {
+  }
+
+  bool deduplicate_weights() const override {
+    return true;
+  }
+};
+
+TEST(ModelTest, DeduplicateWeights) {
+  const std::string model_dir = g_data_dir + "/models/v2/aren-transliteration";
+  DeduplicatedModelReader model_reader(model_dir);
+  auto model_a = models::Model::load(model_reader);
+  const auto model_b = models::Model::load(model_reader);
+
+  size_t num_shared_variables = 0;
+  for (const auto& pair : model_b->get_variables()) {
+    if (pair.second->buffer() == model_a->get_variable(pair.first).buffer())
+      ++num_shared_variables;
+  }
+  EXPECT_GT(num_shared_variables, 0);
+
+  // The shared variables remain valid when the first model is released.
+  model_a.reset();
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(Translator(model_b).translate(input).output(), expected);
+}
+
+TEST(ModelTest, SaveModel) {
+  const std::string model_dir = g_data_dir + "/models/v2/aren-transliteration";
+  const auto model = models::Model::load(model_dir);
+
+  // Save in a temporary directory and check that the reloaded variables are identical.
+  const std::string saved_dir = ::testing::TempDir() + "ct2-saved-model-" + std::to_string(getpid());
+  ASSERT_EQ(mkdir(saved_dir.c_str(), 0755), 0);
+  model->save(saved_dir);
+  for (const auto& filename : {"source_vocabulary.txt", "target_vocabulary.txt"}) {
+    std::ifstream source(model_dir + "/" + filename, std::ios_base::binary);
+    std::ofstream target(saved_dir + "/" + filename, std::ios_base::binary);
+    target << source.rdbuf();
+  }
+
+  const auto saved_model = models::Model::load(saved_dir);
+  EXPECT_EQ(saved_model->current_spec_revision(), model->current_spec_revision());
+  for (const auto& pair : model->get_variables())
+    expect_storage_eq(saved_model->get_variable(pair.first), *pair.second);
+
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(Translator(saved_model).translate(input).output(), expected);
+
+  for (const auto& filename : {"model.bin", "source_vocabulary.txt", "target_vocabulary.txt"})
+    std::remove((saved_dir + "/" + filename).c_str());
+  rmdir(saved_dir.c_str());
+}
+
+static std::string read_file(const std::string& path) {
+  std::ifstream file(path, std::ios_base::binary);
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static models::ModelFileHeader read_model_header(const std::string& path) {
+  std::ifstream model_file(path, std::ios_base::binary);
+  return models::read_model_header(model_file);
+}
+
+// Writes the variables of a model with the library writer.
+static void save_model_file(const std::string& path,
+                            const models::ModelFileHeader& header,
+                            const models::Model& model,
+                            const std::vector<std::string>& excluded_variables = {},
+                            std::vector<models::SavedVariable> variables = {}) {
+  for (const auto& pair : model.get_variables()) {
+    const StorageView& variable = *pair.second;
+    if (std::find(excluded_variables.begin(), excluded_variables.end(), pair.first)
+        == excluded_variables.end())
+      variables.push_back({pair.first, &variable, variable.reserved_memory()});
+  }
+  std::ofstream model_file(path, std::ios_base::binary);
+  models::write_model_file(model_file, header.spec, header.spec_revision, variables, header.aliases);
+}
+
+static void copy_vocabularies(const std::string& model_dir, const std::string& target_dir) {
+  for (const auto& filename : {"source_vocabulary.txt", "target_vocabulary.txt"}) {
+    std::ifstream source(model_dir + "/" + filename, std::ios_base::binary);
+    std::ofstream target(target_dir + "/" + filename, std::ios_base::binary);
+    target << source.rdbuf();
+  }
+}
+
+static void remove_model_dir(const std::string& model_dir) {
+  for (const auto& filename : {"model.bin", "source_vocabulary.txt", "target_vocabulary.txt"})
+    std::remove((model_dir + "/" + filename).c_str());
+  rmdir(model_dir.c_str());
+}
+
+TEST(ModelTest, LoadIndexedModel) {
+  // The binary version 6 indexes the variables which are aligned on 64 bytes.
+  const std::string model_dir = g_data_dir + "/models/v6/aren-transliteration";
+  const models::ModelFileHeader header = read_model_header(model_dir + "/model.bin");
+  EXPECT_FALSE(header.variables.empty());
+  for (const auto& variable : header.variables)
+    EXPECT_EQ(variable.offset % 64, 0) << variable.name;
+
+  // The variables are the same as the model saved with the binary version 2.
+  const auto model = models::Model::load(model_dir);
+  const auto reference_model = models::Model::load(g_data_dir + "/models/v2/aren-transliteration");
+  EXPECT_EQ(model->get_variables().size(), reference_model->get_variables().size());
+  for (const auto& pair : reference_model->get_variables())
+    expect_storage_eq(model->get_variable(pair.first), *pair.second);
+
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+  EXPECT_EQ(Translator(model).translate(input).output(), expected);
+}
+
+TEST(ModelTest, IndexedModelAliases) {
+  // Replace the output projection by an alias to the decoder embeddings.
+  const std::string model_dir = g_data_dir + "/models/v6/aren-transliteration";
+  models::ModelFileHeader header = read_model_header(model_dir + "/model.bin");
+  const std::string alias = "decoder/projection/weight";
+  const std::string variable_name = "decoder/embeddings/weight";
+  header.aliases.emplace_back(alias, variable_name);
+
+  const std::string aliased_dir = (::testing::TempDir()
+                                   + "ct2-aliased-model-" + std::to_string(getpid()));
+  const std::string saved_dir = (::testing::TempDir()
+                                 + "ct2-saved-aliased-model-" + std::to_string(getpid()));
+  ASSERT_EQ(mkdir(aliased_dir.c_str(), 0755), 0);
+  ASSERT_EQ(mkdir(saved_dir.c_str(), 0755), 0);
+  save_model_file(aliased_dir + "/model.bin",
+                  header,
+                  *models::Model::load(model_dir),
+                  {alias});
+  copy_vocabularies(model_dir, aliased_dir);
+
+  // The alias views the variable data after loading and is saved again as an alias.
+  const auto model = models::Model::load(aliased_dir);
+  EXPECT_EQ(model->get_variable(alias).buffer(), model->get_variable(variable_name).buffer());
+  model->save(saved_dir);
+  copy_vocabularies(model_dir, saved_dir);
+
+  const models::ModelFileHeader saved_header = read_model_header(saved_dir + "/model.bin");
+  for (const auto& variable : saved_header.variables) {
+    EXPECT_EQ(variable.offset % 64, 0) << variable.name;
+    EXPECT_NE(variable.name, alias);
+  }
+  EXPECT_NE(std::find(saved_header.aliases.begin(),
+                      saved_header.aliases.end(),
+                      std::make_pair(alias, variable_name)),
+            saved_header.aliases.end());
+
+  const auto saved_model = models::Model::load(saved_dir);
+  EXPECT_EQ(saved_model->get_variable(alias).buffer(),
+            saved_model->get_variable(variable_name).buffer());
+  const std::vector<std::string> input = {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"};
+  EXPECT_EQ(Translator(saved_model).translate(input).output(),
+            Translator(model).translate(input).output());
+
+  remove_model_dir(aliased_dir);
+  remove_model_dir(saved_dir);
+}
+
+TEST(ModelTest, IndexedModelInvalidOffset) {
+  // The last variable of a truncated file has an offset past the end of the file.
+  const std::string model_dir = g_data_dir + "/models/v6/aren-transliteration";
+  const std::string truncated_dir = (::testing::TempDir()
+                                     + "ct2-truncated-model-" + std::to_string(getpid()));
+  ASSERT_EQ(mkdir(truncated_dir.c_str(), 0755), 0);
+  save_model_file(truncated_dir + "/model.bin",
+                  read_model_header(model_dir + "/model.bin"),
+                  *models::Model::load(model_dir));
+  copy_vocabularies(model_dir, truncated_dir);
+
+  const models::ModelFileHeader header = read_model_header(truncated_dir + "/model.bin");
+  const auto last_variable = std::max_element(header.variables.begin(),
+                                              header.variables.end(),
+                                              [](const models::VariableEntry& a,
+                                                 const models::VariableEntry& b) {
+                                                return a.offset < b.offset;
+                                              });
+  ASSERT_EQ(truncate((truncated_dir + "/model.bin").c_str(), last_variable->offset), 0);
+
+  EXPECT_THROW(models::Model::load(truncated_dir), std::runtime_error);
+  MappedModelReader model_reader(truncated_dir);
+  EXPECT_THROW(models::Model::load(model_reader), std::runtime_error);
+
+  remove_model_dir(truncated_dir);
+}
+
+class MappedSharedMemoryModelReader : public models::SharedMemoryModelReader {
+public:
+  MappedSharedMemoryModelReader(const std::string& model_dir,
+                                const std::string& shared_memory_name)
+    : models::SharedMemoryModelReader(model_dir, shared_memory_name)
+    , _model_dir(model_dir) {
+  }
+
+  std::shared_ptr<const MappedFile> map_file(const std::string& filename) override {
+    return std::make_shared<MappedFile>(_model_dir + "/" + filename);
+  }
+
+private:
+  const std::string _model_dir;
+};
+
+TEST(ModelTest, SaveMappedVariablesWithExtraData) {
+  // Like packed weights, a variable can hold more data than its shape. This data should be
+  // saved again when the variable views a mapped file or shared memory.
+  const std::string model_dir = g_data_dir + "/models/v6/aren-transliteration";
+  const std::string extra_dir = (::testing::TempDir()
+                                 + "ct2-extra-data-model-" + std::to_string(getpid()));
+  const std::string saved_dir = (::testing::TempDir()
+                                 + "ct2-saved-extra-data-model-" + std::to_string(getpid()));
+  ASSERT_EQ(mkdir(extra_dir.c_str(), 0755), 0);
+  ASSERT_EQ(mkdir(saved_dir.c_str(), 0755), 0);
+
+  const std::vector<float> extra_data = {0, 1, 2, 3, 4, 5, 6, 7};
+  const dim_t extra_bytes = extra_data.size() * sizeof (float);
+  StorageView extra_variable;
+  extra_variable.view(const_cast<float*>(extra_data.data()), {4});
+  save_model_file(extra_dir + "/model.bin",
+                  read_model_header(model_dir + "/model.bin"),
+                  *models::Model::load(model_dir),
+                  {},
+                  {{"extra/data", &extra_variable, extra_bytes}});
+  copy_vocabularies(model_dir, extra_dir);
+
+  const auto check_saved_model = [&](const models::Model& model) {
+    const StorageView& variable = model.get_variable("extra/data");
+    EXPECT_FALSE(variable.owns_data());
+    EXPECT_EQ(variable.size(), 4);
+
+    model.save(saved_dir);
+    copy_vocabularies(model_dir, saved_dir);
+    const auto saved_model = models::Model::load(saved_dir);
+    const StorageView& saved_variable = saved_model->get_variable("extra/data");
+    ASSERT_EQ(saved_variable.reserved_memory(), extra_bytes);
+    EXPECT_EQ(std::memcmp(saved_variable.buffer(), extra_data.data(), extra_bytes), 0);
+  };
+
+  MappedModelReader model_reader(extra_dir);
+  check_saved_model(*models::Model::load(model_reader, Device::CPU, 0, ComputeType::FLOAT));
+
+  // The shared memory is written from a mapped model and the attached model views it.
+  const std::string shared_memory_name = "/ct2-test-extra-data-" + std::to_string(getpid());
+  MappedSharedMemoryModelReader shared_model_reader(extra_dir, shared_memory_name);
+  const auto model_creator = models::Model::load(shared_model_reader,
+                                                 Device::CPU,
+                                                 0,
+                                                 ComputeType::FLOAT);
+  const auto model_attached = models::Model::load(shared_model_reader,
+                                                  Device::CPU,
+                                                  0,
+                                                  ComputeType::FLOAT);
+  SharedMemory::unlink(shared_memory_name);
+  check_saved_model(*model_attached);
+
+  remove_model_dir(extra_dir);
+  remove_model_dir(saved_dir);
+}
+
+TEST(ModelTest, DeduplicateWeightsWithExtraData) {
+  // Variables with the same shape and data but a different buffer content past their shape
+  // (e.g. packed weights) are not shared.
+  const std::string model_dir = g_data_dir + "/models/v6/aren-transliteration";
+  const auto model = models::Model::load(model_dir);
+  const models::ModelFileHeader header = read_model_header(model_dir + "/model.bin");
+
+  const auto save_model_with_extra_data = [&](const std::string& name, const float extra_value) {
+    const std::string extra_dir = (::testing::TempDir()
+                                   + "ct2-" + name + "-model-" + std::to_string(getpid()));
+    EXPECT_EQ(mkdir(extra_dir.c_str(), 0755), 0);
+    std::vector<float> extra_data(2048, 1.f);
+    extra_data.back() = extra_value;
+    StorageView extra_variable;
+    extra_variable.view(extra_data.data(), {1024});
+    save_model_file(extra_dir + "/model.bin",
+                    header,
+                    *model,
+                    {},
+                    {{"extra/data", &extra_variable, dim_t(extra_data.size() * sizeof (float))}});
+    copy_vocabularies(model_dir, extra_dir);
+    return extra_dir;
+  };
+
+  const std::string model_dir_a = save_model_with_extra_data("extra-data-a", 2);
+  const std::string model_dir_b = save_model_with_extra_data("extra-data-b", 3);
+  DeduplicatedModelReader model_reader_a(model_dir_a);
+  DeduplicatedModelReader model_reader_b(model_dir_b);
+  const auto model_a = models::Model::load(model_reader_a);
+  const auto model_b = models::Model::load(model_reader_b);
+  const auto model_c = models::Model::load(model_reader_b);
+  remove_model_dir(model_dir_a);
+  remove_model_dir(model_dir_b);
+
+  const auto get_buffer = [](const models::Model& model, const std::string& name) {
+    return model.get_variable(name).buffer();
+  };
+  EXPECT_NE(get_buffer(*model_a, "extra/data"), get_buffer(*model_b, "extra/data"));
+  EXPECT_EQ(get_buffer(*model_b, "extra/data"), get_buffer(*model_c, "extra/data"));
+  EXPECT_EQ(get_buffer(*model_a, "decoder/embeddings/weight"),
+            get_buffer(*model_b, "decoder/embeddings/weight"));
+}
+
+class CachedWeightsModelReader : public models::ModelFileReader {
+public:
+  CachedWeightsModelReader(const std::string& model_dir, const std::string& cache_dir)
+    : models::ModelFileReader(model_dir)
+    , _cache_dir(cache_dir) {
+  }
+
+  std::string processed_weights_cache_dir() const override {
+    return _cache_dir;
+  }
+
+private:
+  const std::string _cache_dir;
+};
+
+static std::vector<std::string> list_files(const std::string& dir) {
+  std::vector<std::string> filenames;
+  DIR* dir_handle = opendir(dir.c_str());
+  if (!dir_handle)
+    return filenames;
+  while (const struct dirent* entry = readdir(dir_handle)) {
+    const std::string filename = entry->d_name;
+    if (filename != "." && filename != "..")
+      filenames.emplace_back(filename);
+  }
+  closedir(dir_handle);
+  return filenames;
+}
+
+static std::map<std::string, const StorageView*>
+get_processed_weights(const models::Model& model) {
+  std::map<std::string, const StorageView*> processed_weights;
+  for (const auto& pair : model.get_variables()) {
+    const std::string& name = pair.first;
+    if (ends_with(name, "_packed") || ends_with(name, "_compensation"))
+      processed_weights.emplace(name, pair.second);
+  }
+  return processed_weights;
+}
+
+TEST(ModelTest, ProcessedWeightsCache) {
+  if (!mayiuse_int8(Device::CPU))
+    GTEST_SKIP() << "The Gemm backend does not support int8";
+  const std::string model_dir = g_data_dir + "/models/v2/aren-transliteration";
+  const std::string cache_dir = (::testing::TempDir()
+                                 + "ct2-weights-cache-" + std::to_string(getpid()));
+  ASSERT_EQ(mkdir(cache_dir.c_str(), 0755), 0);
+  CachedWeightsModelReader model_reader(model_dir, cache_dir);
+
+  const auto reference_model = models::Model::load(model_reader,
+                                                    Device::CPU,
+                                                    0,
+                                                    ComputeType::INT8);
+  const auto reference_weights = get_processed_weights(*reference_model);
+  const std::vector<std::string> cache_files = list_files(cache_dir);
+  if (reference_weights.empty()) {
+    EXPECT_TRUE(cache_files.empty());
+    rmdir(cache_dir.c_str());
+    GTEST_SKIP() << "The Gemm backend does not use processed weights";
+  }
+  // The cache file and its checksum.
+  ASSERT_EQ(cache_files.size(), 2);
+  const std::string cache_path = (cache_dir + "/"
+                                  + (ends_with(cache_files[0], ".checksum")
+                                     ? cache_files[1]
+                                     : cache_files[0]));
+
+  // Loads the model and checks that the processed weights are identical to the reference.
+  // The weights read from the cache are views on the mapped cache file.
+  const auto check_processed_weights = [&](const bool expect_cache_hit) {
+    const auto model = models::Model::load(model_reader, Device::CPU, 0, ComputeType::INT8);
+    const auto processed_weights = get_processed_weights(*model);
+    ASSERT_EQ(processed_weights.size(), reference_weights.size());
+    for (const auto& pair : reference_weights) {
+      const auto it = processed_weights.find(pair.first);
+      ASSERT_TRUE(it != processed_weights.end()) << pair.first;
+      EXPECT_NE(it->second->owns_data(), expect_cache_hit) << pair.first;
+      expect_storage_eq(*it->second, *pair.second);
+    }
+  };
+
+  check_processed_weights(/*expect_cache_hit=*/true);
+
+  // The processed weights read from the cache are saved with all their data.
+  {
+    const std::string saved_dir = (::testing::TempDir()
+                                   + "ct2-saved-cached-model-" + std::to_string(getpid()));
+    ASSERT_EQ(mkdir(saved_dir.c_str(), 0755), 0);
+    models::Model::load(model_reader, Device::CPU, 0, ComputeType::INT8)->save(saved_dir, true);
+    copy_vocabularies(model_dir, saved_dir);
+    const auto saved_model = models::Model::load(saved_dir, Device::CPU, 0, ComputeType::INT8);
+    const auto saved_weights = get_processed_weights(*saved_model);
+    remove_model_dir(saved_dir);
+
+    ASSERT_EQ(saved_weights.size(), reference_weights.size());
+    for (const auto& pair : reference_weights) {
+      const StorageView& reference_weight = *pair.second;
+      const StorageView& saved_weight = *saved_weights.at(pair.first);
+      ASSERT_EQ(saved_weight.reserved_memory(), reference_weight.reserved_memory()) << pair.first;
+      EXPECT_EQ(std::memcmp(saved_weight.buffer(),
+                            reference_weight.buffer(),
+                            reference_weight.reserved_memory()), 0) << pair.first;
+    }
+  }
+
+  std::string content = read_file(cache_path);
+
+  // A truncated cache file is ignored and replaced by the recomputed weights.
+  std::ofstream(cache_path, std::ios_base::binary) << content.substr(0, content.size() / 2);
+  check_processed_weights(/*expect_cache_hit=*/false);
+  check_processed_weights(/*expect_cache_hit=*/true);
+
+  // Same for a cache file with corrupted data.
+  content.back() ^= 0xff;
+  std::ofstream(cache_path, std::ios_base::binary) << content;
+  check_processed_weights(/*expect_cache_hit=*/false);
+  check_processed_weights(/*expect_cache_hit=*/true);
+
+  std::remove(cache_path.c_str());
+  std::remove((cache_path + ".checksum").c_str());
+  rmdir(cache_dir.c_str());
+}
+
+TEST(ModelTest, ProcessedWeightsCacheFile) {
+  const std::string cache_path = (::testing::TempDir()
+                                  + "ct2-weights-cache-file-" + std::to_string(getpid()) + ".bin");
+  const std::string checksum_path = cache_path + ".checksum";
+  const StorageView packed_weight({2, 3}, std::vector<float>{1, 2, 3, 4, 5, 6});
+  const StorageView compensation({2}, std::vector<int32_t>{-7, 8});
+  ASSERT_TRUE(models::save_processed_weights(cache_path,
+                                             "TransformerSpec",
+                                             3,
+                                             {{"packed_weight", &packed_weight, 24},
+                                              {"compensation", &compensation, 8}}));
+
+  // The cache file is a regular model file: the checksum is saved in a separate file.
+  const models::ModelFileHeader header = read_model_header(cache_path);
+  EXPECT_EQ(header.spec, "TransformerSpec");
+  EXPECT_EQ(header.spec_revision, 3);
+  ASSERT_EQ(header.variables.size(), 2);
+
+  const auto read_processed_weights = [&cache_path]() {
+    std::vector<std::pair<models::VariableEntry, StorageView>> variables;
+    std::shared_ptr<const MappedFile> mapped_file;
+    std::map<std::string, StorageView> copied_variables;
+    if (models::read_processed_weights(cache_path, variables, mapped_file)) {
+      // The variables are copied before the file is unmapped.
+      for (const auto& pair : variables)
+        copied_variables.emplace(pair.first.name, pair.second);
+    }
+    return copied_variables;
+  };
+
+  {
+    const auto variables = read_processed_weights();
+    ASSERT_EQ(variables.size(), 2);
+    expect_storage_eq(variables.at("packed_weight"), packed_weight);
+    expect_storage_eq(variables.at("compensation"), compensation);
+  }
+
+  const std::string content = read_file(cache_path);
+  const std::string checksum = read_file(checksum_path);
+
+  // A truncated cache file is rejected.
+  std::ofstream(cache_path, std::ios_base::binary) << content.substr(0, content.size() - 1);
+  EXPECT_TRUE(read_processed_weights().empty());
+
+  // Same for a cache file with corrupted data.
+  std::string corrupted_content = content;
+  corrupted_content[header.variables[0].offset] ^= 0xff;
+  std::ofstream(cache_path, std::ios_base::binary) << corrupted_content;
+  EXPECT_TRUE(read_processed_weights().empty());
+
+  // Same for a wrong or missing checksum.
+  std::ofstream(cache_path, std::ios_base::binary) << content;
+  EXPECT_FALSE(read_processed_weights().empty());
+  std::ofstream(checksum_path) << "1234";
+  EXPECT_TRUE(read_processed_weights().empty());
+  std::remove(checksum_path.c_str());
+  EXPECT_TRUE(read_processed_weights().empty());
+
+  std::remove(cache_path.c_str());
+}
+
+#endif
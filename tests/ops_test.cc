@@ -342,6 +342,19 @@ TEST_P(OpDeviceTest, GatherData1D) {
   expect_storage_eq(output, expected);
 }
 
+TEST_P(OpDeviceTest, GatherInPlaceView) {
+  Device device = GetParam();
+  StorageView data({4, 2}, std::vector<float>{1, 1, 2, 2, 3, 3, 4, 4}, device);
+  StorageView ids({2}, std::vector<int32_t>{1, 3}, device);
+  StorageView expected({2, 2}, std::vector<float>{2, 2, 4, 4}, device);
+  StorageView original(data);
+  StorageView view(device);
+  view.shallow_copy(data);
+  ops::Gather(0)(view, ids);
+  expect_storage_eq(view, expected);
+  expect_storage_eq(data, original);
+}
+
 TEST_P(OpDeviceTest, GatherData1DIndex2D) {
   Device device = GetParam();
   StorageView data({4}, std::vector<float>{1, 2, 3, 4}, device);
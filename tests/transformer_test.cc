@@ -27,3 +27,97 @@ TEST(TransformerTest, PositionEncoderNoSharedState) {
     expect_storage_eq(input, expected, 1e-5);
   }
 }
+
+TEST(TransformerTest, DecoderForwardPrefix) {
+  const auto model = models::Model::load(g_data_dir + "/models/v2/aren-transliteration");
+  const auto& seq2seq_model = dynamic_cast<const models::SequenceToSequenceModel&>(*model);
+  auto encoder = seq2seq_model.make_encoder();
+  auto decoder = seq2seq_model.make_decoder();
+
+  const StorageView source_ids({2, 3}, std::vector<int32_t>{4, 5, 6, 7, 8, 0});
+  const StorageView source_lengths({2}, std::vector<int32_t>{3, 2});
+  StorageView memory;
+  (*encoder)(source_ids, source_lengths, memory);
+
+  layers::DecoderState state = decoder->initial_state();
+  state.emplace("memory", memory);
+  state.emplace("memory_lengths", source_lengths);
+  layers::DecoderState expected_state = state;
+
+  // Forcing the prefix in a single pass should match the step by step decoding.
+  const StorageView prefix_ids({2, 3}, std::vector<int32_t>{1, 5, 6, 1, 7, 8});
+  StorageView attention;
+  StorageView expected_attention;
+  decoder->forward_prefix(0, prefix_ids, state, &attention);
+  decoder->layers::Decoder::forward_prefix(0, prefix_ids, expected_state, &expected_attention);
+  expect_storage_eq(attention, expected_attention, 1e-5);
+  for (const auto& pair : expected_state)
+    expect_storage_eq(state.at(pair.first), pair.second, 1e-5);
+
+  const StorageView next_ids({2, 1}, std::vector<int32_t>{9, 10});
+  StorageView logits;
+  StorageView expected_logits;
+  (*decoder)(3, next_ids, state, &logits);
+  (*decoder)(3, next_ids, expected_state, &expected_logits);
+  expect_storage_eq(logits, expected_logits, 1e-4);
+}
+
+TEST(TransformerTest, DecoderForwardPrefixDifferentLengths) {
+  const auto model = models::Model::load(g_data_dir + "/models/v2/aren-transliteration");
+  const auto& seq2seq_model = dynamic_cast<const models::SequenceToSequenceModel&>(*model);
+  auto encoder = seq2seq_model.make_encoder();
+  auto decoder = seq2seq_model.make_decoder();
+
+  const auto make_state = [&encoder, &decoder](const StorageView& source_ids,
+                                               const StorageView& source_lengths) {
+    StorageView memory;
+    (*encoder)(source_ids, source_lengths, memory);
+    layers::DecoderState state = decoder->initial_state();
+    state.emplace("memory", memory);
+    state.emplace("memory_lengths", source_lengths);
+    return state;
+  };
+
+  // The prefixes are padded on the left and should match the prefixes run separately.
+  const std::vector<dim_t> lengths = {3, 1};
+  const std::vector<std::vector<int32_t>> prefixes = {{1, 5, 6}, {1}};
+  const std::vector<std::vector<int32_t>> sources = {{4, 5, 6}, {7, 8}};
+  layers::DecoderState state = make_state(
+    StorageView({2, 3}, std::vector<int32_t>{4, 5, 6, 7, 8, 0}),
+    StorageView({2}, std::vector<int32_t>{3, 2}));
+  StorageView attention;
+  decoder->forward_prefix(lengths,
+                          StorageView({2, 3}, std::vector<int32_t>{1, 5, 6, 0, 0, 1}),
+                          state,
+                          &attention);
+
+  const StorageView next_ids({2, 1}, std::vector<int32_t>{9, 10});
+  StorageView logits;
+  (*decoder)(lengths, next_ids, state, &logits);
+
+  for (dim_t b = 0; b < 2; ++b) {
+    const dim_t source_length = sources[b].size();
+    layers::DecoderState expected_state = make_state(
+      StorageView({1, source_length}, sources[b]),
+      StorageView({1}, std::vector<int32_t>{int32_t(source_length)}));
+    StorageView expected_attention;
+    decoder->forward_prefix(0,
+                            StorageView({1, lengths[b]}, prefixes[b]),
+                            expected_state,
+                            &expected_attention);
+    for (dim_t t = 0; t < lengths[b]; ++t) {
+      for (dim_t j = 0; j < source_length; ++j)
+        EXPECT_NEAR(attention.at<float>({b, 3 - lengths[b] + t, j}),
+                    expected_attention.at<float>({0, t, j}),
+                    1e-5);
+    }
+
+    StorageView expected_logits;
+    (*decoder)(lengths[b],
+               StorageView({1, 1}, std::vector<int32_t>{next_ids.at<int32_t>(b)}),
+               expected_state,
+               &expected_logits);
+    for (dim_t i = 0; i < expected_logits.dim(-1); ++i)
+      EXPECT_NEAR(logits.at<float>({b, 0, i}), expected_logits.at<float>({0, 0, i}), 1e-4);
+  }
+}
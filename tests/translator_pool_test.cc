@@ -0,0 +1,660 @@
+#include <cstdlib>
+
+#include <ctranslate2/translator_pool.h>
+
+#include "test_utils.h"
+
+extern std::string g_data_dir;
+
+static const std::vector<std::vector<std::string>> input = {{"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"}};
+static const std::vector<std::string> expected = {"a", "t", "z", "m", "o", "n"};
+
+TEST(TranslatorPoolTest, TranslateBatch) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  const auto results = pool.translate_batch(input, TranslationOptions());
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, MultipleModels) {
+  const std::string model_a = g_data_dir + "/models/v2/aren-transliteration";
+  const std::string model_b = g_data_dir + "/models/v6/aren-transliteration";
+
+  // The memory budget only allows a single model to be loaded.
+  const size_t model_size = models::Model::load(model_a)->get_memory_usage();
+  TranslatorPool pool(2, 1, model_size + model_size / 2);
+
+  for (const auto& model_id : {model_a, model_b, model_a}) {
+    const auto results = pool.translate_batch(model_id, input, TranslationOptions());
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].output(), expected);
+    EXPECT_EQ(pool.num_loaded_models(), 1);
+  }
+
+  EXPECT_EQ(pool.translate_batch_async(model_b, input, TranslationOptions()).get()[0].output(),
+            expected);
+  EXPECT_THROW(pool.translate_batch(input, TranslationOptions()), std::invalid_argument);
+}
+
+#ifndef _WIN32
+// Sets an environment variable until the end of the scope.
+class ScopedEnvironmentVariable {
+public:
+  ScopedEnvironmentVariable(const char* name, const char* value)
+    : _name(name) {
+    setenv(name, value, 1);
+  }
+  ~ScopedEnvironmentVariable() {
+    unsetenv(_name);
+  }
+
+private:
+  const char* _name;
+};
+
+TEST(TranslatorPoolTest, MultipleLazyModels) {
+  const ScopedEnvironmentVariable lazy_loading("CT2_USE_LAZY_LOADING", "1");
+  const std::string model_a = g_data_dir + "/models/v6/aren-transliteration";
+  const std::string model_b = model_a + "/.";  // Another id for the same model.
+
+  // The lazy models are charged with their full size before they are materialized, so the
+  // memory budget only allows a single model to be loaded.
+  const size_t model_size = models::Model::load(model_a)->get_full_memory_usage();
+  TranslatorPool pool(2, 1, model_size + model_size / 2);
+
+  for (const auto& model_id : {model_a, model_b, model_a}) {
+    const auto results = pool.translate_batch(model_id, input, TranslationOptions());
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].output(), expected);
+    EXPECT_EQ(pool.num_loaded_models(), 1);
+  }
+}
+#endif
+
+TEST(TranslatorPoolTest, MultipleModelsWithoutBudget) {
+  TranslatorPool pool(1, 1, /*max_models_memory=*/0);
+  pool.translate_batch(g_data_dir + "/models/v2/aren-transliteration", input, TranslationOptions());
+  pool.translate_batch(g_data_dir + "/models/v6/aren-transliteration", input, TranslationOptions());
+  EXPECT_EQ(pool.num_loaded_models(), 2);
+}
+
+TEST(TranslatorPoolTest, ReplaceModel) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  auto previous_model = pool.get_translators()[0].get_model();
+  std::weak_ptr<const models::Model> previous_model_ref = previous_model;
+  previous_model.reset();
+
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < 8; ++i)
+    futures.emplace_back(pool.translate_batch_async(input, TranslationOptions()));
+
+  pool.replace_model(models::Model::load(g_data_dir + "/models/v6/aren-transliteration"));
+  for (size_t i = 0; i < 8; ++i)
+    futures.emplace_back(pool.translate_batch_async(input, TranslationOptions()));
+
+  for (auto& future : futures)
+    EXPECT_EQ(future.get()[0].output(), expected);
+
+  // The translators eventually release the previous model.
+  for (size_t i = 0; i < 100 && !previous_model_ref.expired(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_TRUE(previous_model_ref.expired());
+
+  pool.replace_model(nullptr);
+  EXPECT_THROW(pool.translate_batch(input, TranslationOptions()), std::runtime_error);
+}
+
+class LazyModelReader : public models::ModelFileReader {
+public:
+  LazyModelReader(const std::string& model_dir)
+    : models::ModelFileReader(model_dir) {
+  }
+
+  bool lazy_load() const override {
+    return true;
+  }
+};
+
+TEST(TranslatorPoolTest, IdleModelTimeout) {
+  LazyModelReader model_reader(g_data_dir + "/models/v6/aren-transliteration");
+  const auto model = models::Model::load(model_reader);
+  const size_t memory_usage_after_load = model->get_memory_usage();
+
+  // The variables are materialized by the first job.
+  TranslatorPool pool(2, 1, model);
+  EXPECT_EQ(model->get_memory_usage(), memory_usage_after_load);
+  EXPECT_EQ(pool.translate_batch(input, TranslationOptions())[0].output(), expected);
+  EXPECT_GT(model->get_memory_usage(), memory_usage_after_load);
+
+  // The idle model releases its variables and they are materialized again by the next job.
+  pool.set_idle_model_timeout(std::chrono::milliseconds(10));
+  for (size_t i = 0; i < 100 && model->get_memory_usage() > 0; ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(model->get_memory_usage(), 0);
+  EXPECT_EQ(pool.translate_batch(input, TranslationOptions())[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, ContinuousBatching) {
+  const std::string model_path = g_data_dir + "/models/v2/aren-transliteration";
+  const std::vector<std::vector<std::vector<std::string>>> batches = {
+    {{"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"}, {"آ" ,"ز" ,"ا"}},
+    {{"آ" ,"ت" ,"ش" ,"ي" ,"س" ,"و" ,"ن"}},
+    {{}, {"آ" ,"ر" ,"ث" ,"ر"}, {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"}},
+    {{"آ" ,"ز" ,"ا"}},
+  };
+
+  TranslationOptions options;
+  options.beam_size = 1;
+  options.return_scores = true;
+
+  // Reference results with the static batching.
+  Translator translator(model_path);
+  std::vector<std::vector<TranslationResult>> expected_results;
+  for (size_t i = 0; i < batches.size(); ++i) {
+    options.max_decoding_length = (i == 3 ? 2 : 250);
+    expected_results.emplace_back(translator.translate_batch(batches[i], options));
+  }
+
+  // A single translator is used so that the queued batches join the running batch.
+  TranslatorPool pool(1, 1, model_path);
+  options.continuous_batching = true;
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < batches.size(); ++i) {
+    options.max_decoding_length = (i == 3 ? 2 : 250);
+    futures.emplace_back(pool.translate_batch_async(batches[i], options));
+  }
+
+  for (size_t i = 0; i < batches.size(); ++i) {
+    const auto results = futures[i].get();
+    const auto& expected = expected_results[i];
+    ASSERT_EQ(results.size(), expected.size());
+    for (size_t j = 0; j < results.size(); ++j) {
+      EXPECT_EQ(results[j].hypotheses(), expected[j].hypotheses());
+      ASSERT_EQ(results[j].has_scores(), expected[j].has_scores());
+      if (results[j].has_scores()) {
+        EXPECT_NEAR(results[j].score(), expected[j].score(), 1e-4);
+      }
+    }
+  }
+}
+
+TEST(TranslatorPoolTest, JobPriority) {
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+  const std::vector<std::vector<std::string>> long_input(16, input[0]);
+
+  TranslationOptions low_priority_options;
+  low_priority_options.priority = -1;
+  std::vector<std::future<std::vector<TranslationResult>>> low_priority_futures;
+  for (size_t i = 0; i < 8; ++i)
+    low_priority_futures.emplace_back(pool.translate_batch_async(long_input,
+                                                                 low_priority_options));
+
+  TranslationOptions high_priority_options;
+  high_priority_options.priority = 1;
+  auto high_priority_future = pool.translate_batch_async(input, high_priority_options);
+  EXPECT_EQ(high_priority_future.get()[0].output(), expected);
+
+  // The high priority job was run before the low priority jobs that were still queued.
+  EXPECT_NE(low_priority_futures.back().wait_for(std::chrono::seconds(0)),
+            std::future_status::ready);
+  for (auto& future : low_priority_futures)
+    EXPECT_EQ(future.get()[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, JobDeadline) {
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+
+  TranslationOptions options;
+  options.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+  EXPECT_EQ(pool.translate_batch_async(input, options).get()[0].output(), expected);
+
+  options.deadline = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+  EXPECT_THROW(pool.translate_batch_async(input, options).get(), std::runtime_error);
+  EXPECT_THROW(pool.translate_batch(input, options), std::runtime_error);
+}
+
+TEST(TranslatorPoolTest, CancelledJob) {
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+
+  TranslationOptions options;
+  options.cancellation_token = std::make_shared<CancellationToken>();
+  EXPECT_EQ(pool.translate_batch_async(input, options).get()[0].output(), expected);
+
+  options.cancellation_token->cancel();
+  EXPECT_THROW(pool.translate_batch_async(input, options).get(), std::runtime_error);
+
+  Translator translator(g_data_dir + "/models/v2/aren-transliteration");
+  EXPECT_THROW(translator.translate_batch(input, options), std::runtime_error);
+}
+
+TEST(TranslatorPoolTest, CancelRunningJobs) {
+  for (const bool continuous_batching : {false, true}) {
+    TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+
+    TranslationOptions options;
+    options.continuous_batching = continuous_batching;
+    // This translation does not end before it is cancelled.
+    auto cancelled_options = options;
+    cancelled_options.min_decoding_length = 1000000;
+    cancelled_options.max_decoding_length = 1000000;
+    cancelled_options.cancellation_token = std::make_shared<CancellationToken>();
+
+    auto cancelled_future = pool.translate_batch_async(input, cancelled_options);
+    auto future = pool.translate_batch_async(input, options);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    cancelled_options.cancellation_token->cancel();
+    EXPECT_THROW(cancelled_future.get(), std::runtime_error);
+    EXPECT_EQ(future.get()[0].output(), expected);
+  }
+}
+
+TEST(TranslatorPoolTest, CancelMergedJobs) {
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_micro_batching(std::chrono::milliseconds(10));
+
+  // The jobs are merged and each one is stopped separately.
+  TranslationOptions options;
+  options.min_decoding_length = 1000000;
+  options.max_decoding_length = 1000000;
+  auto cancelled_options = options;
+  cancelled_options.cancellation_token = std::make_shared<CancellationToken>();
+  options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
+
+  auto cancelled_future = pool.translate_batch_async(input, cancelled_options);
+  auto future = pool.translate_batch_async(input, options);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  cancelled_options.cancellation_token->cancel();
+  EXPECT_THROW(cancelled_future.get(), std::runtime_error);
+  EXPECT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(TranslatorPoolTest, StepCallback) {
+  const std::vector<std::vector<std::vector<std::string>>> batches = {
+    {{"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"}, {"آ" ,"ز" ,"ا"}},
+    {{"آ" ,"ت" ,"ش" ,"ي" ,"س" ,"و" ,"ن"}},
+  };
+
+  for (const bool continuous_batching : {false, true}) {
+    TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+    pool.set_micro_batching(std::chrono::milliseconds(100));
+
+    std::vector<std::vector<std::vector<std::string>>> outputs(batches.size());
+    std::vector<std::future<std::vector<TranslationResult>>> futures;
+    for (size_t b = 0; b < batches.size(); ++b) {
+      // The callbacks are called from the translator thread.
+      auto& batch_outputs = outputs[b];
+      batch_outputs.resize(batches[b].size());
+      TranslationOptions options;
+      options.continuous_batching = continuous_batching;
+      options.callback = [&batch_outputs](const TranslationStepResult& result) {
+        auto& output = batch_outputs[result.batch_id];
+        output.insert(output.end(), result.tokens.begin(), result.tokens.end());
+      };
+      futures.emplace_back(pool.translate_batch_async(batches[b], options));
+    }
+
+    for (size_t b = 0; b < batches.size(); ++b) {
+      const auto results = futures[b].get();
+      for (size_t i = 0; i < results.size(); ++i)
+        EXPECT_EQ(outputs[b][i], results[i].output());
+    }
+  }
+}
+
+TEST(TranslatorPoolTest, MemoryBudget) {
+  const std::vector<std::vector<std::string>> batch = {
+    {"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"},
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+  };
+  const std::vector<std::vector<std::string>> expected_outputs = {
+    {"a", "r", "b", "a", "k", "e"},
+    {"a", "z", "z", "a"},
+    {"a", "t", "z", "m", "o", "n"},
+  };
+
+  Translator translator(g_data_dir + "/models/v2/aren-transliteration");
+  const size_t example_memory_usage = translator.estimate_memory_usage({batch[0]},
+                                                                      {},
+                                                                      TranslationOptions());
+  ASSERT_GT(example_memory_usage, 0);
+  EXPECT_EQ(translator.estimate_memory_usage(batch, {}, TranslationOptions()),
+            batch.size() * example_memory_usage);
+
+  for (const bool continuous_batching : {false, true}) {
+    TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+    TranslationOptions options;
+    options.continuous_batching = continuous_batching;
+
+    // The batch is translated in smaller batches that fit in the budget.
+    pool.set_memory_budget(2 * example_memory_usage);
+    std::vector<std::future<std::vector<TranslationResult>>> futures;
+    for (size_t i = 0; i < 4; ++i)
+      futures.emplace_back(pool.translate_batch_async(batch, options));
+    for (auto& future : futures) {
+      const auto results = future.get();
+      ASSERT_EQ(results.size(), expected_outputs.size());
+      for (size_t i = 0; i < results.size(); ++i)
+        EXPECT_EQ(results[i].output(), expected_outputs[i]);
+    }
+    EXPECT_EQ(pool.estimated_memory_usage(), 0);
+
+    // A single example does not fit in the budget.
+    pool.set_memory_budget(example_memory_usage / 2);
+    EXPECT_THROW(pool.translate_batch_async(batch, options).get(), std::runtime_error);
+    EXPECT_EQ(pool.estimated_memory_usage(), 0);
+  }
+}
+
+TEST(TranslatorPoolTest, Pipelining) {
+  const std::vector<std::vector<std::string>> batch = {
+    {"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"},
+    {"آ" ,"ز" ,"ا"},
+    {},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+  };
+  const std::vector<std::vector<std::string>> expected_outputs = {
+    {"a", "r", "b", "a", "k", "e"},
+    {"a", "z", "z", "a"},
+    {},
+    {"a", "t", "z", "m", "o", "n"},
+  };
+
+  TranslatorPool pool(3, 1, g_data_dir + "/models/v2/aren-transliteration");
+  EXPECT_THROW(pool.set_pipelining(3), std::invalid_argument);
+  pool.set_pipelining(1);
+
+  // The first translator encodes the jobs while the other translators decode them.
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < 20; ++i) {
+    TranslationOptions options;
+    options.max_batch_size = 2;
+    options.continuous_batching = (i % 5 == 0);
+    futures.emplace_back(pool.translate_batch_async(batch, options));
+  }
+
+  for (auto& future : futures) {
+    const auto results = future.get();
+    ASSERT_EQ(results.size(), expected_outputs.size());
+    for (size_t i = 0; i < results.size(); ++i)
+      EXPECT_EQ(results[i].output(), expected_outputs[i]);
+  }
+
+  pool.set_pipelining(0);
+  EXPECT_EQ(pool.translate_batch(batch, TranslationOptions())[3].output(), expected_outputs[3]);
+}
+
+TEST(TranslatorPoolTest, ShutdownWithPendingJobs) {
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  {
+    TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+    pool.set_pipelining(1);
+    for (size_t i = 0; i < 20; ++i)
+      futures.emplace_back(pool.translate_batch_async(input, TranslationOptions()));
+  }
+
+  // The jobs that were not translated when the pool is destroyed fail with an explicit error.
+  for (auto& future : futures) {
+    try {
+      EXPECT_EQ(future.get()[0].output(), expected);
+    } catch (const std::future_error& e) {
+      ADD_FAILURE() << "Unexpected future error: " << e.what();
+    } catch (const std::runtime_error& e) {
+      EXPECT_STREQ(e.what(), "The translator pool is shutting down");
+    }
+  }
+}
+
+TEST(TranslatorPoolTest, DecodingCostBatching) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  EXPECT_EQ(pool.estimated_target_length_ratio(), 1);
+
+  TranslationOptions options;
+  options.max_batch_size = 16;
+  options.batch_type = BatchType::DecodingCost;
+  const std::vector<std::vector<std::string>> batch = {
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+  };
+  const auto results = pool.translate_batch(batch, options);
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_EQ(results[0].output(), (std::vector<std::string>{"a", "z", "z", "a"}));
+  EXPECT_EQ(results[1].output(), expected);
+
+  // The ratio is fitted on the completed translations: 10 target tokens for 9 source tokens.
+  EXPECT_FLOAT_EQ(pool.estimated_target_length_ratio(), 10.f / 9.f);
+
+  options.target_length_ratio = -1;
+  EXPECT_THROW(pool.translate_batch(batch, options), std::invalid_argument);
+}
+
+TEST(TranslatorPoolTest, TranslationCache) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_translation_cache(1 << 20);
+  EXPECT_EQ(pool.translation_cache_hit_ratio(), 0);
+
+  TranslationOptions options;
+  EXPECT_EQ(pool.translate_batch(input, options)[0].output(), expected);
+  EXPECT_EQ(pool.translation_cache_hit_ratio(), 0);
+  EXPECT_EQ(pool.translate_batch(input, options)[0].output(), expected);
+  EXPECT_FLOAT_EQ(pool.translation_cache_hit_ratio(), 0.5);
+
+  // Only the missing examples are translated and the results keep the input order.
+  const std::vector<std::vector<std::string>> batch = {{"آ" ,"ز" ,"ا"}, {}, input[0]};
+  const auto results = pool.translate_batch(batch, options);
+  ASSERT_EQ(results.size(), 3);
+  EXPECT_EQ(results[0].output(), (std::vector<std::string>{"a", "z", "z", "a"}));
+  EXPECT_TRUE(results[1].output().empty());
+  EXPECT_EQ(results[2].output(), expected);
+  EXPECT_FLOAT_EQ(pool.translation_cache_hit_ratio(), 0.5);
+
+  // The cache key includes the options changing the result.
+  options.num_hypotheses = 2;
+  EXPECT_EQ(pool.translate_batch(input, options)[0].num_hypotheses(), 2);
+  EXPECT_FLOAT_EQ(pool.translation_cache_hit_ratio(), 0.4);
+
+  // Random sampling is not cached.
+  options.num_hypotheses = 1;
+  options.beam_size = 1;
+  options.sampling_topk = 5;
+  pool.translate_batch(input, options);
+  EXPECT_FLOAT_EQ(pool.translation_cache_hit_ratio(), 0.4);
+
+  pool.set_translation_cache(0);
+  EXPECT_EQ(pool.translation_cache_hit_ratio(), 0);
+}
+
+TEST(TranslatorPoolTest, TranslationCacheEviction) {
+  const TranslationResult result(std::vector<std::vector<std::string>>{{"a", "b"}});
+  size_t entry_size = 0;
+  {
+    TranslationCache cache(1 << 20);
+    cache.put("a", nullptr, result);
+    entry_size = cache.memory_usage();
+  }
+
+  TranslationCache cache(2 * entry_size + entry_size / 2, /*num_shards=*/1);
+  std::vector<TranslationResult> results;
+  cache.put("a", nullptr, result);
+  cache.put("b", nullptr, result);
+  EXPECT_TRUE(cache.get("a", nullptr, results));
+  cache.put("c", nullptr, result);  // Evicts "b" which is the least recently used.
+  EXPECT_FALSE(cache.get("b", nullptr, results));
+  EXPECT_TRUE(cache.get("a", nullptr, results));
+  EXPECT_TRUE(cache.get("c", nullptr, results));
+  EXPECT_EQ(results.size(), 3);
+  EXPECT_EQ(cache.memory_usage(), 2 * entry_size);
+}
+
+TEST(TranslatorPoolTest, EncoderCache) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_encoder_cache(1 << 20);
+  EXPECT_EQ(pool.translate_batch(input, {{"a"}}, TranslationOptions())[0].output(), expected);
+  EXPECT_EQ(pool.translate_batch(input, {{"a", "t"}}, TranslationOptions())[0].output(),
+            expected);
+  EXPECT_FLOAT_EQ(pool.encoder_cache_hit_ratio(), 0.5);
+  pool.set_encoder_cache(0);
+  EXPECT_EQ(pool.encoder_cache_hit_ratio(), 0);
+}
+
+TEST(TranslatorPoolTest, MicroBatching) {
+  const std::vector<std::vector<std::vector<std::string>>> batches = {
+    {{"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"}},
+    {{"آ" ,"ز" ,"ا"}, {}},
+    {{"آ" ,"ت" ,"ش" ,"ي" ,"س" ,"و" ,"ن"}},
+    {{"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"}, {"آ" ,"ر" ,"ث" ,"ر"}},
+  };
+
+  Translator translator(g_data_dir + "/models/v2/aren-transliteration");
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_micro_batching(std::chrono::seconds(10), /*max_tokens=*/24);
+
+  // The jobs are held until they contain 24 tokens, i.e. when the last job is posted.
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (const auto& batch : batches)
+    futures.emplace_back(pool.translate_batch_async(batch, TranslationOptions()));
+
+  for (size_t i = 0; i < batches.size(); ++i) {
+    const auto results = futures[i].get();
+    const auto expected_results = translator.translate_batch(batches[i]);
+    ASSERT_EQ(results.size(), expected_results.size());
+    for (size_t j = 0; j < results.size(); ++j)
+      EXPECT_EQ(results[j].hypotheses(), expected_results[j].hypotheses());
+  }
+
+  // A job is translated when it waited for the maximum delay.
+  pool.set_micro_batching(std::chrono::milliseconds(10));
+  EXPECT_EQ(pool.translate_batch_async(input, TranslationOptions()).get()[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, MicroBatchingAlternatives) {
+  // Alternatives can not be returned from a prefix in a batch, so these jobs are not merged.
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_micro_batching(std::chrono::milliseconds(10));
+  TranslationOptions options;
+  options.num_hypotheses = 3;
+  options.return_alternatives = true;
+  const std::vector<std::vector<std::string>> target_prefix = {{"a", "t"}};
+
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < 4; ++i)
+    futures.emplace_back(pool.translate_batch_async(input, target_prefix, options));
+  for (auto& future : futures) {
+    const auto results = future.get();
+    ASSERT_EQ(results.size(), 1);
+    ASSERT_EQ(results[0].num_hypotheses(), 3);
+    EXPECT_EQ(results[0].output(), expected);
+  }
+}
+
+TEST(TranslatorPoolTest, MicroBatchingWaitingJobs) {
+  TranslatorPool pool(1, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_micro_batching(std::chrono::seconds(10));
+
+  // The first job waits for other jobs to be merged with, but the next jobs that can not be
+  // merged with it are translated in the meantime.
+  auto waiting_future = pool.translate_batch_async(input, TranslationOptions());
+  EXPECT_EQ(pool.translate_batch(input, TranslationOptions())[0].output(), expected);
+  EXPECT_EQ(waiting_future.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+  pool.set_micro_batching(std::chrono::microseconds(0));
+  EXPECT_EQ(waiting_future.get()[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, WorkStealing) {
+  TranslatorPool pool(4, 1, g_data_dir + "/models/v2/aren-transliteration");
+
+  // Jobs of different sizes so that some translators become idle and steal queued jobs.
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < 32; ++i) {
+    const std::vector<std::vector<std::string>> batch(i % 4 == 0 ? 16 : 1, input[0]);
+    futures.emplace_back(pool.translate_batch_async(batch, TranslationOptions()));
+  }
+
+  for (size_t i = 0; i < futures.size(); ++i) {
+    const auto results = futures[i].get();
+    ASSERT_EQ(results.size(), i % 4 == 0 ? 16 : 1);
+    for (const auto& result : results)
+      EXPECT_EQ(result.output(), expected);
+  }
+  EXPECT_EQ(pool.num_queued_batches(), 0);
+}
+
+TEST(TranslatorPoolTest, PriorityAcrossQueues) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+
+  // Block both translators with a job waiting in the step callback.
+  std::promise<void> entered[2];
+  std::atomic<bool> has_entered[2] = {{false}, {false}};
+  std::promise<void> release[2];
+  std::shared_future<void> released[2] = {release[0].get_future(), release[1].get_future()};
+  std::vector<std::future<std::vector<TranslationResult>>> blocking_futures;
+  for (size_t i = 0; i < 2; ++i) {
+    TranslationOptions options;
+    options.callback = [&entered, &has_entered, &released, i](const TranslationStepResult&) {
+      if (!has_entered[i].exchange(true))
+        entered[i].set_value();
+      released[i].wait();
+    };
+    blocking_futures.emplace_back(pool.translate_batch_async(input, options));
+  }
+  entered[0].get_future().wait();
+  entered[1].get_future().wait();
+
+  // The jobs are posted alternately to the queues of the busy translators, so each queue
+  // holds a high priority job behind low priority jobs.
+  std::mutex order_mutex;
+  std::vector<int> order;
+  const auto post = [&pool, &order_mutex, &order](int id, int priority) {
+    TranslationOptions options;
+    options.priority = priority;
+    options.callback = [&order_mutex, &order, id](const TranslationStepResult&) {
+      std::lock_guard<std::mutex> lock(order_mutex);
+      if (order.empty() || order.back() != id)
+        order.emplace_back(id);
+    };
+    return pool.translate_batch_async(input, options);
+  };
+
+  std::vector<std::future<std::vector<TranslationResult>>> low_priority_futures;
+  for (int id = 0; id < 4; ++id)
+    low_priority_futures.emplace_back(post(id, -1));
+  auto high_priority_future_a = post(4, 1);
+  auto high_priority_future_b = post(5, 1);
+
+  // The released translator runs both high priority jobs first, including the one queued
+  // for the other translator.
+  release[0].set_value();
+  EXPECT_EQ(high_priority_future_a.get()[0].output(), expected);
+  EXPECT_EQ(high_priority_future_b.get()[0].output(), expected);
+  {
+    std::lock_guard<std::mutex> lock(order_mutex);
+    ASSERT_GE(order.size(), 2);
+    EXPECT_EQ(order[0], 4);
+    EXPECT_EQ(order[1], 5);
+  }
+
+  release[1].set_value();
+  for (auto& future : blocking_futures)
+    EXPECT_EQ(future.get()[0].output(), expected);
+  for (auto& future : low_priority_futures)
+    EXPECT_EQ(future.get()[0].output(), expected);
+}
+
+TEST(TranslatorPoolTest, MicroBatchingMultipleQueues) {
+  TranslatorPool pool(2, 1, g_data_dir + "/models/v2/aren-transliteration");
+  pool.set_micro_batching(std::chrono::milliseconds(10));
+
+  // Jobs with different options are merged in separate groups that can be queued for
+  // different translators.
+  std::vector<std::future<std::vector<TranslationResult>>> futures;
+  for (size_t i = 0; i < 16; ++i) {
+    TranslationOptions options;
+    options.beam_size = 1 + i % 4;
+    futures.emplace_back(pool.translate_batch_async(input, options));
+  }
+
+  for (auto& future : futures)
+    EXPECT_EQ(future.get()[0].output(), expected);
+  EXPECT_EQ(pool.num_queued_batches(), 0);
+}
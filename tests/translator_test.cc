@@ -21,11 +21,12 @@ static std::string beam_to_test_name(::testing::TestParamInfo<size_t> param_info
     return "BeamSearch";
 }
 
-static void check_weights_dtype(const std::unordered_map<std::string, StorageView>& variables,
-                                DataType expected_dtype) {
+static void
+check_weights_dtype(const std::unordered_map<std::string, const StorageView*>& variables,
+                    DataType expected_dtype) {
   for (const auto& variable : variables) {
     const auto& name = variable.first;
-    const auto& value = variable.second;
+    const auto& value = *variable.second;
     if (ends_with(name, "weight")) {
       EXPECT_EQ(value.dtype(), expected_dtype) << "Expected type " << dtype_name(expected_dtype)
                                                << " for weight " << name << ", got "
@@ -84,7 +85,8 @@ INSTANTIATE_TEST_CASE_P(
     std::make_pair("v1/aren-transliteration-i16", DataType::INT16),
     std::make_pair("v2/aren-transliteration", DataType::FLOAT),
     std::make_pair("v2/aren-transliteration-i16", DataType::INT16),
-    std::make_pair("v2/aren-transliteration-i8", DataType::INT8)
+    std::make_pair("v2/aren-transliteration-i8", DataType::INT8),
+    std::make_pair("v6/aren-transliteration", DataType::FLOAT)
     ),
   path_to_test_name);
 
@@ -191,6 +193,32 @@ TEST_P(SearchVariantTest, TranslateBatch) {
   EXPECT_EQ(result[1].output(), expected[1]);
 }
 
+TEST_P(SearchVariantTest, StepCallback) {
+  Translator translator = default_translator();
+  TranslationOptions options;
+  options.beam_size = GetParam();
+  options.max_batch_size = 1;
+  std::vector<std::vector<std::string>> inputs = {
+    {"آ", "ت", "ز", "م", "و", "ن"},
+    {"آ", "ز", "ا"}};
+  std::vector<std::vector<std::string>> outputs(inputs.size());
+  std::vector<size_t> num_last(inputs.size(), 0);
+  options.callback = [&](const TranslationStepResult& result) {
+    ASSERT_LT(result.batch_id, inputs.size());
+    ASSERT_EQ(num_last[result.batch_id], 0);
+    auto& output = outputs[result.batch_id];
+    output.insert(output.end(), result.tokens.begin(), result.tokens.end());
+    if (result.is_last)
+      num_last[result.batch_id] += 1;
+  };
+
+  auto results = translator.translate_batch(inputs, options);
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(outputs[i], results[i].output());
+    EXPECT_EQ(num_last[i], 1);
+  }
+}
+
 TEST_P(SearchVariantTest, ReplaceUnknowns) {
   const auto beam_size = GetParam();
   Translator translator = default_translator();
@@ -232,6 +260,32 @@ TEST(TranslatorTest, TranslateBatchWithMaxBatchSize) {
   EXPECT_EQ(results[4].output(), (std::vector<std::string>{"a", "r", "t", "h", "e", "r"}));
 }
 
+TEST(TranslatorTest, EncodeAndDecodeBatch) {
+  Translator encoder = default_translator();
+  Translator decoder(encoder);
+  TranslationOptions options;
+  options.max_batch_size = 2;
+  std::vector<std::vector<std::string>> inputs = {
+    {"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"},
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"}};
+  const auto expected_results = encoder.translate_batch(inputs, options);
+
+  auto batches = encoder.encode_batch(inputs, {}, options);
+  ASSERT_EQ(batches.size(), 2);
+  std::vector<TranslationResult> results(inputs.size(), TranslationResult(1, false));
+  for (auto& batch : batches) {
+    EXPECT_EQ(batch.state.count("memory"), 1);
+    auto batch_results = decoder.decode_batch(batch, options);
+    ASSERT_EQ(batch_results.size(), batch.example_index.size());
+    for (size_t i = 0; i < batch_results.size(); ++i)
+      results[batch.example_index[i]] = std::move(batch_results[i]);
+  }
+
+  for (size_t i = 0; i < inputs.size(); ++i)
+    EXPECT_EQ(results[i].output(), expected_results[i].output());
+}
+
 TEST(TranslatorTest, TranslateEmptyBatch) {
   Translator translator = default_translator();
   std::vector<std::vector<std::string>> inputs;
@@ -300,6 +354,62 @@ TEST(TranslatorTest, TranslateBatchWithPrefixAndEmpty) {
   EXPECT_EQ(result[4].output(), (std::vector<std::string>{"a", "z", "z", "a"}));
 }
 
+TEST(TranslatorTest, TranslateBatchWithPrefixesOfDifferentLengths) {
+  // The prefixes are padded on the left and forced in a single decoder call, then each
+  // example starts the search at its own step.
+  Translator translator = default_translator();
+  const std::vector<std::vector<std::string>> input = {
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"}};
+  const std::vector<std::vector<std::string>> prefix = {
+    {"a", "t", "s"},
+    {"a", "t", "z", "o"},
+    {"a", "z"},
+    {}};
+  const std::vector<std::vector<std::string>> expected_output = {
+    {"a", "t", "s", "u", "m", "o", "n"},
+    {"a", "t", "z", "o", "m", "o", "n"},
+    {"a", "z", "z", "a"},
+    {"a", "t", "z", "m", "o", "n"}};
+
+  for (const size_t beam_size : {1, 4}) {
+    for (const float length_penalty : {0.f, 1.f}) {
+      TranslationOptions options;
+      options.beam_size = beam_size;
+      options.length_penalty = length_penalty;
+      options.min_decoding_length = 4;
+      options.return_attention = true;
+      const auto results = translator.translate_batch_with_prefix(input, prefix, options);
+      ASSERT_EQ(results.size(), input.size());
+      for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].output(), expected_output[i]);
+        EXPECT_EQ(results[i].attention()[0].size(), expected_output[i].size());
+        const auto result = translator.translate_with_prefix(input[i], prefix[i], options);
+        EXPECT_EQ(results[i].output(), result.output());
+        EXPECT_NEAR(results[i].score(), result.score(), 1e-4);
+        for (size_t t = 0; t < result.attention()[0].size(); ++t) {
+          for (size_t j = 0; j < result.attention()[0][t].size(); ++j)
+            EXPECT_NEAR(results[i].attention()[0][t][j], result.attention()[0][t][j], 1e-4);
+        }
+      }
+
+      // The prefix tokens are streamed before the generated tokens.
+      std::vector<std::vector<std::string>> streamed_output(input.size());
+      options.callback = [&streamed_output](const TranslationStepResult& result) {
+        auto& output = streamed_output[result.batch_id];
+        output.insert(output.end(), result.tokens.begin(), result.tokens.end());
+      };
+      const auto streamed_results = translator.translate_batch_with_prefix(input, prefix, options);
+      for (size_t i = 0; i < streamed_results.size(); ++i) {
+        EXPECT_EQ(streamed_results[i].output(), expected_output[i]);
+        EXPECT_EQ(streamed_output[i], expected_output[i]);
+      }
+    }
+  }
+}
+
 TEST(TranslatorTest, TranslatePrefixWithLargeBeam) {
   // Related to issue https://github.com/OpenNMT/CTranslate2/issues/277
   // This is an example where </s> appears in the topk of the first unconstrained decoding
@@ -399,6 +509,171 @@ TEST(TranslatorTest, InvalidNumHypotheses) {
   EXPECT_THROW(translator.translate(input, options), std::invalid_argument);
 }
 
+TEST(TranslatorTest, RebatchDecodingCost) {
+  const std::vector<std::vector<std::string>> source = {
+    {"a", "b"},
+    {"a", "b", "c", "d"},
+    {"a"},
+    {"b", "c"},
+  };
+  TranslationOptions options;
+  options.max_batch_size = 12;
+  options.batch_type = BatchType::DecodingCost;
+  options.beam_size = 2;
+
+  // The decoding costs are 8, 4, 4, and 2.
+  options.target_length_ratio = 1;
+  auto batches = rebatch_input(source, {}, options);
+  ASSERT_EQ(batches.size(), 2);
+  EXPECT_EQ(batches[0].example_index, (std::vector<size_t>{1, 0}));
+  EXPECT_EQ(batches[1].example_index, (std::vector<size_t>{3, 2}));
+
+  // The decoding costs are 12, 6, 6, and 4.
+  options.target_length_ratio = 1.5;
+  batches = rebatch_input(source, {}, options);
+  ASSERT_EQ(batches.size(), 3);
+  EXPECT_EQ(batches[0].example_index, (std::vector<size_t>{1}));
+  EXPECT_EQ(batches[1].example_index, (std::vector<size_t>{0, 3}));
+  EXPECT_EQ(batches[2].example_index, (std::vector<size_t>{2}));
+
+  // The target length is bounded by max_decoding_length.
+  options.max_decoding_length = 1;
+  batches = rebatch_input(source, {}, options);
+  ASSERT_EQ(batches.size(), 1);
+}
+
+TEST(TranslatorTest, RebatchDuplicates) {
+  const std::vector<std::vector<std::string>> source = {
+    {"a", "b"},
+    {"a", "b", "c"},
+    {},
+    {"a", "b"},
+    {"a", "b"},
+  };
+  const std::vector<std::vector<std::string>> target = {{"x"}, {}, {}, {"x"}, {"y"}};
+  TranslationOptions options;
+
+  auto batches = rebatch_input(source, target, options);
+  ASSERT_EQ(batches.size(), 1);
+  EXPECT_EQ(batches[0].example_index, (std::vector<size_t>{1, 0, 4}));
+  EXPECT_EQ(batches[0].duplicates, (std::vector<std::pair<size_t, size_t>>{{1, 3}}));
+
+  // Random sampling does not produce the same output for identical examples.
+  options.beam_size = 1;
+  options.sampling_topk = 10;
+  batches = rebatch_input(source, target, options);
+  ASSERT_EQ(batches.size(), 1);
+  EXPECT_EQ(batches[0].example_index.size(), 4);
+  EXPECT_TRUE(batches[0].duplicates.empty());
+}
+
+TEST(TranslatorTest, TranslateBatchWithDuplicates) {
+  Translator translator = default_translator();
+  const std::vector<std::vector<std::string>> batch = {
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+    {"آ" ,"ز" ,"ا"},
+    {},
+    {"آ" ,"ز" ,"ا"},
+  };
+  TranslationOptions options;
+  options.max_batch_size = 1;
+  const auto results = translator.translate_batch(batch, options);
+  ASSERT_EQ(results.size(), 5);
+  for (size_t i : {0, 2, 4})
+    EXPECT_EQ(results[i].output(), (std::vector<std::string>{"a", "z", "z", "a"}));
+  EXPECT_EQ(results[1].output(), (std::vector<std::string>{"a", "t", "z", "m", "o", "n"}));
+  EXPECT_TRUE(results[3].output().empty());
+}
+
+TEST(TranslatorTest, EncoderCache) {
+  Translator translator = default_translator();
+  Translator cached_translator = default_translator();
+  auto cache = std::make_shared<EncoderCache>(1 << 20);
+  cached_translator.set_encoder_cache(cache);
+
+  const std::vector<std::vector<std::string>> source = {
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+    {"آ" ,"ز" ,"ا"},
+    {"آ" ,"ر" ,"ب" ,"ا" ,"ك" ,"ه"},
+  };
+  const std::vector<std::vector<std::vector<std::string>>> target_prefixes = {
+    {{"a"}, {"a"}, {"a"}},
+    {{"a", "t"}, {"a", "z"}, {"a", "r", "b"}},
+    {{"a", "c"}, {}, {"o"}},
+  };
+  const std::vector<std::vector<size_t>> batches_index = {{0, 1}, {1, 0}, {2, 0, 1}};
+  const std::vector<float> expected_hit_ratios = {0, 0.5, 4.f / 7.f};
+
+  for (size_t i = 0; i < batches_index.size(); ++i) {
+    const auto& index = batches_index[i];
+    const auto batch_source = index_vector(source, index);
+    const auto batch_target_prefix = index_vector(target_prefixes[i], index);
+    const auto expected_results = translator.translate_batch_with_prefix(batch_source,
+                                                                         batch_target_prefix,
+                                                                         TranslationOptions());
+    const auto results = cached_translator.translate_batch_with_prefix(batch_source,
+                                                                       batch_target_prefix,
+                                                                       TranslationOptions());
+    ASSERT_EQ(results.size(), expected_results.size());
+    for (size_t b = 0; b < results.size(); ++b)
+      EXPECT_EQ(results[b].output(), expected_results[b].output());
+    EXPECT_FLOAT_EQ(cache->hit_ratio(), expected_hit_ratios[i]);
+  }
+
+  EXPECT_GT(cache->memory_usage(), 0);
+  cached_translator.set_encoder_cache(nullptr);
+  cached_translator.translate_batch(source);
+  EXPECT_FLOAT_EQ(cache->hit_ratio(), 4.f / 7.f);
+}
+
+TEST(TranslatorTest, TranslateWithSession) {
+  Translator translator = default_translator();
+  TranslationSession session;
+  const std::vector<std::vector<std::string>> source = {
+    {"آ" ,"ت" ,"ز" ,"م" ,"و" ,"ن"},
+    {"آ" ,"ز" ,"ا"},
+  };
+  // Pairs (source index, target prefix): the session is reset when the prefix is not
+  // extended or the source changes. Repeating a prefix checks that the decoding did not
+  // modify the session state.
+  const std::vector<std::pair<size_t, std::vector<std::string>>> requests = {
+    {0, {}},
+    {0, {"a"}},
+    {0, {"a", "t"}},
+    {0, {"a", "t"}},
+    {0, {"a", "t", "z", "m"}},
+    {0, {"a", "c"}},
+    {0, {"a", "c", "z"}},
+    {1, {"a", "z"}},
+  };
+
+  for (const size_t beam_size : {1, 2}) {
+    for (const bool return_alternatives : {false, true}) {
+      TranslationOptions options;
+      options.beam_size = beam_size;
+      options.return_attention = true;
+      options.return_alternatives = return_alternatives;
+      options.num_hypotheses = return_alternatives ? 3 : 1;
+
+      for (const auto& request : requests) {
+        const auto& example = source[request.first];
+        const auto& target_prefix = request.second;
+        const auto expected = translator.translate_with_prefix(example, target_prefix, options);
+        const auto result = translator.translate_with_session(example,
+                                                              target_prefix,
+                                                              options,
+                                                              session);
+        ASSERT_EQ(result.num_hypotheses(), expected.num_hypotheses());
+        for (size_t h = 0; h < result.num_hypotheses(); ++h) {
+          EXPECT_EQ(result.hypotheses()[h], expected.hypotheses()[h]);
+          EXPECT_EQ(result.attention()[h].size(), result.hypotheses()[h].size());
+        }
+      }
+    }
+  }
+}
+
 TEST(TranslatorTest, IgnoreScore) {
   Translator translator = default_translator();
   TranslationOptions options;